@@ -0,0 +1,118 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "device_imu.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal) {
+	(void) signal;
+	running = 0;
+}
+
+static double seconds_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static double cpu_seconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	
+	return (double) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+		   (double) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void report(const device_imu_type* dev, double elapsed, double cpu) {
+	printf("Captured %llu reports in %.1f s; CPU: %.3f s (%.2f s per hour)\n",
+		   (unsigned long long) device_imu_captured(dev),
+		   elapsed,
+		   cpu,
+		   elapsed > 0.0? cpu * 3600.0 / elapsed : 0.0);
+}
+
+int main(int argc, const char** argv) {
+	if (argc <= 1) {
+		printf("HOW TO USE IT:\n$ xrealAirCaptureIMU <PATH> [SECONDS]\n");
+		return 0;
+	}
+	
+	const char* path = argv[1];
+	const long duration = (argc > 2? atol(argv[2]) : 3600);
+	
+	if (duration <= 0) {
+		printf("THE DURATION NEEDS TO BE POSITIVE!\n");
+		return 1;
+	}
+	
+	device_imu_type dev;
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_open(&dev, NULL)) {
+		return 1;
+	}
+	
+	// Reports arrive at 1000 Hz, the margin covers a slightly faster sensor clock
+	const uint64_t capacity = (uint64_t) duration * 1050;
+	
+	device_imu_clear(&dev);
+	
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_start_capture(&dev, path, capacity)) {
+		device_imu_close(&dev);
+		return 1;
+	}
+	
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	
+	const double start = seconds_now();
+	const double cpu_start = cpu_seconds();
+	
+	double last_report = start;
+	double now = start;
+	
+	while ((running) && (now - start < (double) duration)) {
+		if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_capture(&dev, 100)) {
+			break;
+		}
+		
+		now = seconds_now();
+		
+		if (now - last_report >= 60.0) {
+			report(&dev, now - start, cpu_seconds() - cpu_start);
+			last_report = now;
+		}
+	}
+	
+	report(&dev, seconds_now() - start, cpu_seconds() - cpu_start);
+	
+	const device_imu_error_type error = device_imu_stop_capture(&dev);
+	device_imu_close(&dev);
+	return (error == DEVICE_IMU_ERROR_NO_ERROR? 0 : 1);
+}
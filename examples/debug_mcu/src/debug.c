@@ -22,10 +22,33 @@
 // THE SOFTWARE.
 //
 
+#include "device_imu.h"
 #include "device_mcu.h"
 
 #include <stdio.h>
 
+#define EVENT_BATCH 16
+
+static device_imu_resampler_type resampler;
+
+static void retarget(uint8_t mode) {
+	const device_mcu_display_mode_info_type* info = device_mcu_get_display_mode_info(mode);
+	
+	if ((!info) || (!info->refresh_rate)) {
+		printf("Unknown Display Mode: %u\n", mode);
+		return;
+	}
+	
+	const uint64_t period = 1000000000ULL / info->refresh_rate;
+	
+	// Attached to an IMU with device_imu_resampler_attach, the orientation would now follow the new frame rate
+	device_imu_resampler_retarget(&resampler, period);
+	
+	printf("Display Mode: %ux%u @ %u Hz%s (frame period %.3f ms)\n",
+		   info->width, info->height, info->refresh_rate,
+		   info->stereo? " SBS" : "", (double) period / 1e6);
+}
+
 void test(uint64_t timestamp,
           device_mcu_event_type event,
           uint8_t brightness,
@@ -64,6 +87,15 @@ void test(uint64_t timestamp,
 		case DEVICE_MCU_EVENT_VOLUME_DOWN:
 			printf("Decrease Volume!\n");
 			break;
+		case DEVICE_MCU_EVENT_LINK_LOST:
+			printf("Link lost!\n");
+			break;
+		case DEVICE_MCU_EVENT_LINK_RESTORED:
+			printf("Link restored!\n");
+			break;
+		case DEVICE_MCU_EVENT_DISPLAY_MODE_CHANGED:
+			printf("Display Mode changed!\n");
+			break;
 		default:
 			break;
 	}
@@ -75,8 +107,25 @@ int main(int argc, const char** argv) {
 		return 1;
 	}
 	
+	device_mcu_set_heartbeat(&dev, DEVICE_MCU_HEARTBEAT_INTERVAL_MS, DEVICE_MCU_LINK_TIMEOUT_MS);
+	device_mcu_enable_event_queue(&dev, 0);
+	
+	device_imu_resampler_init(&resampler, 1000000000ULL / 60, DEVICE_IMU_INTERPOLATION_LINEAR, NULL, NULL);
+	retarget(dev.disp_mode);
+	
 	device_mcu_clear(&dev);
-	while (DEVICE_MCU_ERROR_NO_ERROR == device_mcu_read(&dev, -1));
+	while (DEVICE_MCU_ERROR_NO_ERROR == device_mcu_read(&dev, -1)) {
+		device_mcu_event_data_type events [EVENT_BATCH];
+		const uint32_t count = device_mcu_drain_events(&dev, events, EVENT_BATCH);
+		
+		for (uint32_t i = 0; i < count; i++) {
+			if (events[i].event == DEVICE_MCU_EVENT_DISPLAY_MODE_CHANGED) {
+				retarget(events[i].display_mode);
+			}
+		}
+	}
+	
 	device_mcu_close(&dev);
+	device_imu_resampler_free(&resampler);
 	return 0;
 }
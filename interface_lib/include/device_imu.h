@@ -42,6 +42,26 @@
 #define DEVICE_IMU_MSG_GET_STATIC_ID 0x1A
 #define DEVICE_IMU_MSG_UNKNOWN 0x1D
 
+#define DEVICE_IMU_HANDSHAKE_TIMEOUT_MS 250
+#define DEVICE_IMU_HANDSHAKE_ATTEMPTS 3
+#define DEVICE_IMU_OPEN_TIMEOUT_MS 3000
+#define DEVICE_IMU_CLOSE_TIMEOUT_MS 500
+#define DEVICE_IMU_FRESHNESS_MS 5
+#define DEVICE_IMU_STALL_MS 250
+#define DEVICE_IMU_CATCHUP_MS 20
+#define DEVICE_IMU_CALIBRATION_WINDOW 4
+
+#define DEVICE_IMU_CAPTURE_MAGIC 0x554D4958
+#define DEVICE_IMU_CAPTURE_VERSION 1
+#define DEVICE_IMU_CAPTURE_BATCH 64
+
+#define DEVICE_IMU_MAX_STAGES 16
+#define DEVICE_IMU_FLUSH_LIMIT 4096
+
+#define DEVICE_IMU_SAMPLE_RATE 1000
+#define DEVICE_IMU_DECIMATOR_TAPS 8
+#define DEVICE_IMU_RESAMPLER_GAP_MS 10
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -63,6 +83,8 @@ enum device_imu_error_t {
 	DEVICE_IMU_ERROR_NOT_INITIALIZED = 13,
 	DEVICE_IMU_ERROR_PAYLOAD_FAILED = 14,
 	DEVICE_IMU_ERROR_UNKNOWN = 15,
+	DEVICE_IMU_ERROR_TIMEOUT = 16,
+	DEVICE_IMU_ERROR_CAPTURE_FULL = 17,
 };
 
 struct __attribute__((__packed__)) device_imu_packet_t {
@@ -88,6 +110,20 @@ struct __attribute__((__packed__)) device_imu_packet_t {
 	uint8_t _padding [6];
 };
 
+struct device_imu_capture_header_t {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t product_id;
+	uint32_t static_id;
+	uint32_t record_size;
+	uint64_t count; // (records written so far)
+};
+
+struct __attribute__((__packed__)) device_imu_capture_record_t {
+	uint64_t host_timestamp; // (in ns)
+	struct device_imu_packet_t packet;
+};
+
 enum device_imu_event_t {
 	DEVICE_IMU_EVENT_UNKNOWN = 0,
 	DEVICE_IMU_EVENT_INIT    = 1,
@@ -116,8 +152,120 @@ struct device_imu_euler_t {
 	float yaw;
 };
 
+enum device_imu_sample_flag_t {
+	DEVICE_IMU_SAMPLE_FLAG_INITIALISING = (1 << 0),
+	DEVICE_IMU_SAMPLE_FLAG_ANGULAR_RATE_RECOVERY = (1 << 1),
+	DEVICE_IMU_SAMPLE_FLAG_ACCELERATION_RECOVERY = (1 << 2),
+	DEVICE_IMU_SAMPLE_FLAG_MAGNETIC_RECOVERY = (1 << 3),
+	DEVICE_IMU_SAMPLE_FLAG_CAUGHT_UP = (1 << 4),
+	DEVICE_IMU_SAMPLE_FLAG_ACCELEROMETER_IGNORED = (1 << 5),
+	DEVICE_IMU_SAMPLE_FLAG_MAGNETOMETER_IGNORED = (1 << 6),
+	DEVICE_IMU_SAMPLE_FLAG_DROPPED = (1 << 7), // (by a pre-fusion stage, carries the vectors of the last sample passed on)
+};
+
+struct device_imu_sample_t {
+	uint64_t sequence; // (index of the report, gaps show discarded or caught up reports)
+	uint64_t timestamp; // (device time in ns)
+	uint64_t host_timestamp; // (in ns)
+	float delta_time; // (in s)
+	float temperature; // (in °C)
+	
+	struct device_imu_vec3_t raw_gyroscope; // (in °/s)
+	struct device_imu_vec3_t raw_accelerometer; // (in g)
+	struct device_imu_vec3_t raw_magnetometer; // (NaN while the magnetometer is disabled)
+	
+	struct device_imu_vec3_t gyroscope; // (calibrated with offset removed in °/s)
+	struct device_imu_vec3_t accelerometer;
+	struct device_imu_vec3_t magnetometer;
+	
+	struct device_imu_quat_t orientation;
+	uint32_t flags;
+	
+	float acceleration_error; // (between the accelerometer and the expected gravity in degrees)
+	float acceleration_recovery; // (progress of the recovery trigger from 0 to 1)
+	float magnetic_error; // (in degrees)
+	float magnetic_recovery; // (progress of the recovery trigger from 0 to 1)
+};
+
+enum device_imu_stage_position_t {
+	DEVICE_IMU_STAGE_PRE_FUSION = 0, // (after calibration, changes to the sensor vectors are used by the fusion)
+	DEVICE_IMU_STAGE_POST_FUSION = 1, // (after the fusion, right before the sample callback)
+	DEVICE_IMU_STAGE_POSITIONS = 2,
+};
+
+enum device_imu_convention_t {
+	DEVICE_IMU_CONVENTION_NED = 0, // (x forward, y right, z down, same as the sensor fusion)
+	DEVICE_IMU_CONVENTION_OPENGL = 1, // (x right, y up, z backward)
+	DEVICE_IMU_CONVENTION_VULKAN = 2, // (x right, y down, z forward)
+	DEVICE_IMU_CONVENTION_UNITY = 3, // (x right, y up, z forward, left-handed)
+	DEVICE_IMU_CONVENTIONS = 4,
+};
+
+enum device_imu_interpolation_t {
+	DEVICE_IMU_INTERPOLATION_LINEAR = 0, // (waits for one later sample)
+	DEVICE_IMU_INTERPOLATION_CUBIC = 1, // (waits for two later samples)
+	DEVICE_IMU_INTERPOLATIONS = 2,
+};
+
+struct device_imu_options_t {
+	uint32_t handshake_timeout; // (per attempt in ms)
+	uint32_t handshake_attempts;
+	uint32_t open_timeout; // (whole open in ms)
+	uint32_t close_timeout; // (whole close in ms)
+	uint32_t freshness; // (max age of a report to count as current in ms)
+	uint32_t stall_threshold; // (report age starting a catch-up that also resets the accelerometer state in ms, 0 disables it)
+	uint32_t catchup_threshold; // (report age triggering gyroscope-only catch-up in ms, 0 disables it)
+	uint32_t calibration_window; // (segment requests in flight during the calibration download)
+	
+	bool magnetometer; // (decode and calibrate the magnetometer, the fusion doesn't use it currently)
+	bool fixed_point; // (decode, calibrate and integrate in Q-format integers instead of floats)
+	bool adaptive_startup; // (opt-in: schedule the startup gain by detected stillness and seed the gyroscope offset, instead of the fixed ramp)
+	
+	enum device_imu_convention_t convention; // (of the calibrated vectors and the orientation in samples)
+	
+	float gyroscope_cutoff; // (of the low-pass pre-filter in Hz, 0 disables it)
+	float accelerometer_cutoff; // (of the low-pass pre-filter in Hz, 0 disables it)
+	
+	bool deferred_calibration; // (start streaming first and swap in the factory calibration once it arrived)
+	const char* calibration_path; // (cached calibration to start from, only read during open)
+};
+
+struct device_imu_stats_t {
+	uint64_t reports;
+	uint64_t discarded; // (stale reports dropped by flushes)
+	uint32_t flushes;
+	uint32_t stalls; // (catch-ups triggered by the stall threshold)
+	uint32_t stray_replies; // (command replies arriving after their command already succeeded)
+	
+	uint64_t age; // (of the last report in ns, relative to the fastest delivery observed)
+	uint64_t age_max;
+	
+	uint32_t catchups;
+	uint64_t catchup_samples; // (integrated without fusion update or callback)
+	uint64_t recovery; // (of the last catch-up until reports were current again in ns)
+	uint64_t recovery_max;
+	
+	uint32_t checksum_errors; // (in calibration segments)
+	uint32_t calibration_retries; // (sequential downloads after a failed pipelined one)
+	
+	float swap_discontinuity; // (orientation change by the first update after a deferred calibration swap in degrees)
+	
+	uint64_t acceleration_rejections; // (updates with the accelerometer ignored by the fusion)
+	uint64_t magnetic_rejections; // (updates with the magnetometer ignored, all of them while the fusion doesn't use it)
+	uint64_t initialising_updates;
+	
+	uint32_t angular_rate_recoveries; // (times the fusion entered the recovery)
+	uint32_t acceleration_recoveries;
+	uint32_t magnetic_recoveries;
+	
+	float acceleration_error; // (of the last update in degrees)
+	float acceleration_error_max; // (since the initialisation ended)
+};
+
 typedef enum device_imu_error_t device_imu_error_type;
 typedef struct device_imu_packet_t device_imu_packet_type;
+typedef struct device_imu_capture_header_t device_imu_capture_header_type;
+typedef struct device_imu_capture_record_t device_imu_capture_record_type;
 typedef enum device_imu_event_t device_imu_event_type;
 
 typedef struct device_imu_ahrs_t device_imu_ahrs_type;
@@ -127,12 +275,34 @@ typedef struct device_imu_vec3_t device_imu_vec3_type;
 typedef struct device_imu_quat_t device_imu_quat_type;
 typedef struct device_imu_euler_t device_imu_euler_type;
 
+typedef enum device_imu_sample_flag_t device_imu_sample_flag_type;
+typedef struct device_imu_sample_t device_imu_sample_type;
+typedef enum device_imu_stage_position_t device_imu_stage_position_type;
+typedef enum device_imu_convention_t device_imu_convention_type;
+typedef enum device_imu_interpolation_t device_imu_interpolation_type;
+
+typedef struct device_imu_options_t device_imu_options_type;
+typedef struct device_imu_stats_t device_imu_stats_type;
+
 typedef void (*device_imu_event_callback)(
 		uint64_t timestamp,
 		device_imu_event_type event,
 		const device_imu_ahrs_type* ahrs
 );
 
+typedef void (*device_imu_sample_callback)(
+		const device_imu_sample_type* sample,
+		void* userdata
+);
+
+// Returning false drops the sample before the fusion, which still integrates it unchanged. Post-fusion stages keep
+// getting it flagged as dropped to hold their timing, only the sample callback skips it. Post-fusion returning false
+// drops the sample for good, so no later stage or callback gets it.
+typedef bool (*device_imu_stage_callback)(
+		device_imu_sample_type* sample,
+		void* userdata
+);
+
 struct device_imu_t {
 	uint16_t vendor_id;
 	uint16_t product_id;
@@ -142,20 +312,94 @@ struct device_imu_t {
 	
 	uint32_t static_id;
 	
+	device_imu_options_type options;
+	uint64_t open_timestamp; // (host time in ns)
+	uint64_t open_duration; // (in ns)
+	uint64_t calibration_duration; // (download and parsing in ns)
+	uint64_t first_pose_duration; // (from the start of open until the first pose in ns)
+	uint64_t stable_duration; // (from the start of open until the adaptive startup converged in ns, 0 before)
+	
+	int64_t clock_offset; // (host minus device time in ns, tracking the lowest observed)
+	device_imu_stats_type stats;
+	
+	uint64_t catchup_start; // (host time in ns, 0 while current)
+	uint64_t catchup_delta; // (in ns)
+	device_imu_vec3_type catchup_rotation; // (in degrees)
+	bool catchup_stalled; // (the accelerometer state gets reset once caught up)
+	
 	uint64_t last_timestamp;
 	float temperature; // (in °C)
+	uint32_t fusion_flags; // (sample flags of the fusion after the last update)
 	
 	void* offset;
 	device_imu_ahrs_type* ahrs;
 	
 	device_imu_event_callback callback;
-	device_imu_calibration_type* calibration;
+	device_imu_sample_callback sample_callback;
+	void* userdata;
+	device_imu_sample_type sample;
+	
+	device_imu_calibration_type* calibration; // (immutable once published, only access atomically)
+	uint32_t calibration_version; // (increases with every published calibration)
+	uint32_t calibration_readers; // (only access atomically)
+	
+	void* iron;
+	void* folded; // (calibration combined into one transformation per sensor, only used while reading)
+	void* download;
+	void* capture;
+	void* pipeline;
+	void* fixed;
+	void* filter;
+	void* startup;
 };
 
 typedef struct device_imu_t device_imu_type;
 
+// Low-pass filters the sensor vectors before dropping samples, so motion above the output rate does not alias
+struct device_imu_decimator_t {
+	uint32_t rate; // (output rate in Hz, divides the sample rate)
+	uint32_t factor; // (input samples per output sample)
+	uint32_t taps; // (DEVICE_IMU_DECIMATOR_TAPS per output sample plus one)
+	uint32_t delay; // (group delay in input samples, outputs carry the timestamps and orientation of that earlier sample)
+	
+	device_imu_sample_callback callback;
+	void* userdata;
+	device_imu_sample_type sample; // (latest output)
+	
+	void* state;
+};
+
+typedef struct device_imu_decimator_t device_imu_decimator_type;
+
+// Interpolates samples onto an exactly periodic host time grid (vectors linear or cubic, orientations with slerp)
+struct device_imu_resampler_t {
+	uint64_t period; // (grid spacing in host ns)
+	device_imu_interpolation_type interpolation;
+	
+	device_imu_sample_callback callback;
+	void* userdata;
+	device_imu_sample_type sample; // (latest output)
+	
+	void* state;
+};
+
+typedef struct device_imu_resampler_t device_imu_resampler_type;
+
+void device_imu_default_options(device_imu_options_type* options);
+
 device_imu_error_type device_imu_open(device_imu_type* device, device_imu_event_callback callback);
 
+device_imu_error_type device_imu_open_ex(device_imu_type* device, device_imu_event_callback callback, const device_imu_options_type* options);
+
+device_imu_error_type device_imu_set_sample_callback(device_imu_type* device, device_imu_sample_callback callback, void* userdata);
+
+device_imu_error_type device_imu_add_stage(device_imu_type* device,
+										   device_imu_stage_position_type position,
+										   device_imu_stage_callback callback,
+										   void* userdata);
+
+device_imu_error_type device_imu_clear_stages(device_imu_type* device);
+
 device_imu_error_type device_imu_reset_calibration(device_imu_type* device);
 
 device_imu_error_type device_imu_load_calibration(device_imu_type* device, const char* path);
@@ -164,10 +408,20 @@ device_imu_error_type device_imu_save_calibration(device_imu_type* device, const
 
 device_imu_error_type device_imu_clear(device_imu_type* device);
 
+void device_imu_get_stats(const device_imu_type* device, device_imu_stats_type* stats);
+
 device_imu_error_type device_imu_calibrate(device_imu_type* device, uint32_t iterations, bool gyro, bool accel, bool magnet);
 
 device_imu_error_type device_imu_read(device_imu_type* device, int timeout);
 
+device_imu_error_type device_imu_start_capture(device_imu_type* device, const char* path, uint64_t capacity);
+
+device_imu_error_type device_imu_capture(device_imu_type* device, int timeout);
+
+uint64_t device_imu_captured(const device_imu_type* device);
+
+device_imu_error_type device_imu_stop_capture(device_imu_type* device);
+
 device_imu_vec3_type device_imu_get_earth_acceleration(const device_imu_ahrs_type* ahrs);
 
 device_imu_vec3_type device_imu_get_linear_acceleration(const device_imu_ahrs_type* ahrs);
@@ -176,6 +430,46 @@ device_imu_quat_type device_imu_get_orientation(const device_imu_ahrs_type* ahrs
 
 device_imu_euler_type device_imu_get_euler(device_imu_quat_type quat);
 
+device_imu_vec3_type device_imu_convert_vec3(device_imu_vec3_type vec, device_imu_convention_type convention);
+
+device_imu_quat_type device_imu_convert_quat(device_imu_quat_type quat, device_imu_convention_type convention);
+
+void device_imu_get_euler_batch(const device_imu_quat_type* quats, device_imu_euler_type* eulers, uint64_t count);
+
+void device_imu_get_matrix_batch(const device_imu_quat_type* quats, float* matrices, uint64_t count, bool homogeneous);
+
+device_imu_error_type device_imu_decimator_init(device_imu_decimator_type* decimator,
+												 uint32_t rate,
+												 device_imu_sample_callback callback,
+												 void* userdata);
+
+// Returns true whenever an output sample got written, input and output may be the same sample
+bool device_imu_decimator_process(device_imu_decimator_type* decimator,
+								  const device_imu_sample_type* sample,
+								  device_imu_sample_type* output);
+
+// Adds a post-fusion stage feeding the callback of the decimator, other stages keep getting every sample
+device_imu_error_type device_imu_decimator_attach(device_imu_decimator_type* decimator, device_imu_type* device);
+
+device_imu_error_type device_imu_decimator_free(device_imu_decimator_type* decimator);
+
+device_imu_error_type device_imu_resampler_init(device_imu_resampler_type* resampler,
+												 uint64_t period,
+												 device_imu_interpolation_type interpolation,
+												 device_imu_sample_callback callback,
+												 void* userdata);
+
+// Returns how many grid samples got handed to the callback, gaps over DEVICE_IMU_RESAMPLER_GAP_MS are skipped
+uint32_t device_imu_resampler_process(device_imu_resampler_type* resampler, const device_imu_sample_type* sample);
+
+// Changes the grid spacing from any thread (a display mode change for example), applied with the next sample
+device_imu_error_type device_imu_resampler_retarget(device_imu_resampler_type* resampler, uint64_t period);
+
+// Adds a post-fusion stage feeding the callback of the resampler, other stages keep getting every sample
+device_imu_error_type device_imu_resampler_attach(device_imu_resampler_type* resampler, device_imu_type* device);
+
+device_imu_error_type device_imu_resampler_free(device_imu_resampler_type* resampler);
+
 device_imu_error_type device_imu_close(device_imu_type* device);
 
 #ifdef __cplusplus
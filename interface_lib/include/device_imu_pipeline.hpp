@@ -0,0 +1,207 @@
+#pragma once
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "device_imu.h"
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+namespace device_imu {
+
+	// Chains stages by value, so the compiler can inline the whole chain into a single function
+	template<typename... Stages>
+	class pipeline {
+	public:
+		pipeline() = default;
+		
+		explicit pipeline(Stages... stages) : m_stages(std::move(stages)...) {}
+		
+		bool operator()(device_imu_sample_type& sample) {
+			return process<0>(sample);
+		}
+		
+		template<std::size_t Index>
+		auto& stage() {
+			return std::get<Index>(m_stages);
+		}
+		
+		// Registers the fused chain as one stage, the pipeline has to outlive the device or its stages
+		device_imu_error_type attach(device_imu_type* device, device_imu_stage_position_type position) {
+			return device_imu_add_stage(device, position, &pipeline::run, this);
+		}
+		
+	private:
+		std::tuple<Stages...> m_stages;
+		
+		template<std::size_t Index>
+		bool process(device_imu_sample_type& sample) {
+			if constexpr (Index < sizeof...(Stages)) {
+				return std::get<Index>(m_stages)(sample) && process<Index + 1>(sample);
+			} else {
+				return true;
+			}
+		}
+		
+		static bool run(device_imu_sample_type* sample, void* userdata) {
+			return (*static_cast<pipeline*>(userdata))(*sample);
+		}
+	};
+	
+	template<typename... Stages>
+	pipeline<Stages...> make_pipeline(Stages... stages) {
+		return pipeline<Stages...>(std::move(stages)...);
+	}
+	
+	// Passes on every n-th sample only
+	class decimate {
+	public:
+		explicit decimate(unsigned int factor) : m_factor(factor > 0? factor : 1), m_counter(0) {}
+		
+		bool operator()(device_imu_sample_type&) {
+			if (++m_counter < m_factor) {
+				return false;
+			}
+			
+			m_counter = 0;
+			return true;
+		}
+		
+	private:
+		unsigned int m_factor;
+		unsigned int m_counter;
+	};
+	
+	// Passes on every n-th sample with its sensor vectors low-pass filtered first, delaying them by half the filter length
+	// (only for pipelines attached post-fusion, the fusion must not integrate delayed vectors)
+	class antialias_decimate {
+	public:
+		explicit antialias_decimate(uint32_t rate) : m_error(device_imu_decimator_init(&m_decimator, rate, nullptr, nullptr)) {}
+		
+		antialias_decimate(antialias_decimate&& other) noexcept : m_decimator(other.m_decimator), m_error(other.m_error) {
+			other.m_decimator.state = nullptr;
+		}
+		
+		antialias_decimate(const antialias_decimate&) = delete;
+		antialias_decimate& operator=(const antialias_decimate&) = delete;
+		antialias_decimate& operator=(antialias_decimate&&) = delete;
+		
+		~antialias_decimate() {
+			device_imu_decimator_free(&m_decimator);
+		}
+		
+		// An invalid rate leaves the stage without a filter, it then passes on every sample unchanged
+		bool valid() const {
+			return (m_error == DEVICE_IMU_ERROR_NO_ERROR);
+		}
+		
+		device_imu_error_type error() const {
+			return m_error;
+		}
+		
+		bool operator()(device_imu_sample_type& sample) {
+			if (!valid()) {
+				return true;
+			}
+			
+			return device_imu_decimator_process(&m_decimator, &sample, &sample);
+		}
+		
+	private:
+		device_imu_decimator_type m_decimator;
+		device_imu_error_type m_error;
+	};
+	
+	// Converts NED samples into another convention with the permutation resolved at compile time (for devices opened with NED)
+	template<device_imu_convention_type Convention>
+	class convert {
+	public:
+		bool operator()(device_imu_sample_type& sample) const {
+			sample.gyroscope = vector(sample.gyroscope, m_frame.handedness);
+			sample.accelerometer = vector(sample.accelerometer, 1.0f);
+			sample.magnetometer = vector(sample.magnetometer, 1.0f);
+			
+			const device_imu_vec3_type axis = vector({ sample.orientation.x, sample.orientation.y, sample.orientation.z }, m_frame.handedness);
+			
+			sample.orientation.x = axis.x;
+			sample.orientation.y = axis.y;
+			sample.orientation.z = axis.z;
+			return true;
+		}
+		
+	private:
+		struct frame {
+			int axis [3];
+			float sign [3];
+			float handedness;
+		};
+		
+		static constexpr frame select() {
+			switch (Convention) {
+				case DEVICE_IMU_CONVENTION_OPENGL:
+					return { { 1, 2, 0 }, { +1.0f, -1.0f, -1.0f }, +1.0f };
+				case DEVICE_IMU_CONVENTION_VULKAN:
+					return { { 1, 2, 0 }, { +1.0f, +1.0f, +1.0f }, +1.0f };
+				case DEVICE_IMU_CONVENTION_UNITY:
+					return { { 1, 2, 0 }, { +1.0f, -1.0f, +1.0f }, -1.0f };
+				default:
+					return { { 0, 1, 2 }, { +1.0f, +1.0f, +1.0f }, +1.0f };
+			}
+		}
+		
+		static constexpr frame m_frame = select();
+		
+		static device_imu_vec3_type vector(const device_imu_vec3_type& v, float scale) {
+			const float in [3] = { v.x, v.y, v.z };
+			
+			device_imu_vec3_type res;
+			res.x = scale * m_frame.sign[0] * in[m_frame.axis[0]];
+			res.y = scale * m_frame.sign[1] * in[m_frame.axis[1]];
+			res.z = scale * m_frame.sign[2] * in[m_frame.axis[2]];
+			return res;
+		}
+	};
+	
+	// Hands every sample to a function without dropping any
+	template<typename Function>
+	class sink {
+	public:
+		explicit sink(Function function) : m_function(std::move(function)) {}
+		
+		bool operator()(device_imu_sample_type& sample) {
+			m_function(static_cast<const device_imu_sample_type&>(sample));
+			return true;
+		}
+		
+	private:
+		Function m_function;
+	};
+	
+	template<typename Function>
+	sink<Function> make_sink(Function function) {
+		return sink<Function>(std::move(function));
+	}
+
+} // namespace device_imu
@@ -114,6 +114,26 @@
 #define DEVICE_MCU_CONTROL_MODE_BRIGHTNESS 0x0
 #define DEVICE_MCU_CONTROL_MODE_VOLUME 0x1
 
+#define DEVICE_MCU_HANDSHAKE_TIMEOUT_MS 250
+#define DEVICE_MCU_HANDSHAKE_ATTEMPTS 3
+#define DEVICE_MCU_ACTION_TIMEOUT_MS 5000
+#define DEVICE_MCU_OPEN_TIMEOUT_MS 3000
+
+#define DEVICE_MCU_EVENT_QUEUE_SIZE 256
+#define DEVICE_MCU_EVENT_TEXT_LENGTH 43
+
+#define DEVICE_MCU_LOG_QUEUE_SIZE 128
+#define DEVICE_MCU_LOG_LINE_LENGTH 256
+
+#define DEVICE_MCU_COMMAND_INTERVAL_MS 40
+#define DEVICE_MCU_COMMAND_HOLD_MS 500
+#define DEVICE_MCU_COMMAND_POLL_MS 5
+#define DEVICE_MCU_COMMAND_MAX_PRIORITY 127
+
+#define DEVICE_MCU_HEARTBEAT_INTERVAL_MS 25 // (suggested interval, heartbeats are off until enabled)
+#define DEVICE_MCU_LINK_TIMEOUT_MS 100
+#define DEVICE_MCU_FLUSH_LIMIT 1024
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -131,6 +151,7 @@ enum device_mcu_error_t {
 	DEVICE_MCU_ERROR_NOT_INITIALIZED = 9,
 	DEVICE_MCU_ERROR_PAYLOAD_FAILED = 10,
 	DEVICE_MCU_ERROR_UNKNOWN = 11,
+	DEVICE_MCU_ERROR_BUSY = 13,
 };
 
 struct __attribute__((__packed__)) device_mcu_packet_t {
@@ -159,11 +180,107 @@ enum device_mcu_event_t {
 	DEVICE_MCU_EVENT_CONTROL_TOGGLE = 9,
 	DEVICE_MCU_EVENT_VOLUME_UP = 10,
 	DEVICE_MCU_EVENT_VOLUME_DOWN = 11,
+	DEVICE_MCU_EVENT_LINK_LOST = 12,
+	DEVICE_MCU_EVENT_LINK_RESTORED = 13,
+	DEVICE_MCU_EVENT_DISPLAY_MODE_CHANGED = 14,
+};
+
+typedef enum device_mcu_event_t device_mcu_event_type;
+
+enum device_mcu_command_t {
+	DEVICE_MCU_COMMAND_BRIGHTNESS = 0,
+	DEVICE_MCU_COMMAND_DISPLAY_MODE = 1,
+	DEVICE_MCU_COMMAND_COUNT = 2,
+};
+
+typedef enum device_mcu_command_t device_mcu_command_type;
+
+struct device_mcu_event_data_t {
+	uint64_t timestamp;
+	device_mcu_event_type event;
+	
+	union {
+		struct {
+			uint8_t phys;
+			uint8_t virt;
+			uint8_t value;
+		} button;
+		
+		uint8_t value;
+		uint8_t brightness;
+		uint8_t display_mode;
+		uint8_t blend_state;
+		uint8_t control_mode;
+		
+		char text [DEVICE_MCU_EVENT_TEXT_LENGTH];
+	};
+};
+
+struct device_mcu_display_mode_info_t {
+	uint8_t mode;
+	
+	uint16_t width; // (in pixels, both eyes together in case of stereo)
+	uint16_t height;
+	uint16_t refresh_rate; // (in Hz)
+	bool stereo; // (side-by-side)
+};
+
+struct device_mcu_log_line_t {
+	uint64_t timestamp; // (host time in ns)
+	uint64_t device_timestamp;
+	
+	uint16_t length;
+	char text [DEVICE_MCU_LOG_LINE_LENGTH];
+};
+
+struct device_mcu_state_t {
+	uint32_t version; // (increases with every change, wraps after 24 bits)
+	
+	bool active;
+	uint8_t brightness;
+	uint8_t disp_mode;
+	uint8_t blend_state;
+	uint8_t control_mode;
+};
+
+struct device_mcu_command_stats_t {
+	uint32_t requested;
+	uint32_t coalesced; // (requests replaced by a later one before sending)
+	uint32_t rejected; // (requests blocked by a client of higher priority)
+	uint32_t sent;
+	uint32_t failed;
+	
+	uint64_t latency; // (from first pending request to acknowledgement in ns)
+	uint64_t latency_max;
+};
+
+struct device_mcu_link_t {
+	bool armed; // (set once the device answered a heartbeat)
+	bool alive;
+	
+	uint32_t heartbeats_sent;
+	uint32_t heartbeats_received;
+	uint32_t heartbeats_missed;
+	uint32_t losses;
+	
+	uint64_t last_activity; // (host time in ns)
+	uint64_t pending_heartbeat; // (host time in ns)
+	uint64_t next_heartbeat; // (host time in ns)
+	
+	uint64_t latency; // (round-trip in ns)
+	uint64_t latency_min;
+	uint64_t latency_max;
+	uint64_t latency_avg;
 };
 
 typedef enum device_mcu_error_t device_mcu_error_type;
 typedef struct device_mcu_packet_t device_mcu_packet_type;
-typedef enum device_mcu_event_t device_mcu_event_type;
+typedef struct device_mcu_event_data_t device_mcu_event_data_type;
+typedef struct device_mcu_display_mode_info_t device_mcu_display_mode_info_type;
+typedef struct device_mcu_log_line_t device_mcu_log_line_type;
+typedef struct device_mcu_state_t device_mcu_state_type;
+typedef struct device_mcu_command_stats_t device_mcu_command_stats_type;
+typedef struct device_mcu_link_t device_mcu_link_type;
 typedef void (*device_mcu_event_callback)(
 		uint64_t timestamp,
 		device_mcu_event_type event,
@@ -182,13 +299,27 @@ struct device_mcu_t {
 	char dp_fw_version [42];
 	char dsp_fw_version [42];
 	
+	uint64_t open_duration; // (in ns)
+	uint32_t discarded; // (stale reports dropped by device_mcu_clear)
+	
 	bool active;
 	uint8_t brightness;
 	uint8_t disp_mode;
 	uint8_t blend_state;
 	uint8_t control_mode;
 	
+	uint64_t state; // (packed snapshot of the fields above, only access atomically)
+	
+	uint16_t heartbeat_interval; // (in ms)
+	uint16_t link_timeout; // (in ms)
+	device_mcu_link_type link;
+	
+	bool reading; // (set by the first device_mcu_read, only access atomically)
+	
 	device_mcu_event_callback callback;
+	void* queue;
+	void* log;
+	void* commands;
 };
 
 typedef struct device_mcu_t device_mcu_type;
@@ -199,6 +330,42 @@ device_mcu_error_type device_mcu_clear(device_mcu_type* device);
 
 device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout);
 
+uint32_t device_mcu_get_state_version(const device_mcu_type* device);
+
+device_mcu_error_type device_mcu_get_state(const device_mcu_type* device, device_mcu_state_type* state);
+
+// Setup only, fails with DEVICE_MCU_ERROR_BUSY once reading has started (zero capacity uses the default size)
+device_mcu_error_type device_mcu_enable_event_queue(device_mcu_type* device, uint32_t capacity);
+
+uint32_t device_mcu_drain_events(device_mcu_type* device, device_mcu_event_data_type* events, uint32_t count);
+
+uint32_t device_mcu_dropped_events(const device_mcu_type* device);
+
+// Setup only, fails with DEVICE_MCU_ERROR_BUSY once reading has started (zero capacity uses the default size)
+device_mcu_error_type device_mcu_enable_log(device_mcu_type* device, uint32_t capacity);
+
+uint32_t device_mcu_drain_log(device_mcu_type* device, device_mcu_log_line_type* lines, uint32_t count);
+
+device_mcu_error_type device_mcu_set_log_file(device_mcu_type* device, const char* path, uint32_t max_size, uint16_t max_files);
+
+device_mcu_error_type device_mcu_write_log(device_mcu_type* device);
+
+// Requests of lower priority are rejected while another client holds the setting, a client may always replace its own
+device_mcu_error_type device_mcu_request(device_mcu_type* device, device_mcu_command_type command, uint8_t client, uint8_t priority, uint8_t value);
+
+device_mcu_error_type device_mcu_get_command_stats(const device_mcu_type* device, device_mcu_command_type command, device_mcu_command_stats_type* stats);
+
+// Heartbeats are disabled by default, an interval above zero enables monitoring the link
+device_mcu_error_type device_mcu_set_heartbeat(device_mcu_type* device, uint16_t interval, uint16_t timeout);
+
+device_mcu_error_type device_mcu_heartbeat(device_mcu_type* device);
+
+device_mcu_error_type device_mcu_get_link(const device_mcu_type* device, device_mcu_link_type* link);
+
+const device_mcu_display_mode_info_type* device_mcu_get_display_modes(uint32_t* count);
+
+const device_mcu_display_mode_info_type* device_mcu_get_display_mode_info(uint8_t mode);
+
 device_mcu_error_type device_mcu_poll_display_mode(device_mcu_type* device);
 
 device_mcu_error_type device_mcu_update_display_mode(device_mcu_type* device);
@@ -28,6 +28,7 @@
 #include <Fusion/FusionAxes.h>
 #include <Fusion/FusionMath.h>
 #include <float.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,15 +38,44 @@
 
 #include <hidapi/hidapi.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "crc32.h"
 #include "hid_ids.h"
 
+#include "device_imu_fixed.h"
+#include "device_math.h"
+#include "device_time.h"
+
 #define GRAVITY_G (9.806f)
 
+// Startup controller: (stillness within 0.5 °/s and 0.01 g of the means over about 50 ms, below 3 °/s like FusionOffset)
+#define STARTUP_SMOOTHING 0.02f
+#define STARTUP_GYROSCOPE_NOISE 0.5f
+#define STARTUP_ACCELEROMETER_NOISE 0.01f
+#define STARTUP_GYROSCOPE_LIMIT 3.0f
+
+// According to FusionAhrs: (initial gain: 10, initialisation: 3 s)
+#define STARTUP_GAIN 10.0f
+#define STARTUP_TIMEOUT 3.0f
+
+// Seeds the offset after 200 ms of stillness, converged within 0.3° of tilt for 100 ms
+#define STARTUP_SEED_SAMPLES 200
+#define STARTUP_ERROR 0.3f
+#define STARTUP_CONVERGED_SAMPLES 100
+
 #ifndef NDEBUG
 #define device_imu_error(msg) fprintf(stderr, "ERROR: %s\n", msg)
 #else
 #define device_imu_error(msg) (0)
+#endif
+
+#ifndef DEVICE_IMU_DISABLE_MAGNETOMETER
+#define MAGNETOMETER_ENABLED(device) ((device)->options.magnetometer)
+#else
+#define MAGNETOMETER_ENABLED(device) (false)
 #endif
  #include "endian_compat.h"
 struct device_imu_calibration_t {
@@ -67,6 +97,119 @@ struct device_imu_calibration_t {
 	FusionQuaternion noises;
 };
 
+struct device_imu_iron_t {
+	bool estimated;
+	
+	FusionMatrix softIronMatrix;
+	FusionVector hardIronOffset;
+};
+
+typedef struct device_imu_iron_t device_imu_iron_type;
+
+struct device_imu_folded_t {
+	bool valid;
+	uint32_t version; // (of the calibration folded in)
+	
+	// Axes swaps, misalignment, sensitivity and offset combined into a single transformation per sensor
+	device_math_affine_type gyroscope;
+	device_math_affine_type accelerometer;
+};
+
+typedef struct device_imu_folded_t device_imu_folded_type;
+
+struct device_imu_filter_t {
+	bool gyroscope_enabled;
+	bool accelerometer_enabled;
+	
+	device_math_biquad_type gyroscope;
+	device_math_biquad_type accelerometer;
+};
+
+typedef struct device_imu_filter_t device_imu_filter_type;
+
+struct device_imu_startup_t {
+	uint32_t calibration_version; // (of the calibration the gyroscope mean belongs to)
+	float elapsed; // (in s)
+	
+	FusionVector gyroscope; // (mean before the offset removal)
+	FusionVector accelerometer; // (mean)
+	float gyroscope_variance;
+	float accelerometer_variance;
+	
+	FusionVector sum; // (of the gyroscope while still)
+	uint32_t still; // (samples in a row)
+	uint32_t converged; // (samples in a row)
+	bool seeded;
+	bool primed;
+};
+
+typedef struct device_imu_startup_t device_imu_startup_type;
+
+enum device_imu_fusion_write_t {
+	FUSION_WRITE_STILL_GAIN = (1 << 0), // (startup gain, initialising with the ramp stopped)
+	FUSION_WRITE_MOVING_GAIN = (1 << 1), // (normal gain, initialising with the ramp stopped)
+	FUSION_WRITE_INITIALISED = (1 << 2), // (normal gain, initialisation ended)
+	FUSION_WRITE_ACCELERATION_RESET = (1 << 3), // (rejection and recovery state, the orientation stays untouched)
+	FUSION_WRITE_OFFSET = (1 << 4), // (gyroscope offset with the timeout skipped)
+};
+
+// Output conventions as signed axis permutations of NED
+struct device_imu_frame_t {
+	uint8_t axis [3];
+	float sign [3];
+	float handedness; // (determinant, rotation axes flip along with it)
+};
+
+typedef struct device_imu_frame_t device_imu_frame_type;
+
+static const device_imu_frame_type frames [DEVICE_IMU_CONVENTIONS] = {
+		{ { 0, 1, 2 }, { +1.0f, +1.0f, +1.0f }, +1.0f }, // (NED)
+		{ { 1, 2, 0 }, { +1.0f, -1.0f, -1.0f }, +1.0f }, // (OpenGL)
+		{ { 1, 2, 0 }, { +1.0f, +1.0f, +1.0f }, +1.0f }, // (Vulkan)
+		{ { 1, 2, 0 }, { +1.0f, -1.0f, +1.0f }, -1.0f }, // (Unity)
+};
+
+static const device_imu_calibration_type* calibration_acquire(device_imu_type* device) {
+	__atomic_add_fetch(&(device->calibration_readers), 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&(device->calibration), __ATOMIC_SEQ_CST);
+}
+
+static void calibration_release(device_imu_type* device) {
+	__atomic_sub_fetch(&(device->calibration_readers), 1, __ATOMIC_RELEASE);
+}
+
+static device_imu_calibration_type* calibration_copy(device_imu_type* device) {
+	device_imu_calibration_type* calibration = malloc(sizeof(device_imu_calibration_type));
+	
+	if (!calibration) {
+		device_imu_error("Not allocated");
+		return NULL;
+	}
+	
+	const device_imu_calibration_type* current = calibration_acquire(device);
+	
+	if (current) {
+		*calibration = *current;
+	}
+	
+	calibration_release(device);
+	return calibration;
+}
+
+static void calibration_publish(device_imu_type* device, device_imu_calibration_type* calibration) {
+	device_imu_calibration_type* previous = __atomic_exchange_n(&(device->calibration), calibration, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&(device->calibration_version), 1, __ATOMIC_RELEASE);
+	
+	// Readers starting after the exchange only see the new calibration, so the old one is unused once no reader is left
+	while (__atomic_load_n(&(device->calibration_readers), __ATOMIC_SEQ_CST) != 0) {
+		sched_yield();
+	}
+	
+	if (previous) {
+		free(previous);
+	}
+}
+
 static bool send_payload(device_imu_type* device, uint16_t size, const uint8_t* payload) {
 	int payload_size = size;
 	if (payload_size > device->max_payload_size) {
@@ -83,28 +226,33 @@ static bool send_payload(device_imu_type* device, uint16_t size, const uint8_t*
 	return (transferred == size);
 }
 
-static bool recv_payload(device_imu_type* device, uint16_t size, uint8_t* payload) {
+static int recv_payload(device_imu_type* device, uint16_t size, uint8_t* payload, int timeout) {
 	int payload_size = size;
 	if (payload_size > device->max_payload_size) {
 		payload_size = device->max_payload_size;
 	}
 	
-	int transferred = hid_read(device->handle, payload, payload_size);
+	int transferred = hid_read_timeout(device->handle, payload, payload_size, timeout);
+	
+	if (transferred == -1) {
+		device_imu_error("Device may be unplugged");
+		return -1;
+	}
 	
 	if (transferred >= payload_size) {
 		transferred = payload_size;
 	}
 
 	if (transferred == 0) {
-		return false;
+		return 0;
 	}
 	
 	if (transferred != payload_size) {
 		device_imu_error("Receiving payload failed");
-		return false;
+		return 0;
 	}
 	
-	return (transferred == size);
+	return (transferred == size)? 1 : 0;
 }
 
 struct __attribute__((__packed__)) device_imu_payload_packet_t {
@@ -138,30 +286,94 @@ static bool send_payload_msg(device_imu_type* device, uint8_t msgid, uint16_t le
 	return send_payload(device, payload_len, (uint8_t*) (&packet));
 }
 
-static bool send_payload_msg_signal(device_imu_type* device, uint8_t msgid, uint8_t signal) {
-	return send_payload_msg(device, msgid, 1, &signal);
+static bool payload_checksum_valid(const device_imu_payload_packet_type* packet) {
+	const uint16_t length = le16toh(packet->length);
+	const uint32_t checksum = le32toh(packet->checksum);
+	
+	if (length > sizeof(device_imu_payload_packet_type) - 5) {
+		return false;
+	}
+	
+	// No capture confirms that every firmware fills in the checksum of replies, so a zero one counts as unchecked
+	if (!checksum) {
+		return true;
+	}
+	
+	return (checksum == crc32_checksum((const uint8_t*) (&packet->length), length));
 }
 
-static bool recv_payload_msg(device_imu_type* device, uint8_t msgid, uint16_t len, uint8_t* data) {
+static bool recv_payload_msg(device_imu_type* device, uint8_t msgid, uint16_t len, uint8_t* data, uint64_t deadline, bool* checksum) {
 	static device_imu_payload_packet_type packet;
 	
-	packet.head = 0;
-	packet.length = 0;
-	packet.msgid = 0;
-	
 	const uint16_t packet_len = 3 + len;
 	const uint16_t payload_len = 5 + packet_len;
 	
+	// Sensor reports or stale replies may arrive in between, so only the deadline ends the wait
 	do {
-		if (!recv_payload(device, payload_len, (uint8_t*) (&packet))) {
+		packet.head = 0;
+		packet.length = 0;
+		packet.msgid = 0;
+		
+		const int timeout = device_time_until_ms(deadline);
+		
+		if (timeout <= 0) {
+			return false;
+		}
+		
+		if (recv_payload(device, payload_len, (uint8_t*) (&packet), timeout) < 0) {
 			return false;
 		}
-	} while (packet.msgid != msgid);
+	} while ((packet.head != 0xAA) || (packet.msgid != msgid));
+	
+	if (checksum) {
+		*checksum = payload_checksum_valid(&packet);
+	}
 	
 	memcpy(data, packet.data, len);
 	return true;
 }
 
+static bool do_payload_msg(device_imu_type* device,
+						   uint8_t msgid,
+						   uint16_t len,
+						   const uint8_t* data,
+						   uint16_t reply_len,
+						   uint8_t* reply,
+						   uint32_t attempts,
+						   uint64_t deadline) {
+	for (uint32_t attempt = 0; attempt < attempts; attempt++) {
+		const uint64_t now = device_time_now();
+		
+		if (now >= deadline) {
+			break;
+		}
+		
+		if (!send_payload_msg(device, msgid, len, data)) {
+			return false;
+		}
+		
+		uint64_t timeout = now + device->options.handshake_timeout * DEVICE_TIME_MS;
+		
+		if (timeout > deadline) {
+			timeout = deadline;
+		}
+		
+		if (recv_payload_msg(device, msgid, reply_len, reply, timeout, NULL)) {
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static bool do_payload_msg_signal(device_imu_type* device, uint8_t msgid, uint8_t signal, uint64_t deadline) {
+	return do_payload_msg(device, msgid, 1, &signal, 0, NULL, device->options.handshake_attempts, deadline);
+}
+
+static device_imu_error_type payload_error(uint64_t deadline) {
+	return (device_time_now() >= deadline? DEVICE_IMU_ERROR_TIMEOUT : DEVICE_IMU_ERROR_PAYLOAD_FAILED);
+}
+
 static FusionVector json_object_get_vector(struct json_object* obj) {
 	if ((!json_object_is_type(obj, json_type_array)) ||
 		(json_object_array_length(obj) != 3)) {
@@ -189,763 +401,3190 @@ static FusionQuaternion json_object_get_quaternion(struct json_object* obj) {
 	return quaternion;
 }
 
-device_imu_error_type device_imu_open(device_imu_type* device, device_imu_event_callback callback) {
-	if (!device) {
-		device_imu_error("No device");
-		return DEVICE_IMU_ERROR_NO_DEVICE;
-	}
-	
-	memset(device, 0, sizeof(device_imu_type));
-	device->vendor_id 	= xreal_vendor_id;
-	device->product_id 	= 0;
-	device->callback 	= callback;
+static void drain_replies(device_imu_type* device, uint64_t deadline) {
+	static device_imu_payload_packet_type packet;
 	
-	if (!device_init()) {
-		device_imu_error("Not initialized");
-		return DEVICE_IMU_ERROR_NOT_INITIALIZED;
-	}
-
-	struct hid_device_info* info = hid_enumerate(
-		device->vendor_id, 
-		device->product_id
-	);
-
-	struct hid_device_info* it = info;
-	while (it) {
-		int interface_id = xreal_imu_interface_id(it->product_id);
-		if (interface_id != -1 && it->interface_number == interface_id) {
-#ifndef NDEBUG
-            printf("Found IMU device with product_id 0x%x on interface %d\n", it->product_id, interface_id);
-#endif
-			device->product_id = it->product_id;
-			device->handle = hid_open_path(it->path);
-			device->max_payload_size = xreal_imu_max_payload_size(device->product_id);
+	// Replies to requests still in flight arrive late, so wait until the interface stays silent for a while
+	for (;;) {
+		uint64_t timeout = device_time_now() + device->options.handshake_timeout * DEVICE_TIME_MS;
+		
+		if (timeout > deadline) {
+			timeout = deadline;
+		}
+		
+		const int wait = device_time_until_ms(timeout);
+		
+		if ((wait <= 0) || (recv_payload(device, device->max_payload_size, (uint8_t*) (&packet), wait) <= 0)) {
 			break;
 		}
-
-		it = it->next;
 	}
+}
 
-	hid_free_enumeration(info);
+static bool download_calibration(device_imu_type* device,
+								 uint8_t* data,
+								 uint32_t len,
+								 uint32_t window,
+								 uint64_t deadline,
+								 uint32_t* checksum_errors) {
+	const uint16_t max_packet_size = (device->max_payload_size - 8);
 	
-	if (!device->handle) {
-		device_imu_error("No handle");
-		return DEVICE_IMU_ERROR_NO_HANDLE;
+	uint32_t requested = 0;
+	uint32_t received = 0;
+	
+	// Segments are handed out in order, so several requests can be in flight as long as replies get taken in order
+	while (received < len) {
+		while ((requested < len) && (requested - received < window * max_packet_size)) {
+			if (!send_payload_msg(device, DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT, 0, NULL)) {
+				return false;
+			}
+			
+			const uint32_t remaining = (len - requested);
+			requested += (remaining > max_packet_size? max_packet_size : remaining);
+		}
+		
+		const uint32_t remaining = (len - received);
+		const uint16_t next = (remaining > max_packet_size? max_packet_size : remaining);
+		
+		uint64_t timeout = device_time_now() + device->options.handshake_timeout * DEVICE_TIME_MS;
+		
+		if (timeout > deadline) {
+			timeout = deadline;
+		}
+		
+		bool checksum = true;
+		
+		// Requesting a segment again would skip one, so a lost reply can't be resent
+		if (!recv_payload_msg(device, DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT, next, data + received, timeout, &checksum)) {
+			return false;
+		}
+		
+		// A corrupted segment can't be requested again either, so the whole download has to start over
+		if (!checksum) {
+			device_imu_error("Calibration segment checksum failed");
+			(*checksum_errors)++;
+			return false;
+		}
+		
+		received += next;
 	}
+	
+	return true;
+}
 
-	if ((!send_payload_msg_signal(device, DEVICE_IMU_MSG_START_IMU_DATA, 0x0)) ||
-        (!recv_payload_msg(device, DEVICE_IMU_MSG_START_IMU_DATA, 0, NULL))) {
-		device_imu_error("Failed sending payload to stop imu data stream");
-		return DEVICE_IMU_ERROR_PAYLOAD_FAILED;
+static bool parse_calibration(device_imu_calibration_type* calibration, const char* data, uint32_t len) {
+	struct json_tokener* tokener = json_tokener_new();
+	struct json_object* root = json_tokener_parse_ex(tokener, data, (int) len);
+	
+	const bool complete = (json_tokener_get_error(tokener) == json_tokener_success);
+	json_tokener_free(tokener);
+	
+	struct json_object* imu = json_object_object_get(root, "IMU");
+	struct json_object* dev1 = json_object_object_get(imu, "device_1");
+	
+	if ((!complete) || (!json_object_is_type(dev1, json_type_object))) {
+		device_imu_error("Invalid calibration data");
+		json_object_put(root);
+		return false;
 	}
+	
+	FusionVector accel_bias = json_object_get_vector(json_object_object_get(dev1, "accel_bias"));
+	FusionQuaternion accel_q_gyro = json_object_get_quaternion(json_object_object_get(dev1, "accel_q_gyro"));
+	FusionVector gyro_bias = json_object_get_vector(json_object_object_get(dev1, "gyro_bias"));
+	FusionQuaternion gyro_q_mag = json_object_get_quaternion(json_object_object_get(dev1, "gyro_q_mag"));
+	FusionVector mag_bias = json_object_get_vector(json_object_object_get(dev1, "mag_bias"));
+	FusionQuaternion imu_noises = json_object_get_quaternion(json_object_object_get(dev1, "imu_noises"));
+	FusionVector scale_accel = json_object_get_vector(json_object_object_get(dev1, "scale_accel"));
+	FusionVector scale_gyro = json_object_get_vector(json_object_object_get(dev1, "scale_gyro"));
+	FusionVector scale_mag = json_object_get_vector(json_object_object_get(dev1, "scale_mag"));
 
-	device_imu_clear(device);
+	const FusionQuaternion accel_q_mag = FusionQuaternionMultiply(accel_q_gyro, gyro_q_mag);
 	
-	if (!send_payload_msg(device, DEVICE_IMU_MSG_GET_STATIC_ID, 0, NULL)) {
-		device_imu_error("Failed sending payload to get static id");
-		return DEVICE_IMU_ERROR_PAYLOAD_FAILED;
-	}
+	calibration->gyroscopeMisalignment = FusionQuaternionToMatrix(accel_q_gyro);
+	calibration->gyroscopeSensitivity = scale_gyro;
+	calibration->gyroscopeOffset = gyro_bias;
 	
-	uint32_t static_id = 0;
-	if (recv_payload_msg(device, DEVICE_IMU_MSG_GET_STATIC_ID, 4, (uint8_t*) &static_id)) {
-		device->static_id = static_id;
-	} else {
-		device->static_id = 0x20220101;
-	}
+	calibration->accelerometerMisalignment = FUSION_IDENTITY_MATRIX;
+	calibration->accelerometerSensitivity = scale_accel;
+	calibration->accelerometerOffset = accel_bias;
 	
-	device->calibration = malloc(sizeof(device_imu_calibration_type));
-	device_imu_reset_calibration(device);
+	calibration->magnetometerMisalignment = FusionQuaternionToMatrix(accel_q_mag);
+	calibration->magnetometerSensitivity = scale_mag;
+	calibration->magnetometerOffset = mag_bias;
+	
+	calibration->noises = imu_noises;
+	
+	json_object_put(root);
+	return true;
+}
 
-	if (!send_payload_msg(device, DEVICE_IMU_MSG_GET_CAL_DATA_LENGTH, 0, NULL)) {
-		device_imu_error("Failed sending payload to get calibration data length");
-		return DEVICE_IMU_ERROR_PAYLOAD_FAILED;
+static bool load_factory_calibration(device_imu_type* device, device_imu_calibration_type* calibration, uint64_t deadline) {
+	const uint64_t start = device_time_now();
+	bool loaded = false;
+	uint32_t window = device->options.calibration_window;
+	uint32_t attempts = 0;
+	
+	if (!window) {
+		window = 1;
 	}
 	
-	uint32_t calibration_len = 0;
-	if (recv_payload_msg(device, DEVICE_IMU_MSG_GET_CAL_DATA_LENGTH, 4, (uint8_t*) &calibration_len)) {
-		const uint16_t max_packet_size = (device->max_payload_size - 8);
-		char* calibration_data = malloc(calibration_len + 1);
+	for (;;) {
+		uint32_t calibration_len = 0;
 		
-		uint32_t position = 0;
-		while (position < calibration_len) {
-			const uint32_t remaining = (calibration_len - position);
-
-			if (!send_payload_msg(device, DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT, 0, NULL)) {
-				break;
-			}
-			
-			const uint16_t next = (remaining > max_packet_size? max_packet_size : remaining);
-			
-			if (!recv_payload_msg(device, DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT, next, (uint8_t*) calibration_data + position)) {
-				break;
-			}
-			
-			position += next;
+		// Asking for the length again starts over with the first segment
+		if (!do_payload_msg(device, DEVICE_IMU_MSG_GET_CAL_DATA_LENGTH, 0, NULL, 4, (uint8_t*) &calibration_len,
+							device->options.handshake_attempts, deadline)) {
+			break;
 		}
-
-		calibration_data[calibration_len] = '\0';
 		
-		struct json_tokener* tokener = json_tokener_new();
-		struct json_object* root = json_tokener_parse_ex(tokener, calibration_data, calibration_len);
-		struct json_object* imu = json_object_object_get(root, "IMU");
-		struct json_object* dev1 = json_object_object_get(imu, "device_1");
+		calibration_len = le32toh(calibration_len);
 		
-		FusionVector accel_bias = json_object_get_vector(json_object_object_get(dev1, "accel_bias"));
-		FusionQuaternion accel_q_gyro = json_object_get_quaternion(json_object_object_get(dev1, "accel_q_gyro"));
-		FusionVector gyro_bias = json_object_get_vector(json_object_object_get(dev1, "gyro_bias"));
-		FusionQuaternion gyro_q_mag = json_object_get_quaternion(json_object_object_get(dev1, "gyro_q_mag"));
-		FusionVector mag_bias = json_object_get_vector(json_object_object_get(dev1, "mag_bias"));
-		FusionQuaternion imu_noises = json_object_get_quaternion(json_object_object_get(dev1, "imu_noises"));
-		FusionVector scale_accel = json_object_get_vector(json_object_object_get(dev1, "scale_accel"));
-		FusionVector scale_gyro = json_object_get_vector(json_object_object_get(dev1, "scale_gyro"));
-		FusionVector scale_mag = json_object_get_vector(json_object_object_get(dev1, "scale_mag"));
-
-		const FusionQuaternion accel_q_mag = FusionQuaternionMultiply(accel_q_gyro, gyro_q_mag);
+		char* calibration_data = malloc(calibration_len + 1);
+		
+		if (!calibration_data) {
+			device_imu_error("Not allocated");
+			break;
+		}
 		
-		device->calibration->gyroscopeMisalignment = FusionQuaternionToMatrix(accel_q_gyro);
-		device->calibration->gyroscopeSensitivity = scale_gyro;
-		device->calibration->gyroscopeOffset = gyro_bias;
+		uint32_t checksum_errors = 0;
+		loaded = download_calibration(
+				device,
+				(uint8_t*) calibration_data,
+				calibration_len,
+				window,
+				deadline,
+				&checksum_errors
+		);
 		
-		device->calibration->accelerometerMisalignment = FUSION_IDENTITY_MATRIX;
-		device->calibration->accelerometerSensitivity = scale_accel;
-		device->calibration->accelerometerOffset = accel_bias;
+		calibration_data[calibration_len] = '\0';
 		
-		device->calibration->magnetometerMisalignment = FusionQuaternionToMatrix(accel_q_mag);
-		device->calibration->magnetometerSensitivity = scale_mag;
-		device->calibration->magnetometerOffset = mag_bias;
+		device->stats.checksum_errors += checksum_errors;
 		
-		device->calibration->noises = imu_noises;
+		if (loaded) {
+			loaded = parse_calibration(calibration, calibration_data, calibration_len);
+		}
 		
-		json_tokener_free(tokener);
 		free(calibration_data);
+		
+		// Corrupted segments are worth another attempt, other failures only without pipelining
+		if ((loaded) || ((window <= 1) && ((!checksum_errors) || (++attempts >= device->options.handshake_attempts)))) {
+			break;
+		}
+		
+		// Fall back to one request at a time in case the firmware can't keep up with several in flight
+		device_imu_error("Calibration download failed");
+		drain_replies(device, deadline);
+		
+		device->stats.calibration_retries++;
+		window = 1;
 	}
+	
+	device->calibration_duration = device_time_now() - start;
+	return loaded;
+}
 
-	if ((!send_payload_msg_signal(device, DEVICE_IMU_MSG_START_IMU_DATA, 0x1)) ||
-		(!recv_payload_msg(device, DEVICE_IMU_MSG_START_IMU_DATA, 0, NULL))) {
-		device_imu_error("Failed sending payload to start imu data stream");
-		return DEVICE_IMU_ERROR_PAYLOAD_FAILED;
+static void update_factory_calibration(device_imu_type* device, uint64_t deadline) {
+	device_imu_calibration_type* calibration = calibration_copy(device);
+	
+	if (!calibration) {
+		return;
+	}
+	
+	if (load_factory_calibration(device, calibration, deadline)) {
+		calibration_publish(device, calibration);
+	} else {
+		free(calibration);
 	}
+}
+
+enum device_imu_download_phase_t {
+	DOWNLOAD_LENGTH = 0,
+	DOWNLOAD_SEGMENTS = 1,
+	DOWNLOAD_FAILED = 2,
+	DOWNLOAD_SWAPPED = 3,
+};
 
-	const uint32_t SAMPLE_RATE = 1000;
+struct device_imu_download_t {
+	enum device_imu_download_phase_t phase;
+	uint32_t window;
+	uint32_t attempts;
 	
-	device->offset = malloc(sizeof(FusionOffset));
-	device->ahrs = malloc(sizeof(FusionAhrs));
+	uint32_t len;
+	uint32_t requested;
+	uint32_t received;
+	char* data;
 	
-	if (device->offset) {
-		FusionOffsetInitialise((FusionOffset*) device->offset, SAMPLE_RATE);
+	uint64_t start;
+	uint64_t timeout;
+	
+	FusionVector gyroscope_offset; // (user calibration to apply on top of the factory one)
+	FusionVector accelerometer_offset; // (user calibration to apply on top of the factory one)
+};
+
+typedef struct device_imu_download_t device_imu_download_type;
+
+static void download_request_length(device_imu_type* device, device_imu_download_type* download, uint64_t now) {
+	if (download->data) {
+		free(download->data);
+		download->data = NULL;
 	}
+	
+	download->phase = DOWNLOAD_LENGTH;
+	download->len = 0;
+	download->requested = 0;
+	download->received = 0;
+	download->timeout = now + device->options.handshake_timeout * DEVICE_TIME_MS;
+	
+	send_payload_msg(device, DEVICE_IMU_MSG_GET_CAL_DATA_LENGTH, 0, NULL);
+}
 
-	FusionAhrsInitialise((FusionAhrs*) device->ahrs);
+static void download_request_segments(device_imu_type* device, device_imu_download_type* download, uint64_t now) {
+	const uint16_t max_packet_size = (device->max_payload_size - 8);
 	
-	const FusionAhrsSettings settings = {
-			.convention = FusionConventionNed,
-			.gain = 0.5f,
-			.accelerationRejection = 10.0f,
-			.magneticRejection = 20.0f,
-			.recoveryTriggerPeriod = 5 * SAMPLE_RATE, /* 5 seconds */
-	};
+	while ((download->requested < download->len) &&
+		   (download->requested - download->received < download->window * max_packet_size)) {
+		if (!send_payload_msg(device, DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT, 0, NULL)) {
+			break;
+		}
+		
+		const uint32_t remaining = (download->len - download->requested);
+		download->requested += (remaining > max_packet_size? max_packet_size : remaining);
+	}
 	
-	FusionAhrsSetSettings((FusionAhrs*) device->ahrs, &settings);
-	return DEVICE_IMU_ERROR_NO_ERROR;
+	download->timeout = now + device->options.handshake_timeout * DEVICE_TIME_MS;
 }
 
-device_imu_error_type device_imu_reset_calibration(device_imu_type* device) {
-	if (!device) {
-		device_imu_error("No device");
-		return DEVICE_IMU_ERROR_NO_DEVICE;
+static void download_retry(device_imu_type* device, device_imu_download_type* download, uint64_t now) {
+	download->attempts++;
+	
+	if (download->attempts >= device->options.handshake_attempts) {
+		download->phase = DOWNLOAD_FAILED;
+		return;
 	}
 	
-	if (!device->calibration) {
-		device_imu_error("Not allocated");
-		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	device->stats.calibration_retries++;
+	download->window = 1;
+	download_request_length(device, download, now);
+}
+
+static void download_finish(device_imu_type* device, device_imu_download_type* download, uint64_t now) {
+	device_imu_calibration_type* calibration = calibration_copy(device);
+	
+	if (!calibration) {
+		download->phase = DOWNLOAD_FAILED;
+		return;
 	}
 	
-	device->calibration->gyroscopeMisalignment = FUSION_IDENTITY_MATRIX;
-	device->calibration->gyroscopeSensitivity = FUSION_VECTOR_ONES;
-	device->calibration->gyroscopeOffset = FUSION_VECTOR_ZERO;
+	download->data[download->len] = '\0';
+	
+	if (!parse_calibration(calibration, download->data, download->len)) {
+		free(calibration);
+		download_retry(device, download, now);
+		return;
+	}
 	
-	device->calibration->accelerometerMisalignment = FUSION_IDENTITY_MATRIX;
-	device->calibration->accelerometerSensitivity = FUSION_VECTOR_ONES;
-	device->calibration->accelerometerOffset = FUSION_VECTOR_ZERO;
+	// Offsets from device_imu_calibrate() in the meantime would get lost otherwise
+	calibration->gyroscopeOffset = FusionVectorAdd(calibration->gyroscopeOffset, download->gyroscope_offset);
+	calibration->accelerometerOffset = FusionVectorAdd(calibration->accelerometerOffset, download->accelerometer_offset);
 	
-	device->calibration->magnetometerMisalignment = FUSION_IDENTITY_MATRIX;
-	device->calibration->magnetometerSensitivity = FUSION_VECTOR_ONES;
-	device->calibration->magnetometerOffset = FUSION_VECTOR_ZERO;
+	calibration_publish(device, calibration);
 	
-	device->calibration->softIronMatrix = FUSION_IDENTITY_MATRIX;
-	device->calibration->hardIronOffset = FUSION_VECTOR_ZERO;
+	free(download->data);
+	download->data = NULL;
 	
-	device->calibration->noises = FUSION_IDENTITY_QUATERNION;
-	device->calibration->noises.element.w = 0.0f;
+	download->phase = DOWNLOAD_SWAPPED;
+	device->calibration_duration = now - download->start;
 }
 
-device_imu_error_type device_imu_load_calibration(device_imu_type* device, const char* path) {
-	if (!device) {
-		device_imu_error("No device");
-		return DEVICE_IMU_ERROR_NO_DEVICE;
+static bool download_reply(device_imu_type* device, const device_imu_payload_packet_type* payload, int transferred, uint64_t now) {
+	device_imu_download_type* download = (device_imu_download_type*) device->download;
+	
+	if ((!download) || (payload->head != 0xAA)) {
+		return false;
 	}
 	
-	if (!device->calibration) {
-		device_imu_error("Not allocated");
-		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	const uint16_t max_packet_size = (device->max_payload_size - 8);
+	
+	switch (payload->msgid) {
+		case DEVICE_IMU_MSG_GET_CAL_DATA_LENGTH: {
+			if ((download->phase != DOWNLOAD_LENGTH) || (transferred < 8 + 4)) {
+				break;
+			}
+			
+			uint32_t len;
+			memcpy(&len, payload->data, 4);
+			
+			download->len = le32toh(len);
+			download->data = malloc(download->len + 1);
+			
+			if (!download->data) {
+				device_imu_error("Not allocated");
+				download->phase = DOWNLOAD_FAILED;
+				break;
+			}
+			
+			download->phase = DOWNLOAD_SEGMENTS;
+			download_request_segments(device, download, now);
+			break;
+		}
+		case DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT: {
+			if (download->phase != DOWNLOAD_SEGMENTS) {
+				break;
+			}
+			
+			const uint32_t remaining = (download->len - download->received);
+			const uint16_t next = (remaining > max_packet_size? max_packet_size : remaining);
+			
+			// A truncated segment can't be requested again, the timeout starts over instead
+			if (transferred < 8 + next) {
+				break;
+			}
+			
+			// A corrupted segment fails the download, it starts over from the length like any other retry
+			if (!payload_checksum_valid(payload)) {
+				device_imu_error("Calibration segment checksum failed");
+				device->stats.checksum_errors++;
+				download_retry(device, download, now);
+				break;
+			}
+			
+			memcpy(download->data + download->received, payload->data, next);
+			download->received += next;
+			
+			if (download->received >= download->len) {
+				download_finish(device, download, now);
+			} else {
+				download_request_segments(device, download, now);
+			}
+			
+			break;
+		}
+		default:
+			return false;
 	}
 	
-	FILE* file = fopen(path, "rb");
-	if (!file) {
-		device_imu_error("No file opened");
-		return DEVICE_IMU_ERROR_FILE_NOT_OPEN;
+	return true;
+}
+
+static void download_free(device_imu_type* device) {
+	device_imu_download_type* download = (device_imu_download_type*) device->download;
+	
+	if (!download) {
+		return;
 	}
+	
+	if (download->data) {
+		free(download->data);
+	}
+	
+	free(download);
+	device->download = NULL;
+}
 
-	device_imu_error_type result = DEVICE_IMU_ERROR_NO_ERROR;
+static void download_progress(device_imu_type* device, uint64_t now) {
+	device_imu_download_type* download = (device_imu_download_type*) device->download;
 	
-	size_t count;
-	count = fread(device->calibration, 1, sizeof(device_imu_calibration_type), file);
+	if ((download->phase == DOWNLOAD_LENGTH) || (download->phase == DOWNLOAD_SEGMENTS)) {
+		if (now >= download->timeout) {
+			download_retry(device, download, now);
+		}
+	}
 	
-	if (sizeof(device_imu_calibration_type) != count) {
-		device_imu_error("Not fully loaded");
-		result = DEVICE_IMU_ERROR_LOADING_FAILED;
+	if (download->phase != DOWNLOAD_FAILED) {
+		return;
 	}
 	
-	if (0 != fclose(file)) {
-		device_imu_error("No file closed");
-		return DEVICE_IMU_ERROR_FILE_NOT_CLOSED;
+	// Pausing the stream for a blocking download would stall the reader, so the current calibration stays instead
+	device_imu_error("Deferred calibration download failed");
+	
+	device->calibration_duration = now - download->start;
+	download_free(device);
+}
+
+void device_imu_default_options(device_imu_options_type* options) {
+	if (!options) {
+		return;
 	}
 	
-	return result;
+	memset(options, 0, sizeof(device_imu_options_type));
+	options->handshake_timeout 	= DEVICE_IMU_HANDSHAKE_TIMEOUT_MS;
+	options->handshake_attempts = DEVICE_IMU_HANDSHAKE_ATTEMPTS;
+	options->open_timeout 		= DEVICE_IMU_OPEN_TIMEOUT_MS;
+	options->close_timeout 		= DEVICE_IMU_CLOSE_TIMEOUT_MS;
+	options->freshness 			= DEVICE_IMU_FRESHNESS_MS;
+	options->stall_threshold 	= DEVICE_IMU_STALL_MS;
+	options->catchup_threshold 	= DEVICE_IMU_CATCHUP_MS;
+	options->calibration_window = DEVICE_IMU_CALIBRATION_WINDOW;
+	
+#ifdef DEVICE_IMU_FIXED_POINT
+	options->fixed_point 		= true;
+#endif
 }
 
-device_imu_error_type device_imu_save_calibration(device_imu_type* device, const char* path) {
+device_imu_error_type device_imu_open(device_imu_type* device, device_imu_event_callback callback) {
+	return device_imu_open_ex(device, callback, NULL);
+}
+
+device_imu_error_type device_imu_open_ex(device_imu_type* device, device_imu_event_callback callback, const device_imu_options_type* options) {
 	if (!device) {
 		device_imu_error("No device");
 		return DEVICE_IMU_ERROR_NO_DEVICE;
 	}
 	
-	if (!device->calibration) {
-		device_imu_error("Not allocated");
-		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	const uint64_t start = device_time_now();
+	
+	memset(device, 0, sizeof(device_imu_type));
+	device->open_timestamp = start;
+	device->vendor_id 	= xreal_vendor_id;
+	device->product_id 	= 0;
+	device->callback 	= callback;
+	
+	if (options) {
+		device->options = *options;
+	} else {
+		device_imu_default_options(&(device->options));
 	}
 	
-	FILE* file = fopen(path, "wb");
-	if (!file) {
-		device_imu_error("No file opened");
-		return DEVICE_IMU_ERROR_FILE_NOT_OPEN;
+	if (!device->options.handshake_attempts) {
+		device->options.handshake_attempts = 1;
+	}
+	
+	if ((uint32_t) device->options.convention >= DEVICE_IMU_CONVENTIONS) {
+		device_imu_error("Unknown convention");
+		device->options.convention = DEVICE_IMU_CONVENTION_NED;
+	}
+	
+	const uint64_t deadline = start + device->options.open_timeout * DEVICE_TIME_MS;
+	
+	if (!device_init()) {
+		device_imu_error("Not initialized");
+		return DEVICE_IMU_ERROR_NOT_INITIALIZED;
 	}
 
-	device_imu_error_type result = DEVICE_IMU_ERROR_NO_ERROR;
+	struct hid_device_info* info = hid_enumerate(
+		device->vendor_id, 
+		device->product_id
+	);
+
+	struct hid_device_info* it = info;
+	while (it) {
+		int interface_id = xreal_imu_interface_id(it->product_id);
+		if (interface_id != -1 && it->interface_number == interface_id) {
+#ifndef NDEBUG
+            printf("Found IMU device with product_id 0x%x on interface %d\n", it->product_id, interface_id);
+#endif
+			device->product_id = it->product_id;
+			device->handle = hid_open_path(it->path);
+			device->max_payload_size = xreal_imu_max_payload_size(device->product_id);
+			break;
+		}
+
+		it = it->next;
+	}
+
+	hid_free_enumeration(info);
 	
-	size_t count;
-	count = fwrite(device->calibration, 1, sizeof(device_imu_calibration_type), file);
+	if (!device->handle) {
+		device_imu_error("No handle");
+		return DEVICE_IMU_ERROR_NO_HANDLE;
+	}
+
+	if (!do_payload_msg_signal(device, DEVICE_IMU_MSG_START_IMU_DATA, 0x0, deadline)) {
+		device_imu_error("Failed sending payload to stop imu data stream");
+		return payload_error(deadline);
+	}
+
+	device_imu_clear(device);
 	
-	if (sizeof(device_imu_calibration_type) != count) {
-		device_imu_error("Not fully saved");
-		result = DEVICE_IMU_ERROR_SAVING_FAILED;
+	uint32_t static_id = 0;
+	if (do_payload_msg(device, DEVICE_IMU_MSG_GET_STATIC_ID, 0, NULL, 4, (uint8_t*) &static_id,
+					   device->options.handshake_attempts, deadline)) {
+		device->static_id = static_id;
+	} else {
+		device->static_id = 0x20220101;
 	}
 	
-	if (0 != fclose(file)) {
-		device_imu_error("No file closed");
-		return DEVICE_IMU_ERROR_FILE_NOT_CLOSED;
+	device->calibration = malloc(sizeof(device_imu_calibration_type));
+	device_imu_reset_calibration(device);
+	
+	device->iron = calloc(1, sizeof(device_imu_iron_type));
+	device->folded = calloc(1, sizeof(device_imu_folded_type));
+	
+	if ((device->options.calibration_path) &&
+		(DEVICE_IMU_ERROR_NO_ERROR != device_imu_load_calibration(device, device->options.calibration_path))) {
+		device_imu_reset_calibration(device);
 	}
 	
-	return result;
+	if (!device->options.deferred_calibration) {
+		update_factory_calibration(device, deadline);
+	}
+
+	if (!do_payload_msg_signal(device, DEVICE_IMU_MSG_START_IMU_DATA, 0x1, deadline)) {
+		device_imu_error("Failed sending payload to start imu data stream");
+		return payload_error(deadline);
+	}
+	
+	if (device->options.deferred_calibration) {
+		device_imu_download_type* download = calloc(1, sizeof(device_imu_download_type));
+		
+		// The factory calibration arrives in between sensor reports and gets swapped in by device_imu_read()
+		if (download) {
+			download->window = device->options.calibration_window? device->options.calibration_window : 1;
+			download->start = device_time_now();
+			
+			device->download = download;
+			download_request_length(device, download, download->start);
+		}
+	}
+
+	const uint32_t SAMPLE_RATE = DEVICE_IMU_SAMPLE_RATE;
+	
+	device->offset = malloc(sizeof(FusionOffset));
+	device->ahrs = malloc(sizeof(FusionAhrs));
+	
+	if (device->offset) {
+		FusionOffsetInitialise((FusionOffset*) device->offset, SAMPLE_RATE);
+	}
+
+	FusionAhrsInitialise((FusionAhrs*) device->ahrs);
+	
+	const FusionAhrsSettings settings = {
+			.convention = FusionConventionNed,
+			.gain = 0.5f,
+			.accelerationRejection = 10.0f,
+			.magneticRejection = 20.0f,
+			.recoveryTriggerPeriod = 5 * SAMPLE_RATE, /* 5 seconds */
+	};
+	
+	FusionAhrsSetSettings((FusionAhrs*) device->ahrs, &settings);
+	
+	// The orientation still gets written into the AHRS, so every getter keeps working with the fixed-point path
+	if ((device->options.fixed_point) && (device->ahrs)) {
+		device->fixed = malloc(sizeof(device_imu_fixed_type));
+		
+		if (device->fixed) {
+			device_imu_fixed_init(
+					(device_imu_fixed_type*) device->fixed,
+					settings.gain,
+					settings.accelerationRejection,
+					settings.recoveryTriggerPeriod,
+					SAMPLE_RATE
+			);
+		}
+	}
+	
+	const bool gyroscope_filter = (device->options.gyroscope_cutoff > 0.0f);
+	const bool accelerometer_filter = (device->options.accelerometer_cutoff > 0.0f);
+	
+	// Vibration gets removed before it reaches the fusion, where it would trigger the acceleration rejection
+	if ((gyroscope_filter) || (accelerometer_filter)) {
+		if ((device->options.gyroscope_cutoff >= SAMPLE_RATE / 2) || (device->options.accelerometer_cutoff >= SAMPLE_RATE / 2)) {
+			device_imu_error("Cutoff beyond Nyquist frequency");
+		} else if (device->fixed) {
+			device_imu_error("Pre-filter not supported with fixed-point");
+		} else {
+			device->filter = calloc(1, sizeof(device_imu_filter_type));
+		}
+	}
+	
+	if (device->filter) {
+		device_imu_filter_type* filter = (device_imu_filter_type*) device->filter;
+		
+		filter->gyroscope_enabled = gyroscope_filter;
+		filter->accelerometer_enabled = accelerometer_filter;
+		
+		if (gyroscope_filter) {
+			device_math_biquad_lowpass(&(filter->gyroscope), device->options.gyroscope_cutoff, (float) SAMPLE_RATE);
+		}
+		
+		if (accelerometer_filter) {
+			device_math_biquad_lowpass(&(filter->accelerometer), device->options.accelerometer_cutoff, (float) SAMPLE_RATE);
+		}
+	}
+	
+	if ((device->options.adaptive_startup) && (device->ahrs)) {
+		device->startup = calloc(1, sizeof(device_imu_startup_type));
+	}
+	
+	device->open_duration = device_time_now() - start;
+
+#ifndef NDEBUG
+	printf("Opened IMU in %.1f ms (calibration: %.1f ms)\n",
+		   (double) device->open_duration / 1e6,
+		   (double) device->calibration_duration / 1e6);
+#endif
+
+	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
-static void device_imu_callback(device_imu_type* device,
-							 uint64_t timestamp,
-							 device_imu_event_type event) {
-	if (!device->callback) {
-		return;
+device_imu_error_type device_imu_set_sample_callback(device_imu_type* device, device_imu_sample_callback callback, void* userdata) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
 	}
 	
-	device->callback(timestamp, event, device->ahrs);
+	device->sample_callback = callback;
+	device->userdata = userdata;
+	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
-static int32_t pack32bit_signed(const uint8_t* data) {
-	uint32_t unsigned_value = (data[0]) | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
-	return ((int32_t) unsigned_value);
+struct device_imu_stage_t {
+	device_imu_stage_callback callback;
+	void* userdata;
+};
+
+typedef struct device_imu_stage_t device_imu_stage_type;
+
+struct device_imu_pipeline_t {
+	uint32_t count [DEVICE_IMU_STAGE_POSITIONS];
+	device_imu_stage_type stages [DEVICE_IMU_STAGE_POSITIONS][DEVICE_IMU_MAX_STAGES];
+	
+	bool holding;
+	device_imu_vec3_type held [6]; // (vectors of the last sample passed on by the pre-fusion stages)
+};
+
+typedef struct device_imu_pipeline_t device_imu_pipeline_type;
+
+device_imu_error_type device_imu_add_stage(device_imu_type* device,
+										   device_imu_stage_position_type position,
+										   device_imu_stage_callback callback,
+										   void* userdata) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+	
+	if ((!callback) || (position < 0) || (position >= DEVICE_IMU_STAGE_POSITIONS)) {
+		device_imu_error("Invalid stage");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
+	}
+	
+	if (!device->pipeline) {
+		device->pipeline = calloc(1, sizeof(device_imu_pipeline_type));
+	}
+	
+	device_imu_pipeline_type* pipeline = (device_imu_pipeline_type*) device->pipeline;
+	
+	if ((!pipeline) || (pipeline->count[position] >= DEVICE_IMU_MAX_STAGES)) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	device_imu_stage_type* stage = &(pipeline->stages[position][pipeline->count[position]++]);
+	stage->callback = callback;
+	stage->userdata = userdata;
+	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
-static int32_t pack24bit_signed(const uint8_t* data) {
-	uint32_t unsigned_value = (data[0]) | (data[1] << 8) | (data[2] << 16);
-	if ((data[2] & 0x80) != 0) unsigned_value |= (0xFF << 24);
-	return ((int32_t) unsigned_value);
+device_imu_error_type device_imu_clear_stages(device_imu_type* device) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+	
+	if (device->pipeline) {
+		free(device->pipeline);
+		device->pipeline = NULL;
+	}
+	
+	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
-static int16_t pack16bit_signed(const uint8_t* data) {
-	uint16_t unsigned_value = (data[1] << 8) | (data[0]);
-	return (int16_t) unsigned_value;
+static uint32_t stage_count(const device_imu_type* device, device_imu_stage_position_type position) {
+	const device_imu_pipeline_type* pipeline = (const device_imu_pipeline_type*) device->pipeline;
+	return pipeline? pipeline->count[position] : 0;
 }
 
-static int32_t pack32bit_signed_swap(const uint8_t* data) {
-	uint32_t unsigned_value = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | (data[3]);
-	return ((int32_t) unsigned_value);
+static bool run_stages(device_imu_type* device, device_imu_stage_position_type position, device_imu_sample_type* sample) {
+	const device_imu_pipeline_type* pipeline = (const device_imu_pipeline_type*) device->pipeline;
+	
+	if (!pipeline) {
+		return true;
+	}
+	
+	const device_imu_stage_type* stages = pipeline->stages[position];
+	
+	for (uint32_t i = 0; i < pipeline->count[position]; i++) {
+		if (!stages[i].callback(sample, stages[i].userdata)) {
+			return false;
+		}
+	}
+	
+	return true;
 }
 
-static int16_t pack16bit_signed_swap(const uint8_t* data) {
+// A dropped sample gets the vectors of the last one passed on, so post-fusion stages still see a sample per report
+static bool run_pre_fusion_stages(device_imu_type* device, device_imu_sample_type* sample) {
+	device_imu_pipeline_type* pipeline = (device_imu_pipeline_type*) device->pipeline;
+	
+	if ((!pipeline) || (!pipeline->count[DEVICE_IMU_STAGE_PRE_FUSION])) {
+		return true;
+	}
+	
+	device_imu_vec3_type* vectors [6] = {
+			&(sample->raw_gyroscope), &(sample->raw_accelerometer), &(sample->raw_magnetometer),
+			&(sample->gyroscope), &(sample->accelerometer), &(sample->magnetometer)
+	};
+	
+	const bool passed = run_stages(device, DEVICE_IMU_STAGE_PRE_FUSION, sample);
+	
+	for (uint32_t i = 0; i < 6; i++) {
+		if (passed) {
+			pipeline->held[i] = *(vectors[i]);
+		} else if (pipeline->holding) {
+			*(vectors[i]) = pipeline->held[i];
+		}
+	}
+	
+	pipeline->holding |= passed;
+	return passed;
+}
+
+device_imu_error_type device_imu_reset_calibration(device_imu_type* device) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+	
+	if (!device->calibration) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	device_imu_calibration_type* calibration = malloc(sizeof(device_imu_calibration_type));
+	
+	if (!calibration) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	calibration->gyroscopeMisalignment = FUSION_IDENTITY_MATRIX;
+	calibration->gyroscopeSensitivity = FUSION_VECTOR_ONES;
+	calibration->gyroscopeOffset = FUSION_VECTOR_ZERO;
+	
+	calibration->accelerometerMisalignment = FUSION_IDENTITY_MATRIX;
+	calibration->accelerometerSensitivity = FUSION_VECTOR_ONES;
+	calibration->accelerometerOffset = FUSION_VECTOR_ZERO;
+	
+	calibration->magnetometerMisalignment = FUSION_IDENTITY_MATRIX;
+	calibration->magnetometerSensitivity = FUSION_VECTOR_ONES;
+	calibration->magnetometerOffset = FUSION_VECTOR_ZERO;
+	
+	calibration->softIronMatrix = FUSION_IDENTITY_MATRIX;
+	calibration->hardIronOffset = FUSION_VECTOR_ZERO;
+	
+	calibration->noises = FUSION_IDENTITY_QUATERNION;
+	calibration->noises.element.w = 0.0f;
+	
+	calibration_publish(device, calibration);
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+device_imu_error_type device_imu_load_calibration(device_imu_type* device, const char* path) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+	
+	if (!device->calibration) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		device_imu_error("No file opened");
+		return DEVICE_IMU_ERROR_FILE_NOT_OPEN;
+	}
+	
+	device_imu_calibration_type* calibration = malloc(sizeof(device_imu_calibration_type));
+	
+	if (!calibration) {
+		device_imu_error("Not allocated");
+		fclose(file);
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+
+	device_imu_error_type result = DEVICE_IMU_ERROR_NO_ERROR;
+	
+	size_t count;
+	count = fread(calibration, 1, sizeof(device_imu_calibration_type), file);
+	
+	// A partially loaded calibration never gets published
+	if (sizeof(device_imu_calibration_type) != count) {
+		device_imu_error("Not fully loaded");
+		result = DEVICE_IMU_ERROR_LOADING_FAILED;
+		free(calibration);
+	} else {
+		calibration_publish(device, calibration);
+	}
+	
+	if (0 != fclose(file)) {
+		device_imu_error("No file closed");
+		return DEVICE_IMU_ERROR_FILE_NOT_CLOSED;
+	}
+	
+	return result;
+}
+
+device_imu_error_type device_imu_save_calibration(device_imu_type* device, const char* path) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+	
+	if (!device->calibration) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	device_imu_calibration_type calibration;
+	
+	const device_imu_calibration_type* current = calibration_acquire(device);
+	calibration = *current;
+	calibration_release(device);
+	
+	// The iron estimate keeps changing while streaming, so it only gets merged into the saved copy
+	const device_imu_iron_type* iron = (const device_imu_iron_type*) device->iron;
+	
+	if ((iron) && (iron->estimated)) {
+		calibration.softIronMatrix = iron->softIronMatrix;
+		calibration.hardIronOffset = iron->hardIronOffset;
+	}
+	
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		device_imu_error("No file opened");
+		return DEVICE_IMU_ERROR_FILE_NOT_OPEN;
+	}
+
+	device_imu_error_type result = DEVICE_IMU_ERROR_NO_ERROR;
+	
+	size_t count;
+	count = fwrite(&calibration, 1, sizeof(device_imu_calibration_type), file);
+	
+	if (sizeof(device_imu_calibration_type) != count) {
+		device_imu_error("Not fully saved");
+		result = DEVICE_IMU_ERROR_SAVING_FAILED;
+	}
+	
+	if (0 != fclose(file)) {
+		device_imu_error("No file closed");
+		return DEVICE_IMU_ERROR_FILE_NOT_CLOSED;
+	}
+	
+	return result;
+}
+
+static void device_imu_callback(device_imu_type* device,
+							 uint64_t timestamp,
+							 device_imu_event_type event) {
+	if (!device->callback) {
+		return;
+	}
+	
+	device->callback(timestamp, event, device->ahrs);
+}
+
+static void sample_vector(device_imu_vec3_type* vector, const FusionVector* fusion) {
+	vector->x = fusion->axis.x;
+	vector->y = fusion->axis.y;
+	vector->z = fusion->axis.z;
+}
+
+static FusionVector sample_fusion_vector(const device_imu_vec3_type* vector) {
+	FusionVector fusion;
+	fusion.axis.x = vector->x;
+	fusion.axis.y = vector->y;
+	fusion.axis.z = vector->z;
+	return fusion;
+}
+
+static uint32_t sample_flags(const FusionAhrs* ahrs, const FusionAhrsInternalStates* states) {
+	const FusionAhrsFlags ahrs_flags = FusionAhrsGetFlags(ahrs);
+	uint32_t flags = 0;
+	
+	if (ahrs_flags.initialising) {
+		flags |= DEVICE_IMU_SAMPLE_FLAG_INITIALISING;
+	}
+	
+	if (ahrs_flags.angularRateRecovery) {
+		flags |= DEVICE_IMU_SAMPLE_FLAG_ANGULAR_RATE_RECOVERY;
+	}
+	
+	if (ahrs_flags.accelerationRecovery) {
+		flags |= DEVICE_IMU_SAMPLE_FLAG_ACCELERATION_RECOVERY;
+	}
+	
+	if (ahrs_flags.magneticRecovery) {
+		flags |= DEVICE_IMU_SAMPLE_FLAG_MAGNETIC_RECOVERY;
+	}
+	
+	if (states->accelerometerIgnored) {
+		flags |= DEVICE_IMU_SAMPLE_FLAG_ACCELEROMETER_IGNORED;
+	}
+	
+	if (states->magnetometerIgnored) {
+		flags |= DEVICE_IMU_SAMPLE_FLAG_MAGNETOMETER_IGNORED;
+	}
+	
+	return flags;
+}
+
+// Reads the flags and internal states once per update, the sample and the stats share them
+static void update_fusion_stats(device_imu_type* device, FusionAhrsInternalStates* states) {
+	const FusionAhrs* ahrs = (const FusionAhrs*) device->ahrs;
+	
+	*states = FusionAhrsGetInternalStates(ahrs);
+	
+	const uint32_t flags = sample_flags(ahrs, states);
+	const uint32_t entered = flags & ~(device->fusion_flags);
+	
+	device->fusion_flags = flags;
+	
+	if (flags & DEVICE_IMU_SAMPLE_FLAG_ACCELEROMETER_IGNORED) {
+		device->stats.acceleration_rejections++;
+	}
+	
+	if (flags & DEVICE_IMU_SAMPLE_FLAG_MAGNETOMETER_IGNORED) {
+		device->stats.magnetic_rejections++;
+	}
+	
+	if (flags & DEVICE_IMU_SAMPLE_FLAG_INITIALISING) {
+		device->stats.initialising_updates++;
+	}
+	
+	if (entered & DEVICE_IMU_SAMPLE_FLAG_ANGULAR_RATE_RECOVERY) {
+		device->stats.angular_rate_recoveries++;
+	}
+	
+	if (entered & DEVICE_IMU_SAMPLE_FLAG_ACCELERATION_RECOVERY) {
+		device->stats.acceleration_recoveries++;
+	}
+	
+	if (entered & DEVICE_IMU_SAMPLE_FLAG_MAGNETIC_RECOVERY) {
+		device->stats.magnetic_recoveries++;
+	}
+	
+	device->stats.acceleration_error = states->accelerationError;
+	
+	// The error while initialising only shows how far off the start was
+	if ((!(flags & DEVICE_IMU_SAMPLE_FLAG_INITIALISING)) && (states->accelerationError > device->stats.acceleration_error_max)) {
+		device->stats.acceleration_error_max = states->accelerationError;
+	}
+}
+
+static int32_t pack32bit_signed(const uint8_t* data) {
+	uint32_t unsigned_value = (data[0]) | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+	return ((int32_t) unsigned_value);
+}
+
+static int32_t pack24bit_signed(const uint8_t* data) {
+	uint32_t unsigned_value = (data[0]) | (data[1] << 8) | (data[2] << 16);
+	if ((data[2] & 0x80) != 0) unsigned_value |= (0xFF << 24);
+	return ((int32_t) unsigned_value);
+}
+
+static int16_t pack16bit_signed(const uint8_t* data) {
+	uint16_t unsigned_value = (data[1] << 8) | (data[0]);
+	return (int16_t) unsigned_value;
+}
+
+static int32_t pack32bit_signed_swap(const uint8_t* data) {
+	uint32_t unsigned_value = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | (data[3]);
+	return ((int32_t) unsigned_value);
+}
+
+static int16_t pack16bit_signed_swap(const uint8_t* data) {
 	uint16_t unsigned_value = (data[0] << 8) | (data[1]);
 	return (int16_t) unsigned_value;
 }
 
-static int16_t pack16bit_signed_bizarre(const uint8_t* data) {
-	uint16_t unsigned_value = (data[0]) | ((data[1] ^ 0x80) << 8);
-	return (int16_t) unsigned_value;
+static int16_t pack16bit_signed_bizarre(const uint8_t* data) {
+	uint16_t unsigned_value = (data[0]) | ((data[1] ^ 0x80) << 8);
+	return (int16_t) unsigned_value;
+}
+
+static void readGyroscope_from_packet(const device_imu_packet_type* packet, FusionVector* gyroscope) {
+	int32_t vel_m = pack16bit_signed(packet->angular_multiplier);
+	int32_t vel_d = pack32bit_signed(packet->angular_divisor);
+	
+	int32_t vel_x = pack24bit_signed(packet->angular_velocity_x);
+	int32_t vel_y = pack24bit_signed(packet->angular_velocity_y);
+	int32_t vel_z = pack24bit_signed(packet->angular_velocity_z);
+	
+	gyroscope->axis.x = (float) vel_x * (float) vel_m / (float) vel_d;
+	gyroscope->axis.y = (float) vel_y * (float) vel_m / (float) vel_d;
+	gyroscope->axis.z = (float) vel_z * (float) vel_m / (float) vel_d;
+}
+
+static void readAccelerometer_from_packet(const device_imu_packet_type* packet, FusionVector* accelerometer) {
+	int32_t accel_m = pack16bit_signed(packet->acceleration_multiplier);
+	int32_t accel_d = pack32bit_signed(packet->acceleration_divisor);
+	
+	int32_t accel_x = pack24bit_signed(packet->acceleration_x);
+	int32_t accel_y = pack24bit_signed(packet->acceleration_y);
+	int32_t accel_z = pack24bit_signed(packet->acceleration_z);
+	
+	accelerometer->axis.x = (float) accel_x * (float) accel_m / (float) accel_d;
+	accelerometer->axis.y = (float) accel_y * (float) accel_m / (float) accel_d;
+	accelerometer->axis.z = (float) accel_z * (float) accel_m / (float) accel_d;
+}
+
+static void readMagnetometer_from_packet(const device_imu_packet_type* packet, FusionVector* magnetometer) {
+	int32_t magnet_m = pack16bit_signed_swap(packet->magnetic_multiplier);
+	int32_t magnet_d = pack32bit_signed_swap(packet->magnetic_divisor);
+	
+	int16_t magnet_x = pack16bit_signed_bizarre(packet->magnetic_x);
+	int16_t magnet_y = pack16bit_signed_bizarre(packet->magnetic_y);
+	int16_t magnet_z = pack16bit_signed_bizarre(packet->magnetic_z);
+	
+	magnetometer->axis.x = (float) magnet_x * (float) magnet_m / (float) magnet_d;
+	magnetometer->axis.y = (float) magnet_y * (float) magnet_m / (float) magnet_d;
+	magnetometer->axis.z = (float) magnet_z * (float) magnet_m / (float) magnet_d;
+}
+
+static void readIMU_from_packet(const device_imu_packet_type* packet,
+								FusionVector* gyroscope,
+								FusionVector* accelerometer,
+								FusionVector* magnetometer) {
+	readGyroscope_from_packet(packet, gyroscope);
+	readAccelerometer_from_packet(packet, accelerometer);
+	readMagnetometer_from_packet(packet, magnetometer);
+}
+
+#define min(x, y) ((x) < (y)? (x) : (y))
+#define max(x, y) ((x) > (y)? (x) : (y))
+
+static void pre_biased_coordinate_system(FusionVector* v) {
+	*v = FusionAxesSwap(*v, FusionAxesAlignmentNXNZNY);
+}
+
+static void post_biased_coordinate_system(const FusionVector* v, FusionVector* res) {
+	*res = FusionAxesSwap(*v, FusionAxesAlignmentPZPXPY);
+}
+
+static void iterate_iron_offset_estimation(const FusionVector* magnetometer, FusionMatrix* softIronMatrix, FusionVector* hardIronOffset) {
+	static FusionVector max = { FLT_MIN, FLT_MIN, FLT_MIN };
+	static FusionVector min = { FLT_MAX, FLT_MAX, FLT_MAX };
+
+	for (int i = 0; i < 3; i++) {
+		max.array[i] = max(max.array[i], magnetometer->array[i]);
+		min.array[i] = min(min.array[i], magnetometer->array[i]);
+	}
+	
+	const float mx = (max.axis.x - min.axis.x) / 2.0f;
+	const float my = (max.axis.y - min.axis.y) / 2.0f;
+	const float mz = (max.axis.z - min.axis.z) / 2.0f;
+	
+	const float cx = (min.axis.x + max.axis.x) / 2.0f;
+	const float cy = (min.axis.y + max.axis.y) / 2.0f;
+	const float cz = (min.axis.z + max.axis.z) / 2.0f;
+
+	memset(softIronMatrix, 0, sizeof(*softIronMatrix));
+	
+	softIronMatrix->element.xx = 1.0f / mx;
+	softIronMatrix->element.yy = 1.0f / my;
+	softIronMatrix->element.zz = 1.0f / mz;
+
+	hardIronOffset->axis.x = cx;
+	hardIronOffset->axis.y = cy;
+	hardIronOffset->axis.z = cz;
+}
+
+static FusionVector calibrate_inertial(FusionVector v,
+										const FusionMatrix misalignment,
+										const FusionVector sensitivity,
+										const FusionVector offset) {
+	FusionVector res;
+	
+	pre_biased_coordinate_system(&v);
+	v = FusionCalibrationInertial(v, misalignment, sensitivity, offset);
+	post_biased_coordinate_system(&v, &res);
+	return res;
+}
+
+static void fold_inertial(device_math_affine_type* affine,
+						  const FusionMatrix misalignment,
+						  const FusionVector sensitivity,
+						  const FusionVector offset) {
+	const FusionVector origin = calibrate_inertial(FUSION_VECTOR_ZERO, misalignment, sensitivity, offset);
+	
+	// The calibration is affine, so its linear part gets sampled column by column with the unit vectors
+	for (int j = 0; j < 3; j++) {
+		FusionVector unit = FUSION_VECTOR_ZERO;
+		unit.array[j] = 1.0f;
+		
+		const FusionVector column = FusionVectorSubtract(
+				calibrate_inertial(unit, misalignment, sensitivity, offset),
+				origin
+		);
+		
+		for (int i = 0; i < 3; i++) {
+			affine->columns[j][i] = column.array[i];
+		}
+		
+		affine->columns[j][3] = 0.0f;
+	}
+	
+	for (int i = 0; i < 3; i++) {
+		affine->columns[3][i] = origin.array[i];
+	}
+	
+	affine->columns[3][3] = 0.0f;
+}
+
+static const device_imu_folded_type* update_folded_calibration(device_imu_type* device) {
+	device_imu_folded_type* folded = (device_imu_folded_type*) device->folded;
+	
+	if (!folded) {
+		return NULL;
+	}
+	
+	// Only the reading thread uses the folded calibration, so it gets rebuilt there once a new version got published
+	const uint32_t version = __atomic_load_n(&(device->calibration_version), __ATOMIC_ACQUIRE);
+	
+	if ((folded->valid) && (version == folded->version)) {
+		return folded;
+	}
+	
+	const device_imu_calibration_type* calibration = calibration_acquire(device);
+	
+	if (calibration) {
+		fold_inertial(
+				&(folded->gyroscope),
+				calibration->gyroscopeMisalignment,
+				calibration->gyroscopeSensitivity,
+				FusionVectorMultiplyScalar(calibration->gyroscopeOffset, FusionRadiansToDegrees(1.0f))
+		);
+		
+		fold_inertial(
+				&(folded->accelerometer),
+				calibration->accelerometerMisalignment,
+				calibration->accelerometerSensitivity,
+				FusionVectorMultiplyScalar(calibration->accelerometerOffset, 1.0f / GRAVITY_G)
+		);
+	} else {
+		fold_inertial(&(folded->gyroscope), FUSION_IDENTITY_MATRIX, FUSION_VECTOR_ONES, FUSION_VECTOR_ZERO);
+		fold_inertial(&(folded->accelerometer), FUSION_IDENTITY_MATRIX, FUSION_VECTOR_ONES, FUSION_VECTOR_ZERO);
+	}
+	
+	calibration_release(device);
+	
+	folded->version = version;
+	folded->valid = true;
+	return folded;
+}
+
+static void apply_calibration(device_imu_type* device,
+							  FusionVector* gyroscope,
+							  FusionVector* accelerometer,
+							  FusionVector* magnetometer) {
+	const device_imu_folded_type* folded = update_folded_calibration(device);
+	
+	if (folded) {
+		*gyroscope = device_math_affine_apply(&(folded->gyroscope), *gyroscope);
+		*accelerometer = device_math_affine_apply(&(folded->accelerometer), *accelerometer);
+	}
+	
+	if (!magnetometer) {
+		return;
+	}
+	
+	FusionMatrix magnetometerMisalignment;
+	FusionVector magnetometerSensitivity;
+	FusionVector magnetometerOffset;
+	
+	FusionMatrix softIronMatrix;
+	FusionVector hardIronOffset;
+	
+	const device_imu_calibration_type* calibration = calibration_acquire(device);
+	
+	if (calibration) {
+		magnetometerMisalignment = calibration->magnetometerMisalignment;
+		magnetometerSensitivity = calibration->magnetometerSensitivity;
+		magnetometerOffset = calibration->magnetometerOffset;
+		
+		softIronMatrix = calibration->softIronMatrix;
+		hardIronOffset = calibration->hardIronOffset;
+	} else {
+		magnetometerMisalignment = FUSION_IDENTITY_MATRIX;
+		magnetometerSensitivity = FUSION_VECTOR_ONES;
+		magnetometerOffset = FUSION_VECTOR_ZERO;
+		
+		softIronMatrix = FUSION_IDENTITY_MATRIX;
+		hardIronOffset = FUSION_VECTOR_ZERO;
+	}
+	
+	calibration_release(device);
+	
+	FusionVector m = *magnetometer;
+	
+	pre_biased_coordinate_system(&m);
+	
+	m = FusionCalibrationInertial(
+			m,
+			magnetometerMisalignment,
+			magnetometerSensitivity,
+			magnetometerOffset
+	);
+
+	iterate_iron_offset_estimation(
+		&m, 
+		&softIronMatrix, 
+		&hardIronOffset
+	);
+	
+	device_imu_iron_type* iron = (device_imu_iron_type*) device->iron;
+	
+	if (iron) {
+		iron->softIronMatrix = softIronMatrix;
+		iron->hardIronOffset = hardIronOffset;
+		iron->estimated = true;
+	}
+	
+	m = FusionCalibrationMagnetic(
+			m,
+			softIronMatrix,
+			hardIronOffset
+	);
+	
+	post_biased_coordinate_system(&m, magnetometer);
+}
+
+static uint64_t update_clock(device_imu_type* device, uint64_t timestamp, uint64_t now) {
+	const int64_t offset = (int64_t) (now - timestamp);
+	
+	// The lowest offset belongs to the report delivered fastest, a slow leak upwards follows clock drift
+	if ((!device->stats.reports) || (offset < device->clock_offset)) {
+		device->clock_offset = offset;
+	} else {
+		device->clock_offset += (offset - device->clock_offset) / 4096;
+	}
+	
+	const uint64_t age = (uint64_t) (offset - device->clock_offset);
+	
+	device->stats.reports++;
+	device->stats.age = age;
+	
+	if (age > device->stats.age_max) {
+		device->stats.age_max = age;
+	}
+	
+	return age;
+}
+
+static void apply_gyroscope_calibration(device_imu_type* device, FusionVector* gyroscope) {
+	const device_imu_folded_type* folded = update_folded_calibration(device);
+	
+	if (folded) {
+		*gyroscope = device_math_affine_apply(&(folded->gyroscope), *gyroscope);
+	}
+}
+
+static void update_fixed_calibration(device_imu_type* device, device_imu_fixed_type* fixed) {
+	const device_imu_folded_type* folded = update_folded_calibration(device);
+	
+	if ((!folded) || (folded->version == fixed->calibration_version)) {
+		return;
+	}
+	
+	float gyroscope_matrix [9];
+	float gyroscope_offset [3];
+	float accelerometer_matrix [9];
+	float accelerometer_offset [3];
+	
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			gyroscope_matrix[i * 3 + j] = folded->gyroscope.columns[j][i];
+			accelerometer_matrix[i * 3 + j] = folded->accelerometer.columns[j][i];
+		}
+		
+		gyroscope_offset[i] = -folded->gyroscope.columns[3][i];
+		accelerometer_offset[i] = -folded->accelerometer.columns[3][i];
+	}
+	
+	device_imu_fixed_set_calibration(
+			fixed,
+			gyroscope_matrix,
+			gyroscope_offset,
+			accelerometer_matrix,
+			accelerometer_offset,
+			folded->version
+	);
+}
+
+static void sample_fixed_vector(device_imu_vec3_type* vector, const device_imu_fixed_vec3_type* fixed) {
+	vector->x = device_imu_fixed_to_float(fixed->x, DEVICE_IMU_FIXED_SENSOR);
+	vector->y = device_imu_fixed_to_float(fixed->y, DEVICE_IMU_FIXED_SENSOR);
+	vector->z = device_imu_fixed_to_float(fixed->z, DEVICE_IMU_FIXED_SENSOR);
+}
+
+static void sample_fixed_missing(device_imu_vec3_type* vector) {
+	vector->x = NAN;
+	vector->y = NAN;
+	vector->z = NAN;
+}
+
+static device_imu_fixed_vec3_type fixed_sample_vector(const device_imu_vec3_type* vector) {
+	device_imu_fixed_vec3_type fixed;
+	fixed.x = device_imu_fixed_from_float(vector->x, DEVICE_IMU_FIXED_SENSOR);
+	fixed.y = device_imu_fixed_from_float(vector->y, DEVICE_IMU_FIXED_SENSOR);
+	fixed.z = device_imu_fixed_from_float(vector->z, DEVICE_IMU_FIXED_SENSOR);
+	return fixed;
+}
+
+static void catchup_fixed(device_imu_type* device, const device_imu_packet_type* packet, uint64_t delta) {
+	device_imu_fixed_type* fixed = (device_imu_fixed_type*) device->fixed;
+	
+	device_imu_fixed_vec3_type gyroscope;
+	device_imu_fixed_vec3_type accelerometer;
+	
+	device_imu_fixed_decode(packet, &gyroscope, &accelerometer);
+	update_fixed_calibration(device, fixed);
+	device_imu_fixed_calibrate(fixed, &gyroscope, &accelerometer);
+	device_imu_fixed_offset(fixed, &gyroscope);
+	device_imu_fixed_integrate(fixed, &gyroscope, delta);
+}
+
+// Only the state read back by the getters gets converted, the filter itself stays in integers (the private fields
+// of Fusion v1.2, same as for write_fusion_state())
+static void store_fixed_state(FusionAhrs* ahrs, const device_imu_fixed_type* fixed) {
+	ahrs->quaternion.element.w = device_imu_fixed_to_float(fixed->orientation.w, DEVICE_IMU_FIXED_UNIT);
+	ahrs->quaternion.element.x = device_imu_fixed_to_float(fixed->orientation.x, DEVICE_IMU_FIXED_UNIT);
+	ahrs->quaternion.element.y = device_imu_fixed_to_float(fixed->orientation.y, DEVICE_IMU_FIXED_UNIT);
+	ahrs->quaternion.element.z = device_imu_fixed_to_float(fixed->orientation.z, DEVICE_IMU_FIXED_UNIT);
+	
+	ahrs->initialising = fixed->initialising;
+	ahrs->accelerometerIgnored = fixed->accelerometer_ignored;
+	
+	// Enough of the rejection state for the internal states and flags read back from the AHRS
+	ahrs->halfAccelerometerFeedback.axis.x = device_imu_fixed_to_float(fixed->feedback.x, DEVICE_IMU_FIXED_UNIT);
+	ahrs->halfAccelerometerFeedback.axis.y = device_imu_fixed_to_float(fixed->feedback.y, DEVICE_IMU_FIXED_UNIT);
+	ahrs->halfAccelerometerFeedback.axis.z = device_imu_fixed_to_float(fixed->feedback.z, DEVICE_IMU_FIXED_UNIT);
+	ahrs->accelerationRecoveryTrigger = (int) fixed->recovery_trigger;
+	ahrs->accelerationRecoveryTimeout = (int) fixed->recovery_timeout;
+	ahrs->magnetometerIgnored = true;
+}
+
+// Fusion has no setters for the gain ramp, the acceleration rejection or the gyroscope offset, so this is the only
+// place writing those private fields. They match Fusion v1.2 (FusionAhrs.c, FusionOffset.c), a submodule update has
+// to be checked against them (the reason the adaptive startup is opt-in).
+static void write_fusion_state(device_imu_type* device, uint32_t writes, const FusionVector* offset) {
+	FusionAhrs* ahrs = (FusionAhrs*) device->ahrs;
+	device_imu_fixed_type* fixed = (device_imu_fixed_type*) device->fixed;
+	
+	if ((ahrs) && (writes & (FUSION_WRITE_STILL_GAIN | FUSION_WRITE_MOVING_GAIN | FUSION_WRITE_INITIALISED))) {
+		const bool initialising = !(writes & FUSION_WRITE_INITIALISED);
+		const float gain = (writes & FUSION_WRITE_STILL_GAIN? STARTUP_GAIN : ahrs->settings.gain);
+		
+		ahrs->rampedGain = gain;
+		ahrs->rampedGainStep = 0.0f;
+		ahrs->initialising = initialising;
+		
+		if (fixed) {
+			fixed->ramped_gain = (initialising? device_imu_fixed_from_float(gain, DEVICE_IMU_FIXED_SENSOR) : fixed->gain);
+			fixed->ramped_gain_step = 0;
+			fixed->initialising = initialising;
+		}
+	}
+	
+	// Same as the reset of FusionAhrsReset() limited to the accelerometer
+	if ((ahrs) && (writes & FUSION_WRITE_ACCELERATION_RESET)) {
+		ahrs->halfAccelerometerFeedback = FUSION_VECTOR_ZERO;
+		ahrs->accelerometerIgnored = false;
+		ahrs->accelerationRecoveryTrigger = 0;
+		ahrs->accelerationRecoveryTimeout = (int) ahrs->settings.recoveryTriggerPeriod;
+		
+		if (fixed) {
+			memset(&(fixed->feedback), 0, sizeof(fixed->feedback));
+			fixed->accelerometer_ignored = false;
+			fixed->recovery_trigger = 0;
+			fixed->recovery_timeout = fixed->recovery_period;
+		}
+	}
+	
+	// Skips the timeout, so the offset keeps following the drift right away
+	if ((offset) && (writes & FUSION_WRITE_OFFSET)) {
+		if (fixed) {
+			const int64_t scale = (int64_t) 1 << (32 - DEVICE_IMU_FIXED_SENSOR);
+			
+			fixed->offset[0] = (int64_t) device_imu_fixed_from_float(offset->axis.x, DEVICE_IMU_FIXED_SENSOR) * scale;
+			fixed->offset[1] = (int64_t) device_imu_fixed_from_float(offset->axis.y, DEVICE_IMU_FIXED_SENSOR) * scale;
+			fixed->offset[2] = (int64_t) device_imu_fixed_from_float(offset->axis.z, DEVICE_IMU_FIXED_SENSOR) * scale;
+			fixed->offset_timer = fixed->offset_timeout;
+		} else if (device->offset) {
+			FusionOffset* fusion_offset = (FusionOffset*) device->offset;
+			
+			fusion_offset->gyroscopeOffset = *offset;
+			fusion_offset->timer = fusion_offset->timeout;
+		}
+	}
+}
+
+static bool finish_catchup(device_imu_type* device, uint64_t now) {
+	if (!device->catchup_start) {
+		return false;
+	}
+	
+	if ((device->ahrs) && (device->fixed)) {
+		// The fixed-point filter integrated each report already, so only its state is left to read back
+		store_fixed_state((FusionAhrs*) device->ahrs, (const device_imu_fixed_type*) device->fixed);
+	} else if ((device->ahrs) && (device->catchup_delta > 0)) {
+		// A single update over the whole backlog with the mean rate applies the rotation, the zero vector skips the accelerometer
+		const float deltaTime = (float) ((double) device->catchup_delta / 1e9);
+		
+		FusionVector rotation;
+		rotation.axis.x = device->catchup_rotation.x;
+		rotation.axis.y = device->catchup_rotation.y;
+		rotation.axis.z = device->catchup_rotation.z;
+		
+		FusionAhrsUpdateNoMagnetometer(
+				(FusionAhrs*) device->ahrs,
+				FusionVectorMultiplyScalar(rotation, 1.0f / deltaTime),
+				FUSION_VECTOR_ZERO,
+				deltaTime
+		);
+	}
+	
+	if (device->catchup_stalled) {
+		write_fusion_state(device, FUSION_WRITE_ACCELERATION_RESET, NULL);
+		device->catchup_stalled = false;
+	}
+	
+	const uint64_t recovery = now - device->catchup_start;
+	
+	device->stats.recovery = recovery;
+	
+	if (recovery > device->stats.recovery_max) {
+		device->stats.recovery_max = recovery;
+	}
+	
+	device->catchup_start = 0;
+	device->catchup_delta = 0;
+	memset(&(device->catchup_rotation), 0, sizeof(device->catchup_rotation));
+	return true;
+}
+
+device_imu_error_type device_imu_clear(device_imu_type* device) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+
+	if (!device->handle) {
+		device_imu_error("No handle");
+		return DEVICE_IMU_ERROR_NO_HANDLE;
+	}
+	
+	if (sizeof(device_imu_packet_type) > device->max_payload_size) {
+		device_imu_error("Not proper size");
+		return DEVICE_IMU_ERROR_WRONG_SIZE;
+	}
+	
+	// Without any report seen before, the age of reports isn't known yet and only an empty queue counts as current
+	const bool synced = (device->stats.reports > 0);
+	const uint64_t freshness = device->options.freshness * DEVICE_TIME_MS;
+	
+	union {
+		device_imu_packet_type packet;
+		device_imu_payload_packet_type payload;
+	} report;
+	
+	int report_size = sizeof(device_imu_packet_type);
+	
+	if (device->download) {
+		report_size = (device->max_payload_size < sizeof(report)? device->max_payload_size : sizeof(report));
+	}
+	
+	uint32_t discarded = 0;
+	
+	while (discarded < DEVICE_IMU_FLUSH_LIMIT) {
+		const int transferred = hid_read_timeout(
+			device->handle, 
+			(uint8_t*) &report, 
+			report_size,
+			0
+		);
+		
+		if (transferred == -1) {
+			device_imu_error("Device may be unplugged");
+			return DEVICE_IMU_ERROR_UNPLUGGED;
+		}
+		
+		if (transferred == 0) {
+			break;
+		}
+		
+		// Replies to a deferred calibration download aren't stale, so they still need to be handled
+		if ((device->download) && (download_reply(device, &(report.payload), transferred, device_time_now()))) {
+			continue;
+		}
+		
+		if ((transferred < (int) sizeof(device_imu_packet_type)) ||
+			(report.packet.signature[0] != 0x01) || (report.packet.signature[1] != 0x02)) {
+			continue;
+		}
+		
+		const uint64_t timestamp = le64toh(report.packet.timestamp);
+		const uint64_t age = update_clock(device, timestamp, device_time_now());
+		
+		// Keeps the time step of the next delivered report at a single sample period
+		device->last_timestamp = timestamp;
+		discarded++;
+		
+		if ((synced) && (age <= freshness)) {
+			break;
+		}
+	}
+	
+	device->stats.discarded += discarded;
+	device->stats.flushes++;
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+void device_imu_get_stats(const device_imu_type* device, device_imu_stats_type* stats) {
+	if ((!device) || (!stats)) {
+		return;
+	}
+	
+	*stats = device->stats;
+}
+
+device_imu_error_type device_imu_calibrate(device_imu_type* device, uint32_t iterations, bool gyro, bool accel, bool magnet) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+
+	if (!device->handle) {
+		device_imu_error("No handle");
+		return DEVICE_IMU_ERROR_NO_HANDLE;
+	}
+
+	if (!device->calibration) {
+		device_imu_error("No calibration allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	if (sizeof(device_imu_packet_type) > device->max_payload_size) {
+		device_imu_error("Not proper size");
+		return DEVICE_IMU_ERROR_WRONG_SIZE;
+	}
+	
+	union {
+		device_imu_packet_type packet;
+		device_imu_payload_packet_type payload;
+	} report;
+	
+	int report_size = sizeof(device_imu_packet_type);
+	
+	// Replies to a deferred calibration download can be larger than sensor reports
+	if (device->download) {
+		report_size = (device->max_payload_size < sizeof(report)? device->max_payload_size : sizeof(report));
+	}
+	
+	device_imu_packet_type packet;
+	int transferred;
+	
+	bool initialized = false;
+	
+	FusionVector cal_gyroscope;
+	FusionVector cal_accelerometer;
+
+	FusionMatrix softIronMatrix;
+	FusionVector hardIronOffset;
+	
+	const float factor = iterations > 0? 1.0f / ((float) iterations) : 0.0f;
+
+	FusionVector prev_accel;
+	while (iterations > 0) {
+		if (device->download) {
+			download_progress(device, device_time_now());
+		}
+		
+		memset(&report, 0, report_size);
+		
+		transferred = hid_read_timeout(
+			device->handle, 
+			(uint8_t*) &report, 
+			report_size,
+			device->download? (int) device->options.handshake_timeout : -1
+		);
+
+		if (transferred == -1) {
+			device_imu_error("Device may be unplugged");
+			return DEVICE_IMU_ERROR_UNPLUGGED;
+		}
+
+		if (transferred == 0) {
+			continue;
+		}
+		
+		// Replies to a deferred calibration download must not get lost in between
+		if ((device->download) && (download_reply(device, &(report.payload), transferred, device_time_now()))) {
+			continue;
+		}
+		
+		if (transferred > (int) sizeof(device_imu_packet_type)) {
+			transferred = sizeof(device_imu_packet_type);
+		}
+
+		if ((int) sizeof(device_imu_packet_type) != transferred) {
+			device_imu_error("Unexpected packet size");
+			return DEVICE_IMU_ERROR_UNEXPECTED;
+		}
+		
+		packet = report.packet;
+		
+		if ((packet.signature[0] != 0x01) || (packet.signature[1] != 0x02)) {
+			continue;
+		}
+		
+		FusionVector gyroscope;
+		FusionVector accelerometer;
+		FusionVector magnetometer;
+		
+		readIMU_from_packet(&packet, &gyroscope, &accelerometer, &magnetometer);
+		
+		pre_biased_coordinate_system(&gyroscope);
+		pre_biased_coordinate_system(&accelerometer);
+		pre_biased_coordinate_system(&magnetometer);
+
+		if (initialized) {
+			cal_gyroscope = FusionVectorAdd(cal_gyroscope, gyroscope);
+			cal_accelerometer = FusionVectorAdd(cal_accelerometer, FusionVectorSubtract(accelerometer, prev_accel));
+		} else {
+			cal_gyroscope = gyroscope;
+			cal_accelerometer = FUSION_VECTOR_ZERO;
+		}
+
+		prev_accel = accelerometer;
+
+		iterate_iron_offset_estimation(
+			&magnetometer, 
+			&softIronMatrix, 
+			&hardIronOffset
+		);
+		
+		iterations--;
+	}
+	
+	if (factor > 0.0f) {
+		device_imu_calibration_type* calibration = calibration_copy(device);
+		
+		if (!calibration) {
+			return DEVICE_IMU_ERROR_NO_ALLOCATION;
+		}
+		
+		device_imu_download_type* download = (device_imu_download_type*) device->download;
+		
+		// A factory calibration still being downloaded needs to keep these offsets once it gets swapped in
+		if ((download) && (download->phase == DOWNLOAD_SWAPPED)) {
+			download = NULL;
+		}
+		
+		if (gyro) {
+			const FusionVector offset = FusionVectorMultiplyScalar(
+					cal_gyroscope,
+					FusionDegreesToRadians(factor)
+			);
+			
+			calibration->gyroscopeOffset = FusionVectorAdd(calibration->gyroscopeOffset, offset);
+			
+			if (download) {
+				download->gyroscope_offset = FusionVectorAdd(download->gyroscope_offset, offset);
+			}
+		}
+		
+		if (accel) {
+			const FusionVector offset = FusionVectorMultiplyScalar(
+					cal_accelerometer,
+					factor * GRAVITY_G
+			);
+			
+			calibration->accelerometerOffset = FusionVectorAdd(calibration->accelerometerOffset, offset);
+			
+			if (download) {
+				download->accelerometer_offset = FusionVectorAdd(download->accelerometer_offset, offset);
+			}
+		}
+		
+		if (magnet) {
+			calibration->softIronMatrix = softIronMatrix;
+			calibration->hardIronOffset = hardIronOffset;
+		}
+		
+		calibration_publish(device, calibration);
+	}
+	
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+static device_imu_vec3_type convert_vector(const device_imu_frame_type* frame, const device_imu_vec3_type* vector, bool axial) {
+	const float in [3] = { vector->x, vector->y, vector->z };
+	const float scale = (axial? frame->handedness : 1.0f);
+	
+	device_imu_vec3_type res;
+	res.x = scale * frame->sign[0] * in[frame->axis[0]];
+	res.y = scale * frame->sign[1] * in[frame->axis[1]];
+	res.z = scale * frame->sign[2] * in[frame->axis[2]];
+	return res;
+}
+
+static device_imu_vec3_type revert_vector(const device_imu_type* device, const device_imu_vec3_type* vector, bool axial) {
+	const device_imu_frame_type* frame = &(frames[device->options.convention]);
+	const float in [3] = { vector->x, vector->y, vector->z };
+	const float scale = (axial? frame->handedness : 1.0f);
+	
+	float out [3];
+	
+	for (int i = 0; i < 3; i++) {
+		out[frame->axis[i]] = scale * frame->sign[i] * in[i];
+	}
+	
+	device_imu_vec3_type res;
+	res.x = out[0];
+	res.y = out[1];
+	res.z = out[2];
+	return res;
+}
+
+static device_imu_quat_type convert_orientation(const device_imu_frame_type* frame, const device_imu_quat_type* quat) {
+	const device_imu_vec3_type axis = { quat->x, quat->y, quat->z };
+	const device_imu_vec3_type converted = convert_vector(frame, &axis, true);
+	
+	device_imu_quat_type res;
+	res.x = converted.x;
+	res.y = converted.y;
+	res.z = converted.z;
+	res.w = quat->w;
+	return res;
+}
+
+// The gyroscope measures rotation, so it follows the handedness like the axis of the orientation
+static void convert_sample(const device_imu_type* device, device_imu_sample_type* sample) {
+	if (device->options.convention == DEVICE_IMU_CONVENTION_NED) {
+		return;
+	}
+	
+	const device_imu_frame_type* frame = &(frames[device->options.convention]);
+	
+	sample->gyroscope = convert_vector(frame, &(sample->gyroscope), true);
+	sample->accelerometer = convert_vector(frame, &(sample->accelerometer), false);
+	sample->magnetometer = convert_vector(frame, &(sample->magnetometer), false);
+}
+
+static void apply_filter(device_imu_type* device, FusionVector* gyroscope, FusionVector* accelerometer, bool caught_up) {
+	device_imu_filter_type* filter = (device_imu_filter_type*) device->filter;
+	
+	// The state from before a catch-up doesn't belong to the current motion anymore
+	if (caught_up) {
+		device_math_biquad_reset(&(filter->gyroscope));
+		device_math_biquad_reset(&(filter->accelerometer));
+	}
+	
+	if (filter->gyroscope_enabled) {
+		*gyroscope = device_math_biquad_apply(&(filter->gyroscope), *gyroscope);
+	}
+	
+	if (filter->accelerometer_enabled) {
+		*accelerometer = device_math_biquad_apply(&(filter->accelerometer), *accelerometer);
+	}
+}
+
+// Replaces the fixed gain ramp: full gain while still, the normal gain under motion, done once level and seeded
+static void observe_startup(device_imu_type* device, const FusionVector* gyroscope, const FusionVector* accelerometer, float deltaTime) {
+	device_imu_startup_type* startup = (device_imu_startup_type*) device->startup;
+	
+	const uint32_t version = __atomic_load_n(&(device->calibration_version), __ATOMIC_ACQUIRE);
+	
+	// A swapped in calibration invalidates the gyroscope mean collected so far
+	if ((!startup->primed) || (startup->calibration_version != version)) {
+		startup->calibration_version = version;
+		startup->gyroscope = *gyroscope;
+		startup->accelerometer = *accelerometer;
+		startup->gyroscope_variance = 0.0f;
+		startup->accelerometer_variance = 0.0f;
+		startup->still = 0;
+		startup->converged = 0;
+		startup->seeded = false;
+		startup->primed = true;
+	}
+	
+	startup->elapsed += deltaTime;
+	
+	const FusionVector gyroscope_deviation = FusionVectorSubtract(*gyroscope, startup->gyroscope);
+	const FusionVector accelerometer_deviation = FusionVectorSubtract(*accelerometer, startup->accelerometer);
+	
+	startup->gyroscope = FusionVectorAdd(startup->gyroscope, FusionVectorMultiplyScalar(gyroscope_deviation, STARTUP_SMOOTHING));
+	startup->accelerometer = FusionVectorAdd(startup->accelerometer, FusionVectorMultiplyScalar(accelerometer_deviation, STARTUP_SMOOTHING));
+	
+	const float gyroscope_magnitude = FusionVectorMagnitude(gyroscope_deviation);
+	const float accelerometer_magnitude = FusionVectorMagnitude(accelerometer_deviation);
+	
+	startup->gyroscope_variance += STARTUP_SMOOTHING * (gyroscope_magnitude * gyroscope_magnitude - startup->gyroscope_variance);
+	startup->accelerometer_variance += STARTUP_SMOOTHING * (accelerometer_magnitude * accelerometer_magnitude - startup->accelerometer_variance);
+	
+	const bool still = (
+			(startup->gyroscope_variance < STARTUP_GYROSCOPE_NOISE * STARTUP_GYROSCOPE_NOISE) &&
+			(startup->accelerometer_variance < STARTUP_ACCELEROMETER_NOISE * STARTUP_ACCELEROMETER_NOISE) &&
+			(fabsf(startup->gyroscope.axis.x) < STARTUP_GYROSCOPE_LIMIT) &&
+			(fabsf(startup->gyroscope.axis.y) < STARTUP_GYROSCOPE_LIMIT) &&
+			(fabsf(startup->gyroscope.axis.z) < STARTUP_GYROSCOPE_LIMIT)
+	);
+	
+	if (still) {
+		startup->sum = (startup->still > 0? FusionVectorAdd(startup->sum, *gyroscope) : *gyroscope);
+		startup->still++;
+	} else {
+		startup->still = 0;
+		startup->converged = 0;
+	}
+	
+	if ((!startup->seeded) && (startup->still >= STARTUP_SEED_SAMPLES)) {
+		const FusionVector offset = FusionVectorMultiplyScalar(startup->sum, 1.0f / (float) startup->still);
+		
+		write_fusion_state(device, FUSION_WRITE_OFFSET, &offset);
+		startup->seeded = true;
+	}
+	
+	// Motion during startup would tilt the orientation with a high gain, while rejection is still off
+	write_fusion_state(device, still? FUSION_WRITE_STILL_GAIN : FUSION_WRITE_MOVING_GAIN, NULL);
+}
+
+static void check_startup(device_imu_type* device, uint64_t now) {
+	device_imu_startup_type* startup = (device_imu_startup_type*) device->startup;
+	const FusionQuaternion q = ((const FusionAhrs*) device->ahrs)->quaternion;
+	
+	// Half of the gravity direction in the sensor frame for NED (same as FusionAhrs)
+	const FusionVector gravity = {
+			.axis.x = q.element.w * q.element.y - q.element.x * q.element.z,
+			.axis.y = -(q.element.y * q.element.z + q.element.w * q.element.x),
+			.axis.z = 0.5f - q.element.w * q.element.w - q.element.z * q.element.z,
+	};
+	
+	const FusionVector a = startup->accelerometer;
+	const float dot = a.axis.x * gravity.axis.x + a.axis.y * gravity.axis.y + a.axis.z * gravity.axis.z;
+	const float magnitude = FusionVectorMagnitude(a) * FusionVectorMagnitude(gravity);
+	const float cosine = (magnitude > 0.0f? dot / magnitude : -1.0f);
+	const float error = FusionRadiansToDegrees(acosf(cosine < 1.0f? cosine : 1.0f));
+	
+	if ((startup->still > 0) && (error < STARTUP_ERROR)) {
+		startup->converged++;
+	} else {
+		startup->converged = 0;
+	}
+	
+	const bool converged = ((startup->seeded) && (startup->converged >= STARTUP_CONVERGED_SAMPLES));
+	
+	// Without any stillness the normal gain takes over after the same time as the fixed ramp would
+	if ((!converged) && (startup->elapsed < STARTUP_TIMEOUT)) {
+		return;
+	}
+	
+	if (converged) {
+		device->stable_duration = now - device->open_timestamp;
+	}
+	
+	write_fusion_state(device, FUSION_WRITE_INITIALISED, NULL);
+	
+	free(device->startup);
+	device->startup = NULL;
+}
+
+static void begin_sample(const device_imu_type* device,
+						 device_imu_sample_type* sample,
+						 uint64_t timestamp,
+						 uint64_t now,
+						 float deltaTime) {
+	sample->sequence = device->stats.reports;
+	sample->timestamp = timestamp;
+	sample->host_timestamp = now;
+	sample->delta_time = deltaTime;
+	sample->temperature = device->temperature;
+}
+
+static void measure_swap(device_imu_type* device, const FusionQuaternion* previous, const device_imu_quat_type* orientation) {
+	// Measures how far the first update with the swapped in calibration moved the orientation
+	if ((device->download) && (((device_imu_download_type*) device->download)->phase == DOWNLOAD_SWAPPED)) {
+		const float dot = fabsf(
+				previous->element.w * orientation->w +
+				previous->element.x * orientation->x +
+				previous->element.y * orientation->y +
+				previous->element.z * orientation->z
+		);
+		
+		device->stats.swap_discontinuity = FusionRadiansToDegrees(2.0f * acosf(dot < 1.0f? dot : 1.0f));
+		download_free(device);
+	}
+}
+
+static void finish_update(device_imu_type* device,
+						  uint64_t timestamp,
+						  uint64_t now,
+						  device_imu_sample_type* sample,
+						  bool caught_up,
+						  bool dropped) {
+	if (!device->first_pose_duration) {
+		device->first_pose_duration = now - device->open_timestamp;
+	}
+	
+	FusionAhrsInternalStates states;
+	memset(&states, 0, sizeof(states));
+	
+	if (device->ahrs) {
+		update_fusion_stats(device, &states);
+	}
+	
+	device_imu_callback(device, timestamp, DEVICE_IMU_EVENT_UPDATE);
+	
+	if (sample) {
+		sample->orientation = device_imu_get_orientation(device->ahrs);
+		
+		if (device->options.convention != DEVICE_IMU_CONVENTION_NED) {
+			sample->orientation = convert_orientation(&(frames[device->options.convention]), &(sample->orientation));
+		}
+		sample->flags = device->fusion_flags | (caught_up? DEVICE_IMU_SAMPLE_FLAG_CAUGHT_UP : 0) | (dropped? DEVICE_IMU_SAMPLE_FLAG_DROPPED : 0);
+		sample->acceleration_error = states.accelerationError;
+		sample->acceleration_recovery = states.accelerationRecoveryTrigger;
+		sample->magnetic_error = states.magneticError;
+		sample->magnetic_recovery = states.magneticRecoveryTrigger;
+		
+		if ((run_stages(device, DEVICE_IMU_STAGE_POST_FUSION, sample)) && (!dropped) && (device->sample_callback)) {
+			device->sample_callback(sample, device->userdata);
+		}
+	}
+}
+
+static device_imu_error_type read_fixed(device_imu_type* device,
+										const device_imu_packet_type* packet,
+										uint64_t timestamp,
+										uint64_t now,
+										uint64_t delta,
+										device_imu_sample_type* sample,
+										bool caught_up) {
+	device_imu_fixed_type* fixed = (device_imu_fixed_type*) device->fixed;
+	
+	device_imu_fixed_vec3_type gyroscope;
+	device_imu_fixed_vec3_type accelerometer;
+	
+	device_imu_fixed_decode(packet, &gyroscope, &accelerometer);
+	
+	// The magnetometer isn't part of the fixed-point path, so it's always marked as missing
+	if (sample) {
+		begin_sample(device, sample, timestamp, now, (float) ((double) delta / 1e9));
+		
+		sample_fixed_vector(&(sample->raw_gyroscope), &gyroscope);
+		sample_fixed_vector(&(sample->raw_accelerometer), &accelerometer);
+		sample_fixed_missing(&(sample->raw_magnetometer));
+	}
+	
+	update_fixed_calibration(device, fixed);
+	device_imu_fixed_calibrate(fixed, &gyroscope, &accelerometer);
+	
+	if (device->startup) {
+		const FusionVector g = {
+				.axis.x = device_imu_fixed_to_float(gyroscope.x, DEVICE_IMU_FIXED_SENSOR),
+				.axis.y = device_imu_fixed_to_float(gyroscope.y, DEVICE_IMU_FIXED_SENSOR),
+				.axis.z = device_imu_fixed_to_float(gyroscope.z, DEVICE_IMU_FIXED_SENSOR),
+		};
+		
+		const FusionVector a = {
+				.axis.x = device_imu_fixed_to_float(accelerometer.x, DEVICE_IMU_FIXED_SENSOR),
+				.axis.y = device_imu_fixed_to_float(accelerometer.y, DEVICE_IMU_FIXED_SENSOR),
+				.axis.z = device_imu_fixed_to_float(accelerometer.z, DEVICE_IMU_FIXED_SENSOR),
+		};
+		
+		observe_startup(device, &g, &a, (float) ((double) delta / 1e9));
+	}
+	
+	device_imu_fixed_offset(fixed, &gyroscope);
+	
+	bool dropped = false;
+	
+	if (sample) {
+		sample_fixed_vector(&(sample->gyroscope), &gyroscope);
+		sample_fixed_vector(&(sample->accelerometer), &accelerometer);
+		sample_fixed_missing(&(sample->magnetometer));
+		convert_sample(device, sample);
+		
+		// A dropped sample still gets integrated, otherwise its rotation would be lost
+		dropped = !run_pre_fusion_stages(device, sample);
+		
+		if ((!dropped) && (stage_count(device, DEVICE_IMU_STAGE_PRE_FUSION) > 0)) {
+			const device_imu_vec3_type g = revert_vector(device, &(sample->gyroscope), true);
+			const device_imu_vec3_type a = revert_vector(device, &(sample->accelerometer), false);
+			
+			gyroscope = fixed_sample_vector(&g);
+			accelerometer = fixed_sample_vector(&a);
+		}
+	}
+	
+	FusionAhrs* ahrs = (FusionAhrs*) device->ahrs;
+	const FusionQuaternion previous = ahrs->quaternion;
+	
+	device_imu_fixed_update(fixed, &gyroscope, &accelerometer, delta);
+	
+	store_fixed_state(ahrs, fixed);
+	
+	ahrs->accelerometer.axis.x = device_imu_fixed_to_float(accelerometer.x, DEVICE_IMU_FIXED_SENSOR);
+	ahrs->accelerometer.axis.y = device_imu_fixed_to_float(accelerometer.y, DEVICE_IMU_FIXED_SENSOR);
+	ahrs->accelerometer.axis.z = device_imu_fixed_to_float(accelerometer.z, DEVICE_IMU_FIXED_SENSOR);
+	
+	if (device->startup) {
+		check_startup(device, now);
+	}
+	
+	if (device->download) {
+		const device_imu_quat_type orientation = device_imu_get_orientation(device->ahrs);
+		
+		measure_swap(device, &previous, &orientation);
+	}
+	
+	finish_update(device, timestamp, now, sample, caught_up, dropped);
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+device_imu_error_type device_imu_read(device_imu_type* device, int timeout) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+
+	if (!device->handle) {
+		device_imu_error("No handle");
+		return DEVICE_IMU_ERROR_NO_HANDLE;
+	}
+	
+	if (sizeof(device_imu_packet_type) > device->max_payload_size) {
+		device_imu_error("Not proper size");
+		return DEVICE_IMU_ERROR_WRONG_SIZE;
+	}
+	
+	if (device->download) {
+		download_progress(device, device_time_now());
+	}
+	
+	union {
+		device_imu_packet_type packet;
+		device_imu_payload_packet_type payload;
+	} report;
+	
+	int report_size = sizeof(device_imu_packet_type);
+	
+	// Replies to the deferred calibration download can be larger than sensor reports
+	if (device->download) {
+		report_size = (device->max_payload_size < sizeof(report)? device->max_payload_size : sizeof(report));
+	}
+	
+	memset(&report, 0, report_size);
+	
+	int transferred = hid_read_timeout(
+		device->handle, 
+		(uint8_t*) &report, 
+		report_size,
+		timeout
+	);
+
+	if (transferred == -1) {
+		device_imu_error("Device may be unplugged");
+		return DEVICE_IMU_ERROR_UNPLUGGED;
+	}
+	
+	if (transferred == 0) {
+		return DEVICE_IMU_ERROR_NO_ERROR;
+	}
+	
+	if ((device->download) && (download_reply(device, &(report.payload), transferred, device_time_now()))) {
+		return DEVICE_IMU_ERROR_NO_ERROR;
+	}
+	
+	const device_imu_packet_type packet = report.packet;
+	
+	if (transferred > (int) sizeof(device_imu_packet_type)) {
+		transferred = sizeof(device_imu_packet_type);
+	}
+	
+	if ((int) sizeof(device_imu_packet_type) != transferred) {
+		device_imu_error("Unexpected packet size");
+		return DEVICE_IMU_ERROR_UNEXPECTED;
+	}
+	
+	const uint64_t timestamp = le64toh(packet.timestamp);
+	
+	if ((packet.signature[0] == 0xaa) && (packet.signature[1] == 0x53)) {
+		device_imu_callback(device, timestamp, DEVICE_IMU_EVENT_INIT);
+		return DEVICE_IMU_ERROR_NO_ERROR;
+	}
+	
+	// A command resent during open gets answered twice, the late reply may only arrive once the stream runs
+	if (packet.signature[0] == 0xaa) {
+		device->stats.stray_replies++;
+		return DEVICE_IMU_ERROR_NO_ERROR;
+	}
+	
+	if ((packet.signature[0] != 0x01) || (packet.signature[1] != 0x02)) {
+		device_imu_error("Not matching signature");
+		return DEVICE_IMU_ERROR_WRONG_SIGNATURE;
+	}
+	
+	const uint64_t now = device_time_now();
+	const uint64_t age = update_clock(device, timestamp, now);
+	
+	const bool stalled = ((device->options.stall_threshold) && (age > device->options.stall_threshold * DEVICE_TIME_MS));
+	
+	const uint64_t delta = (device->last_timestamp? timestamp - device->last_timestamp : 0);
+	const float deltaTime = (float) ((double) delta / 1e9);
+	
+	device->last_timestamp = timestamp;
+	
+	int16_t temperature = pack16bit_signed(packet.temperature);
+	
+	// According to the ICM-42688-P datasheet: (offset: 25 °C, sensitivity: 132.48 LSB/°C)
+	device->temperature = ((float) temperature) / 132.48f + 25.0f;
+	
+	// Once behind, only the gyroscope gets integrated without callbacks until reports are current again
+	const bool behind = (device->catchup_start?
+			age > device->options.freshness * DEVICE_TIME_MS :
+			((device->options.catchup_threshold) && (age > device->options.catchup_threshold * DEVICE_TIME_MS)) || (stalled)
+	);
+	
+	// A stall keeps the rotation as well, only the accelerometer state gets too old to continue from
+	if ((stalled) && (device->ahrs) && (!device->catchup_stalled)) {
+		device->catchup_stalled = true;
+		device->stats.stalls++;
+	}
+	
+	if ((device->ahrs) && (behind)) {
+		if (!device->catchup_start) {
+			device->catchup_start = now;
+			device->stats.catchups++;
+		}
+		
+		if (device->fixed) {
+			catchup_fixed(device, &packet, delta);
+		} else {
+			FusionVector gyroscope;
+			
+			readGyroscope_from_packet(&packet, &gyroscope);
+			apply_gyroscope_calibration(device, &gyroscope);
+			
+			if (device->offset) {
+				gyroscope = FusionOffsetUpdate((FusionOffset*) device->offset, gyroscope);
+			}
+			
+			device->catchup_rotation.x += gyroscope.axis.x * deltaTime;
+			device->catchup_rotation.y += gyroscope.axis.y * deltaTime;
+			device->catchup_rotation.z += gyroscope.axis.z * deltaTime;
+		}
+		
+		device->catchup_delta += delta;
+		device->stats.catchup_samples++;
+		return DEVICE_IMU_ERROR_NO_ERROR;
+	}
+	
+	const bool caught_up = finish_catchup(device, now);
+	
+	// The sample only gets filled in with someone consuming it, it's handed over by reference afterwards
+	device_imu_sample_type* sample = ((device->sample_callback) || (device->pipeline)? &(device->sample) : NULL);
+	
+	if (device->fixed) {
+		return read_fixed(device, &packet, timestamp, now, delta, sample, caught_up);
+	}
+	
+	FusionVector gyroscope;
+	FusionVector accelerometer;
+	FusionVector magnetometer;
+	
+	readGyroscope_from_packet(&packet, &gyroscope);
+	readAccelerometer_from_packet(&packet, &accelerometer);
+	
+	// Without a consumer the magnetometer stays marked as missing, which saves its decoding and iron estimation
+	if (MAGNETOMETER_ENABLED(device)) {
+		readMagnetometer_from_packet(&packet, &magnetometer);
+	} else {
+		magnetometer.axis.x = NAN;
+		magnetometer.axis.y = NAN;
+		magnetometer.axis.z = NAN;
+	}
+	
+	if (sample) {
+		begin_sample(device, sample, timestamp, now, deltaTime);
+		
+		sample_vector(&(sample->raw_gyroscope), &gyroscope);
+		sample_vector(&(sample->raw_accelerometer), &accelerometer);
+		sample_vector(&(sample->raw_magnetometer), &magnetometer);
+	}
+	
+	apply_calibration(device, &gyroscope, &accelerometer, MAGNETOMETER_ENABLED(device)? &magnetometer : NULL);
+	
+	if (device->startup) {
+		observe_startup(device, &gyroscope, &accelerometer, deltaTime);
+	}
+	
+	if (device->offset) {
+		gyroscope = FusionOffsetUpdate((FusionOffset*) device->offset, gyroscope);
+	}
+	
+	if (device->filter) {
+		apply_filter(device, &gyroscope, &accelerometer, caught_up);
+	}
+	
+	bool dropped = false;
+	
+	if (sample) {
+		sample_vector(&(sample->gyroscope), &gyroscope);
+		sample_vector(&(sample->accelerometer), &accelerometer);
+		sample_vector(&(sample->magnetometer), &magnetometer);
+		convert_sample(device, sample);
+		
+		// A dropped sample still gets integrated, otherwise its rotation would be lost
+		dropped = !run_pre_fusion_stages(device, sample);
+		
+		if ((!dropped) && (stage_count(device, DEVICE_IMU_STAGE_PRE_FUSION) > 0)) {
+			// Stages see the vectors in the output convention, the fusion still needs them in NED
+			const device_imu_vec3_type g = revert_vector(device, &(sample->gyroscope), true);
+			const device_imu_vec3_type a = revert_vector(device, &(sample->accelerometer), false);
+			const device_imu_vec3_type m = revert_vector(device, &(sample->magnetometer), false);
+			
+			gyroscope = sample_fusion_vector(&g);
+			accelerometer = sample_fusion_vector(&a);
+			magnetometer = sample_fusion_vector(&m);
+		}
+	}
+	
+#ifndef NDEBUG
+	printf("G: %.2f %.2f %.2f\n", gyroscope.axis.x, gyroscope.axis.y, gyroscope.axis.z);
+	printf("A: %.2f %.2f %.2f\n", accelerometer.axis.x, accelerometer.axis.y, accelerometer.axis.z);
+	printf("M: %.2f %.2f %.2f\n", magnetometer.axis.x, magnetometer.axis.y, magnetometer.axis.z);
+#endif
+
+	if (device->ahrs) {
+		const FusionQuaternion previous = FusionAhrsGetQuaternion((const FusionAhrs*) device->ahrs);
+		
+		if (isnan(magnetometer.axis.x) || isnan(magnetometer.axis.x) || isnan(magnetometer.axis.x)) {
+			FusionAhrsUpdateNoMagnetometer((FusionAhrs*) device->ahrs, gyroscope, accelerometer, deltaTime);
+		} else {
+			/* The magnetometer seems to make results of sensor fusion generally worse. So it is not used currently. */
+			// FusionAhrsUpdate((FusionAhrs*) device->ahrs, gyroscope, accelerometer, magnetometer, deltaTime);
+			FusionAhrsUpdateNoMagnetometer((FusionAhrs*) device->ahrs, gyroscope, accelerometer, deltaTime);
+		}
+
+		const device_imu_quat_type orientation = device_imu_get_orientation(device->ahrs);
+
+		// TODO: fix detection of this case; quat.x as a nan value is only a side-effect of some issue with ahrs or
+		//       the gyro/accel/magnet readings
+		if (isnan(orientation.x) || isnan(orientation.y) || isnan(orientation.z) || isnan(orientation.w)) {
+			device_imu_error("Invalid orientation reading");
+			return DEVICE_IMU_ERROR_INVALID_VALUE;
+		}
+		
+		measure_swap(device, &previous, &orientation);
+		
+		if (device->startup) {
+			check_startup(device, now);
+		}
+	}
+	
+	finish_update(device, timestamp, now, sample, caught_up, dropped);
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+struct device_imu_capture_t {
+	int fd;
+	uint8_t* mapping;
+	size_t size;
+	
+	uint64_t capacity;
+	uint64_t count;
+};
+
+typedef struct device_imu_capture_t device_imu_capture_type;
+
+device_imu_error_type device_imu_start_capture(device_imu_type* device, const char* path, uint64_t capacity) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+
+	if (!device->handle) {
+		device_imu_error("No handle");
+		return DEVICE_IMU_ERROR_NO_HANDLE;
+	}
+	
+	if (device->capture) {
+		device_imu_stop_capture(device);
+	}
+	
+	device_imu_capture_type* capture = calloc(1, sizeof(device_imu_capture_type));
+	
+	if (!capture) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	capture->capacity = capacity;
+	capture->size = sizeof(device_imu_capture_header_type) + capacity * sizeof(device_imu_capture_record_type);
+	capture->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	
+	if (capture->fd == -1) {
+		device_imu_error("No file opened");
+		free(capture);
+		return DEVICE_IMU_ERROR_FILE_NOT_OPEN;
+	}
+	
+	// The whole file gets reserved upfront, so capturing never needs to grow it
+	if (0 != ftruncate(capture->fd, (off_t) capture->size)) {
+		device_imu_error("Not reserved");
+		close(capture->fd);
+		free(capture);
+		return DEVICE_IMU_ERROR_SAVING_FAILED;
+	}
+	
+	void* mapping = mmap(NULL, capture->size, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, 0);
+	
+	if (mapping == MAP_FAILED) {
+		device_imu_error("Not mapped");
+		close(capture->fd);
+		free(capture);
+		return DEVICE_IMU_ERROR_SAVING_FAILED;
+	}
+	
+	capture->mapping = (uint8_t*) mapping;
+	madvise(capture->mapping, capture->size, MADV_SEQUENTIAL);
+	
+	device_imu_capture_header_type* header = (device_imu_capture_header_type*) capture->mapping;
+	header->magic = DEVICE_IMU_CAPTURE_MAGIC;
+	header->version = DEVICE_IMU_CAPTURE_VERSION;
+	header->product_id = device->product_id;
+	header->static_id = device->static_id;
+	header->record_size = sizeof(device_imu_capture_record_type);
+	header->count = 0;
+	
+	device->capture = capture;
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+device_imu_error_type device_imu_capture(device_imu_type* device, int timeout) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
+
+	if ((!device->handle) || (!device->capture)) {
+		device_imu_error("No handle");
+		return DEVICE_IMU_ERROR_NO_HANDLE;
+	}
+	
+	if (device->download) {
+		download_progress(device, device_time_now());
+	}
+	
+	device_imu_capture_type* capture = (device_imu_capture_type*) device->capture;
+	device_imu_capture_header_type* header = (device_imu_capture_header_type*) capture->mapping;
+	
+	device_imu_capture_record_type* records = (device_imu_capture_record_type*) (
+			capture->mapping + sizeof(device_imu_capture_header_type)
+	);
+	
+	// Reports get read straight into the mapping, after the first one only as many as are already queued
+	for (uint32_t i = 0; i < DEVICE_IMU_CAPTURE_BATCH; i++) {
+		if (capture->count >= capture->capacity) {
+			header->count = capture->count;
+			return DEVICE_IMU_ERROR_CAPTURE_FULL;
+		}
+		
+		device_imu_capture_record_type* record = &(records[capture->count]);
+		int transferred;
+		
+		// Replies to the deferred calibration download can be larger than a record, so they need a copy
+		if (device->download) {
+			union {
+				device_imu_packet_type packet;
+				device_imu_payload_packet_type payload;
+			} report;
+			
+			const int report_size = (device->max_payload_size < sizeof(report)? device->max_payload_size : sizeof(report));
+			
+			transferred = hid_read_timeout(
+				device->handle,
+				(uint8_t*) &report,
+				report_size,
+				i > 0? 0 : timeout
+			);
+			
+			if ((transferred > 0) && (download_reply(device, &(report.payload), transferred, device_time_now()))) {
+				continue;
+			}
+			
+			if (transferred > (int) sizeof(device_imu_packet_type)) {
+				transferred = sizeof(device_imu_packet_type);
+			}
+			
+			if (transferred > 0) {
+				memcpy(&(record->packet), &(report.packet), transferred);
+			}
+		} else {
+			transferred = hid_read_timeout(
+				device->handle, 
+				(uint8_t*) &(record->packet), 
+				sizeof(device_imu_packet_type),
+				i > 0? 0 : timeout
+			);
+		}
+		
+		if (transferred == -1) {
+			device_imu_error("Device may be unplugged");
+			header->count = capture->count;
+			return DEVICE_IMU_ERROR_UNPLUGGED;
+		}
+		
+		if (transferred == 0) {
+			break;
+		}
+		
+		if (((int) sizeof(device_imu_packet_type) != transferred) ||
+			(record->packet.signature[0] != 0x01) || (record->packet.signature[1] != 0x02)) {
+			continue;
+		}
+		
+		record->host_timestamp = device_time_now();
+		capture->count++;
+	}
+	
+	header->count = capture->count;
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+uint64_t device_imu_captured(const device_imu_type* device) {
+	if ((!device) || (!device->capture)) {
+		return 0;
+	}
+	
+	return ((const device_imu_capture_type*) device->capture)->count;
 }
 
-static void readIMU_from_packet(const device_imu_packet_type* packet,
-								FusionVector* gyroscope,
-								FusionVector* accelerometer,
-								FusionVector* magnetometer) {
-	int32_t vel_m = pack16bit_signed(packet->angular_multiplier);
-	int32_t vel_d = pack32bit_signed(packet->angular_divisor);
+device_imu_error_type device_imu_stop_capture(device_imu_type* device) {
+	if (!device) {
+		device_imu_error("No device");
+		return DEVICE_IMU_ERROR_NO_DEVICE;
+	}
 	
-	int32_t vel_x = pack24bit_signed(packet->angular_velocity_x);
-	int32_t vel_y = pack24bit_signed(packet->angular_velocity_y);
-	int32_t vel_z = pack24bit_signed(packet->angular_velocity_z);
+	device_imu_capture_type* capture = (device_imu_capture_type*) device->capture;
 	
-	gyroscope->axis.x = (float) vel_x * (float) vel_m / (float) vel_d;
-	gyroscope->axis.y = (float) vel_y * (float) vel_m / (float) vel_d;
-	gyroscope->axis.z = (float) vel_z * (float) vel_m / (float) vel_d;
+	if (!capture) {
+		return DEVICE_IMU_ERROR_NO_ERROR;
+	}
 	
-	int32_t accel_m = pack16bit_signed(packet->acceleration_multiplier);
-	int32_t accel_d = pack32bit_signed(packet->acceleration_divisor);
+	device_imu_error_type result = DEVICE_IMU_ERROR_NO_ERROR;
 	
-	int32_t accel_x = pack24bit_signed(packet->acceleration_x);
-	int32_t accel_y = pack24bit_signed(packet->acceleration_y);
-	int32_t accel_z = pack24bit_signed(packet->acceleration_z);
+	const size_t size = sizeof(device_imu_capture_header_type) + capture->count * sizeof(device_imu_capture_record_type);
 	
-	accelerometer->axis.x = (float) accel_x * (float) accel_m / (float) accel_d;
-	accelerometer->axis.y = (float) accel_y * (float) accel_m / (float) accel_d;
-	accelerometer->axis.z = (float) accel_z * (float) accel_m / (float) accel_d;
+	((device_imu_capture_header_type*) capture->mapping)->count = capture->count;
 	
-	int32_t magnet_m = pack16bit_signed_swap(packet->magnetic_multiplier);
-	int32_t magnet_d = pack32bit_signed_swap(packet->magnetic_divisor);
+	if (0 != msync(capture->mapping, size, MS_SYNC)) {
+		device_imu_error("Not fully saved");
+		result = DEVICE_IMU_ERROR_SAVING_FAILED;
+	}
 	
-	int16_t magnet_x = pack16bit_signed_bizarre(packet->magnetic_x);
-	int16_t magnet_y = pack16bit_signed_bizarre(packet->magnetic_y);
-	int16_t magnet_z = pack16bit_signed_bizarre(packet->magnetic_z);
+	munmap(capture->mapping, capture->size);
 	
-	magnetometer->axis.x = (float) magnet_x * (float) magnet_m / (float) magnet_d;
-	magnetometer->axis.y = (float) magnet_y * (float) magnet_m / (float) magnet_d;
-	magnetometer->axis.z = (float) magnet_z * (float) magnet_m / (float) magnet_d;
+	// Only the reserved space which stayed unused gets cut off again
+	if (0 != ftruncate(capture->fd, (off_t) size)) {
+		device_imu_error("Not fully saved");
+		result = DEVICE_IMU_ERROR_SAVING_FAILED;
+	}
+	
+	if (0 != close(capture->fd)) {
+		device_imu_error("No file closed");
+		result = DEVICE_IMU_ERROR_FILE_NOT_CLOSED;
+	}
+	
+	free(capture);
+	device->capture = NULL;
+	return result;
 }
 
-#define min(x, y) ((x) < (y)? (x) : (y))
-#define max(x, y) ((x) > (y)? (x) : (y))
+device_imu_vec3_type device_imu_get_earth_acceleration(const device_imu_ahrs_type* ahrs) {
+	FusionVector acceleration = ahrs? FusionAhrsGetEarthAcceleration((const FusionAhrs*) ahrs) : FUSION_VECTOR_ZERO;
+	device_imu_vec3_type a;
+	a.x = acceleration.axis.x;
+	a.y = acceleration.axis.y;
+	a.z = acceleration.axis.z;
+	return a;
+}
 
-static void pre_biased_coordinate_system(FusionVector* v) {
-	*v = FusionAxesSwap(*v, FusionAxesAlignmentNXNZNY);
+device_imu_vec3_type device_imu_get_linear_acceleration(const device_imu_ahrs_type* ahrs) {
+	FusionVector acceleration = ahrs? FusionAhrsGetLinearAcceleration((const FusionAhrs*) ahrs) : FUSION_VECTOR_ZERO;
+	device_imu_vec3_type a;
+	a.x = acceleration.axis.x;
+	a.y = acceleration.axis.y;
+	a.z = acceleration.axis.z;
+	return a;
 }
 
-static void post_biased_coordinate_system(const FusionVector* v, FusionVector* res) {
-	*res = FusionAxesSwap(*v, FusionAxesAlignmentPZPXPY);
+device_imu_quat_type device_imu_get_orientation(const device_imu_ahrs_type* ahrs) {
+	FusionQuaternion quaternion = ahrs? FusionAhrsGetQuaternion((const FusionAhrs*) ahrs) : FUSION_IDENTITY_QUATERNION;
+	device_imu_quat_type q;
+	q.x = quaternion.element.x;
+	q.y = quaternion.element.y;
+	q.z = quaternion.element.z;
+	q.w = quaternion.element.w;
+	return q;
 }
 
-static void iterate_iron_offset_estimation(const FusionVector* magnetometer, FusionMatrix* softIronMatrix, FusionVector* hardIronOffset) {
-	static FusionVector max = { FLT_MIN, FLT_MIN, FLT_MIN };
-	static FusionVector min = { FLT_MAX, FLT_MAX, FLT_MAX };
+device_imu_euler_type device_imu_get_euler(device_imu_quat_type quat) {
+	FusionQuaternion quaternion;
+	quaternion.element.x = quat.x;
+	quaternion.element.y = quat.y;
+	quaternion.element.z = quat.z;
+	quaternion.element.w = quat.w;
+	FusionEuler euler = FusionQuaternionToEuler(quaternion);
+	device_imu_euler_type e;
+	e.roll = euler.angle.roll;
+	e.pitch = euler.angle.pitch;
+	e.yaw = euler.angle.yaw;
+	return e;
+}
 
-	for (int i = 0; i < 3; i++) {
-		max.array[i] = max(max.array[i], magnetometer->array[i]);
-		min.array[i] = min(min.array[i], magnetometer->array[i]);
+device_imu_vec3_type device_imu_convert_vec3(device_imu_vec3_type vec, device_imu_convention_type convention) {
+	if ((uint32_t) convention >= DEVICE_IMU_CONVENTIONS) {
+		device_imu_error("Unknown convention");
+		return vec;
 	}
 	
-	const float mx = (max.axis.x - min.axis.x) / 2.0f;
-	const float my = (max.axis.y - min.axis.y) / 2.0f;
-	const float mz = (max.axis.z - min.axis.z) / 2.0f;
-	
-	const float cx = (min.axis.x + max.axis.x) / 2.0f;
-	const float cy = (min.axis.y + max.axis.y) / 2.0f;
-	const float cz = (min.axis.z + max.axis.z) / 2.0f;
+	return convert_vector(&(frames[convention]), &vec, false);
+}
 
-	memset(softIronMatrix, 0, sizeof(*softIronMatrix));
+device_imu_quat_type device_imu_convert_quat(device_imu_quat_type quat, device_imu_convention_type convention) {
+	if ((uint32_t) convention >= DEVICE_IMU_CONVENTIONS) {
+		device_imu_error("Unknown convention");
+		return quat;
+	}
 	
-	softIronMatrix->element.xx = 1.0f / mx;
-	softIronMatrix->element.yy = 1.0f / my;
-	softIronMatrix->element.zz = 1.0f / mz;
-
-	hardIronOffset->axis.x = cx;
-	hardIronOffset->axis.y = cy;
-	hardIronOffset->axis.z = cz;
+	return convert_orientation(&(frames[convention]), &quat);
 }
 
-static void apply_calibration(const device_imu_type* device,
-							  FusionVector* gyroscope,
-							  FusionVector* accelerometer,
-							  FusionVector* magnetometer) {
-	FusionMatrix gyroscopeMisalignment;
-	FusionVector gyroscopeSensitivity;
-	FusionVector gyroscopeOffset;
+static void load_quaternions(const device_imu_quat_type* quats,
+							 uint64_t count,
+							 device_math_f4* x,
+							 device_math_f4* y,
+							 device_math_f4* z,
+							 device_math_f4* w) {
+	float lanes [4][4];
+	
+	// Unused lanes get the identity, so they stay away from any special case
+	for (uint64_t i = 0; i < 4; i++) {
+		lanes[0][i] = (i < count? quats[i].x : 0.0f);
+		lanes[1][i] = (i < count? quats[i].y : 0.0f);
+		lanes[2][i] = (i < count? quats[i].z : 0.0f);
+		lanes[3][i] = (i < count? quats[i].w : 1.0f);
+	}
 	
-	FusionMatrix accelerometerMisalignment;
-	FusionVector accelerometerSensitivity;
-	FusionVector accelerometerOffset;
+	*x = device_math_f4_load(lanes[0]);
+	*y = device_math_f4_load(lanes[1]);
+	*z = device_math_f4_load(lanes[2]);
+	*w = device_math_f4_load(lanes[3]);
+}
+
+void device_imu_get_euler_batch(const device_imu_quat_type* quats, device_imu_euler_type* eulers, uint64_t count) {
+	if ((!quats) || (!eulers)) {
+		return;
+	}
 	
-	FusionMatrix magnetometerMisalignment;
-	FusionVector magnetometerSensitivity;
-	FusionVector magnetometerOffset;
+	for (uint64_t i = 0; i < count; i += 4) {
+		const uint64_t lanes = (count - i < 4? count - i : 4);
+		
+		device_math_f4 x, y, z, w;
+		load_quaternions(quats + i, lanes, &x, &y, &z, &w);
+		
+		device_math_f4 roll, pitch, yaw;
+		device_math_f4_euler(x, y, z, w, &roll, &pitch, &yaw);
+		
+		float angles [3][4];
+		device_math_f4_store(angles[0], roll);
+		device_math_f4_store(angles[1], pitch);
+		device_math_f4_store(angles[2], yaw);
+		
+		for (uint64_t j = 0; j < lanes; j++) {
+			eulers[i + j].roll = angles[0][j];
+			eulers[i + j].pitch = angles[1][j];
+			eulers[i + j].yaw = angles[2][j];
+		}
+	}
+}
+
+void device_imu_get_matrix_batch(const device_imu_quat_type* quats, float* matrices, uint64_t count, bool homogeneous) {
+	if ((!quats) || (!matrices)) {
+		return;
+	}
 	
-	FusionMatrix softIronMatrix;
-	FusionVector hardIronOffset;
+	const uint32_t size = (homogeneous? 4 : 3);
 	
-	if (device->calibration) {
-		gyroscopeMisalignment = device->calibration->gyroscopeMisalignment;
-		gyroscopeSensitivity = device->calibration->gyroscopeSensitivity;
-		gyroscopeOffset = device->calibration->gyroscopeOffset;
+	for (uint64_t i = 0; i < count; i += 4) {
+		const uint64_t lanes = (count - i < 4? count - i : 4);
 		
-		accelerometerMisalignment = device->calibration->accelerometerMisalignment;
-		accelerometerSensitivity = device->calibration->accelerometerSensitivity;
-		accelerometerOffset = device->calibration->accelerometerOffset;
+		device_math_f4 x, y, z, w;
+		load_quaternions(quats + i, lanes, &x, &y, &z, &w);
 		
-		magnetometerMisalignment = device->calibration->magnetometerMisalignment;
-		magnetometerSensitivity = device->calibration->magnetometerSensitivity;
-		magnetometerOffset = device->calibration->magnetometerOffset;
+		device_math_f4 matrix [9];
+		device_math_f4_matrix(x, y, z, w, matrix);
 		
-		softIronMatrix = device->calibration->softIronMatrix;
-		hardIronOffset = device->calibration->hardIronOffset;
-	} else {
-		gyroscopeMisalignment = FUSION_IDENTITY_MATRIX;
-		gyroscopeSensitivity = FUSION_VECTOR_ONES;
-		gyroscopeOffset = FUSION_VECTOR_ZERO;
-		
-		accelerometerMisalignment = FUSION_IDENTITY_MATRIX;
-		accelerometerSensitivity = FUSION_VECTOR_ONES;
-		accelerometerOffset = FUSION_VECTOR_ZERO;
+		float elements [9][4];
 		
-		magnetometerMisalignment = FUSION_IDENTITY_MATRIX;
-		magnetometerSensitivity = FUSION_VECTOR_ONES;
-		magnetometerOffset = FUSION_VECTOR_ZERO;
+		for (uint32_t k = 0; k < 9; k++) {
+			device_math_f4_store(elements[k], matrix[k]);
+		}
 		
-		softIronMatrix = FUSION_IDENTITY_MATRIX;
-		hardIronOffset = FUSION_VECTOR_ZERO;
+		for (uint64_t j = 0; j < lanes; j++) {
+			float* m = matrices + (i + j) * size * size;
+			
+			for (uint32_t row = 0; row < size; row++) {
+				for (uint32_t column = 0; column < size; column++) {
+					m[row * size + column] = ((row < 3) && (column < 3)?
+							elements[row * 3 + column][j] :
+							(row == column? 1.0f : 0.0f)
+					);
+				}
+			}
+		}
 	}
+}
 
-	gyroscopeOffset = FusionVectorMultiplyScalar(
-		gyroscopeOffset, 
-		FusionRadiansToDegrees(1.0f)
-	);
+// Raw and calibrated gyroscope and accelerometer, in that order
+#define DECIMATOR_CHANNELS 12
 
-	accelerometerOffset = FusionVectorMultiplyScalar(
-		accelerometerOffset, 
-		1.0f / GRAVITY_G
-	);
+// Cutoff relative to the output rate, leaves the Blackman transition band above its Nyquist frequency
+#define DECIMATOR_CUTOFF 0.3
 
-	FusionVector g = *gyroscope;
-	FusionVector a = *accelerometer;
-	FusionVector m = *magnetometer;
+struct device_imu_decimator_state_t {
+	uint32_t position; // (next row of the history)
+	uint32_t phase; // (input samples until the next output)
+	bool primed;
+	
+	float* coefficients;
+	float* history; // (two copies of every row, so each window is contiguous)
+	device_imu_sample_type* samples;
+};
 
-	pre_biased_coordinate_system(&g);
-	pre_biased_coordinate_system(&a);
-	pre_biased_coordinate_system(&m);
+typedef struct device_imu_decimator_state_t device_imu_decimator_state_type;
 
-	g = FusionCalibrationInertial(
-			g,
-			gyroscopeMisalignment,
-			gyroscopeSensitivity,
-			gyroscopeOffset
-	);
-	
-	a = FusionCalibrationInertial(
-			a,
-			accelerometerMisalignment,
-			accelerometerSensitivity,
-			accelerometerOffset
-	);
+static void design_decimator(float* coefficients, uint32_t taps, double cutoff) {
+	const double pi = 3.14159265358979323846;
+	const double center = 0.5 * (taps - 1);
 	
-	m = FusionCalibrationInertial(
-			m,
-			magnetometerMisalignment,
-			magnetometerSensitivity,
-			magnetometerOffset
-	);
-
-	iterate_iron_offset_estimation(
-		&m, 
-		&softIronMatrix, 
-		&hardIronOffset
-	);
+	double sum = 0.0;
 	
-	if (device->calibration) {
-		device->calibration->softIronMatrix = softIronMatrix;
-		device->calibration->hardIronOffset = hardIronOffset;
+	for (uint32_t i = 0; i < taps; i++) {
+		const double t = i - center;
+		const double sinc = (t == 0.0? 2.0 * cutoff : sin(2.0 * pi * cutoff * t) / (pi * t));
+		const double phase = 2.0 * pi * i / (taps - 1);
+		const double window = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase);
+		
+		coefficients[i] = (float) (sinc * window);
+		sum += coefficients[i];
 	}
 	
-	m = FusionCalibrationMagnetic(
-			m,
-			softIronMatrix,
-			hardIronOffset
-	);
-
-	post_biased_coordinate_system(&g, gyroscope);
-	post_biased_coordinate_system(&a, accelerometer);
-	post_biased_coordinate_system(&m, magnetometer);
+	// Unity gain for constant rates and gravity
+	for (uint32_t i = 0; i < taps; i++) {
+		coefficients[i] = (float) (coefficients[i] / sum);
+	}
 }
 
-device_imu_error_type device_imu_clear(device_imu_type* device) {
-	return device_imu_read(device, 10);
+static void push_decimator_row(device_imu_decimator_type* decimator,
+							   device_imu_decimator_state_type* state,
+							   const device_imu_sample_type* sample) {
+	const float row [DECIMATOR_CHANNELS] = {
+			sample->raw_gyroscope.x, sample->raw_gyroscope.y, sample->raw_gyroscope.z,
+			sample->raw_accelerometer.x, sample->raw_accelerometer.y, sample->raw_accelerometer.z,
+			sample->gyroscope.x, sample->gyroscope.y, sample->gyroscope.z,
+			sample->accelerometer.x, sample->accelerometer.y, sample->accelerometer.z
+	};
+	
+	const uint32_t position = state->position;
+	
+	memcpy(state->history + position * DECIMATOR_CHANNELS, row, sizeof(row));
+	memcpy(state->history + (position + decimator->taps) * DECIMATOR_CHANNELS, row, sizeof(row));
+	state->samples[position] = *sample;
+	
+	state->position = (position + 1 < decimator->taps? position + 1 : 0);
 }
 
-device_imu_error_type device_imu_calibrate(device_imu_type* device, uint32_t iterations, bool gyro, bool accel, bool magnet) {
-	if (!device) {
-		device_imu_error("No device");
-		return DEVICE_IMU_ERROR_NO_DEVICE;
+device_imu_error_type device_imu_decimator_init(device_imu_decimator_type* decimator,
+												 uint32_t rate,
+												 device_imu_sample_callback callback,
+												 void* userdata) {
+	if (!decimator) {
+		device_imu_error("No decimator");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
 	}
-
-	if (!device->handle) {
-		device_imu_error("No handle");
-		return DEVICE_IMU_ERROR_NO_HANDLE;
+	
+	memset(decimator, 0, sizeof(device_imu_decimator_type));
+	
+	if ((rate == 0) || (rate > DEVICE_IMU_SAMPLE_RATE) || (DEVICE_IMU_SAMPLE_RATE % rate != 0)) {
+		device_imu_error("Invalid decimation rate");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
 	}
-
-	if (!device->calibration) {
-		device_imu_error("No calibration allocated");
+	
+	decimator->rate = rate;
+	decimator->factor = DEVICE_IMU_SAMPLE_RATE / rate;
+	decimator->taps = DEVICE_IMU_DECIMATOR_TAPS * decimator->factor + 1;
+	decimator->delay = (decimator->taps - 1) / 2;
+	decimator->callback = callback;
+	decimator->userdata = userdata;
+	
+	device_imu_decimator_state_type* state = calloc(1, sizeof(device_imu_decimator_state_type));
+	
+	if (!state) {
+		device_imu_error("Not allocated");
 		return DEVICE_IMU_ERROR_NO_ALLOCATION;
 	}
 	
-	if (sizeof(device_imu_packet_type) > device->max_payload_size) {
-		device_imu_error("Not proper size");
-		return DEVICE_IMU_ERROR_WRONG_SIZE;
+	state->coefficients = calloc(decimator->taps, sizeof(float));
+	state->history = calloc(2 * decimator->taps * DECIMATOR_CHANNELS, sizeof(float));
+	state->samples = calloc(decimator->taps, sizeof(device_imu_sample_type));
+	decimator->state = state;
+	
+	if ((!state->coefficients) || (!state->history) || (!state->samples)) {
+		device_imu_error("Not allocated");
+		device_imu_decimator_free(decimator);
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
+	}
+	
+	design_decimator(
+			state->coefficients,
+			decimator->taps,
+			DECIMATOR_CUTOFF / decimator->factor
+	);
+	
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+bool device_imu_decimator_process(device_imu_decimator_type* decimator,
+								  const device_imu_sample_type* sample,
+								  device_imu_sample_type* output) {
+	if ((!decimator) || (!decimator->state) || (!sample) || (!output)) {
+		return false;
+	}
+	
+	device_imu_decimator_state_type* state = (device_imu_decimator_state_type*) decimator->state;
+	
+	// Starts from a steady state instead of ramping up from zero
+	if (!state->primed) {
+		for (uint32_t i = 0; i < decimator->taps; i++) {
+			push_decimator_row(decimator, state, sample);
+		}
+		
+		state->primed = true;
+	} else {
+		push_decimator_row(decimator, state, sample);
+	}
+	
+	// Only the kept outputs get computed, which is all the polyphase decomposition saves
+	if (state->phase > 0) {
+		state->phase--;
+		return false;
 	}
 	
-	device_imu_packet_type packet;
-	int transferred;
+	state->phase = decimator->factor - 1;
+	
+	const float* window = state->history + state->position * DECIMATOR_CHANNELS;
+	
+	device_math_f4 sum [3] = {
+			device_math_f4_set(0.0f),
+			device_math_f4_set(0.0f),
+			device_math_f4_set(0.0f)
+	};
+	
+	// The window runs from the oldest to the latest row, the symmetric taps need no reversal
+	for (uint32_t k = 0; k < decimator->taps; k++) {
+		const device_math_f4 h = device_math_f4_set(state->coefficients[k]);
+		const float* row = window + k * DECIMATOR_CHANNELS;
+		
+		sum[0] = device_math_f4_add(sum[0], device_math_f4_mul(h, device_math_f4_load(row + 0)));
+		sum[1] = device_math_f4_add(sum[1], device_math_f4_mul(h, device_math_f4_load(row + 4)));
+		sum[2] = device_math_f4_add(sum[2], device_math_f4_mul(h, device_math_f4_load(row + 8)));
+	}
+	
+	float filtered [DECIMATOR_CHANNELS];
+	device_math_f4_store(filtered + 0, sum[0]);
+	device_math_f4_store(filtered + 4, sum[1]);
+	device_math_f4_store(filtered + 8, sum[2]);
+	
+	const uint32_t latest = (state->position + decimator->taps - 1) % decimator->taps;
+	*output = state->samples[(latest + decimator->taps - decimator->delay) % decimator->taps];
 	
-	bool initialized = false;
+	output->raw_gyroscope = (device_imu_vec3_type) { filtered[0], filtered[1], filtered[2] };
+	output->raw_accelerometer = (device_imu_vec3_type) { filtered[3], filtered[4], filtered[5] };
+	output->gyroscope = (device_imu_vec3_type) { filtered[6], filtered[7], filtered[8] };
+	output->accelerometer = (device_imu_vec3_type) { filtered[9], filtered[10], filtered[11] };
+	output->delta_time = (float) decimator->factor / DEVICE_IMU_SAMPLE_RATE;
+	return true;
+}
+
+static bool decimator_stage(device_imu_sample_type* sample, void* userdata) {
+	device_imu_decimator_type* decimator = (device_imu_decimator_type*) userdata;
 	
-	FusionVector cal_gyroscope;
-	FusionVector cal_accelerometer;
+	if ((device_imu_decimator_process(decimator, sample, &(decimator->sample))) && (decimator->callback)) {
+		decimator->callback(&(decimator->sample), decimator->userdata);
+	}
+	
+	return true;
+}
 
-	FusionMatrix softIronMatrix;
-	FusionVector hardIronOffset;
+device_imu_error_type device_imu_decimator_attach(device_imu_decimator_type* decimator, device_imu_type* device) {
+	if ((!decimator) || (!decimator->state)) {
+		device_imu_error("Decimator not initialized");
+		return DEVICE_IMU_ERROR_NOT_INITIALIZED;
+	}
 	
-	const float factor = iterations > 0? 1.0f / ((float) iterations) : 0.0f;
+	return device_imu_add_stage(device, DEVICE_IMU_STAGE_POST_FUSION, decimator_stage, decimator);
+}
 
-	FusionVector prev_accel;
-	while (iterations > 0) {
-		memset(&packet, 0, sizeof(device_imu_packet_type));
+device_imu_error_type device_imu_decimator_free(device_imu_decimator_type* decimator) {
+	if (!decimator) {
+		device_imu_error("No decimator");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
+	}
+	
+	device_imu_decimator_state_type* state = (device_imu_decimator_state_type*) decimator->state;
+	
+	if (state) {
+		free(state->coefficients);
+		free(state->history);
+		free(state->samples);
+		free(state);
 		
-		transferred = hid_read(
-			device->handle, 
-			(uint8_t*) &packet, 
-			sizeof(device_imu_packet_type)
-		);
+		decimator->state = NULL;
+	}
+	
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
 
-		if (transferred == -1) {
-			device_imu_error("Device may be unplugged");
-			return DEVICE_IMU_ERROR_UNPLUGGED;
-		}
+// Raw and calibrated gyroscope and accelerometer, the magnetometer and the temperature
+#define RESAMPLER_CHANNELS 16
+#define RESAMPLER_HISTORY 4
 
-		if (transferred == 0) {
-			continue;
-		}
+struct device_imu_resampler_entry_t {
+	int64_t time; // (device time in ns)
+	float values [RESAMPLER_CHANNELS];
+	FusionQuaternion orientation;
+	
+	uint64_t sequence;
+	uint32_t flags;
+	device_imu_vec3_type raw_magnetometer;
+	
+	float acceleration_error;
+	float acceleration_recovery;
+	float magnetic_error;
+	float magnetic_recovery;
+};
 
-		if (sizeof(device_imu_packet_type) != transferred) {
-			device_imu_error("Unexpected packet size");
-			return DEVICE_IMU_ERROR_UNEXPECTED;
-		}
-		
-		if ((packet.signature[0] != 0x01) || (packet.signature[1] != 0x02)) {
-			continue;
-		}
-		
-		FusionVector gyroscope;
-		FusionVector accelerometer;
-		FusionVector magnetometer;
-		
-		readIMU_from_packet(&packet, &gyroscope, &accelerometer, &magnetometer);
-		
-		pre_biased_coordinate_system(&gyroscope);
-		pre_biased_coordinate_system(&accelerometer);
-		pre_biased_coordinate_system(&magnetometer);
+typedef struct device_imu_resampler_entry_t device_imu_resampler_entry_type;
 
-		if (initialized) {
-			cal_gyroscope = FusionVectorAdd(cal_gyroscope, gyroscope);
-			cal_accelerometer = FusionVectorAdd(cal_accelerometer, FusionVectorSubtract(accelerometer, prev_accel));
-		} else {
-			cal_gyroscope = gyroscope;
-			cal_accelerometer = FUSION_VECTOR_ZERO;
-		}
+struct device_imu_resampler_state_t {
+	device_imu_resampler_entry_type entries [RESAMPLER_HISTORY]; // (oldest first)
+	uint32_t count;
+	
+	int64_t offset; // (host minus device time in ns, tracking the lowest observed with a slow leak upwards)
+	bool synchronised;
+	bool started;
+	uint64_t next; // (host time of the next grid sample in ns)
+	
+	uint64_t retarget; // (requested grid spacing in ns, only access atomically)
+};
 
-		prev_accel = accelerometer;
+typedef struct device_imu_resampler_state_t device_imu_resampler_state_type;
 
-		iterate_iron_offset_estimation(
-			&magnetometer, 
-			&softIronMatrix, 
-			&hardIronOffset
-		);
-		
-		iterations--;
+static void push_resampler_entry(device_imu_resampler_state_type* state, const device_imu_sample_type* sample) {
+	if (state->count >= RESAMPLER_HISTORY) {
+		memmove(state->entries, state->entries + 1, (RESAMPLER_HISTORY - 1) * sizeof(device_imu_resampler_entry_type));
+		state->count = RESAMPLER_HISTORY - 1;
 	}
 	
-	if (factor > 0.0f) {
-		if (gyro) {
-			device->calibration->gyroscopeOffset = FusionVectorAdd(
-					device->calibration->gyroscopeOffset,
-					FusionVectorMultiplyScalar(
-							cal_gyroscope,
-							FusionDegreesToRadians(factor)
-					)
-			);
-		}
+	device_imu_resampler_entry_type* entry = &(state->entries[state->count++]);
+	
+	const float values [RESAMPLER_CHANNELS] = {
+			sample->raw_gyroscope.x, sample->raw_gyroscope.y, sample->raw_gyroscope.z,
+			sample->raw_accelerometer.x, sample->raw_accelerometer.y, sample->raw_accelerometer.z,
+			sample->gyroscope.x, sample->gyroscope.y, sample->gyroscope.z,
+			sample->accelerometer.x, sample->accelerometer.y, sample->accelerometer.z,
+			sample->magnetometer.x, sample->magnetometer.y, sample->magnetometer.z,
+			sample->temperature
+	};
+	
+	entry->time = (int64_t) sample->timestamp;
+	memcpy(entry->values, values, sizeof(values));
+	
+	entry->orientation.element.w = sample->orientation.w;
+	entry->orientation.element.x = sample->orientation.x;
+	entry->orientation.element.y = sample->orientation.y;
+	entry->orientation.element.z = sample->orientation.z;
+	
+	entry->sequence = sample->sequence;
+	entry->flags = sample->flags;
+	entry->raw_magnetometer = sample->raw_magnetometer;
+	
+	entry->acceleration_error = sample->acceleration_error;
+	entry->acceleration_recovery = sample->acceleration_recovery;
+	entry->magnetic_error = sample->magnetic_error;
+	entry->magnetic_recovery = sample->magnetic_recovery;
+}
+
+// Cubic Hermite spline with tangents from the actual neighbouring timestamps, so jitter does not bend the curve
+static void interpolate_cubic(const device_imu_resampler_entry_type* previous,
+							  const device_imu_resampler_entry_type* a,
+							  const device_imu_resampler_entry_type* b,
+							  const device_imu_resampler_entry_type* next,
+							  float u,
+							  float* values) {
+	const float h = (float) (b->time - a->time);
+	const float u2 = u * u;
+	const float u3 = u2 * u;
+	
+	const device_math_f4 h00 = device_math_f4_set(2.0f * u3 - 3.0f * u2 + 1.0f);
+	const device_math_f4 h01 = device_math_f4_set(-2.0f * u3 + 3.0f * u2);
+	const device_math_f4 h10 = device_math_f4_set((u3 - 2.0f * u2 + u) * h / (float) (b->time - previous->time));
+	const device_math_f4 h11 = device_math_f4_set((u3 - u2) * h / (float) (next->time - a->time));
+	
+	for (uint32_t i = 0; i < RESAMPLER_CHANNELS; i += 4) {
+		const device_math_f4 pa = device_math_f4_load(a->values + i);
+		const device_math_f4 pb = device_math_f4_load(b->values + i);
+		const device_math_f4 pp = device_math_f4_load(previous->values + i);
+		const device_math_f4 pn = device_math_f4_load(next->values + i);
 		
-		if (accel) {
-			device->calibration->accelerometerOffset = FusionVectorAdd(
-					device->calibration->accelerometerOffset,
-					FusionVectorMultiplyScalar(
-							cal_accelerometer,
-							factor * GRAVITY_G
-					)
-			);
-		}
+		device_math_f4 v = device_math_f4_add(device_math_f4_mul(h00, pa), device_math_f4_mul(h01, pb));
+		v = device_math_f4_add(v, device_math_f4_mul(h10, device_math_f4_sub(pb, pp)));
+		v = device_math_f4_add(v, device_math_f4_mul(h11, device_math_f4_sub(pn, pa)));
 		
-		if (magnet) {
-			device->calibration->softIronMatrix = softIronMatrix;
-			device->calibration->hardIronOffset = hardIronOffset;
-		}
+		device_math_f4_store(values + i, v);
 	}
-	
-	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
-device_imu_error_type device_imu_read(device_imu_type* device, int timeout) {
-	if (!device) {
-		device_imu_error("No device");
-		return DEVICE_IMU_ERROR_NO_DEVICE;
+static void interpolate_linear(const device_imu_resampler_entry_type* a,
+							   const device_imu_resampler_entry_type* b,
+							   float u,
+							   float* values) {
+	const device_math_f4 weight = device_math_f4_set(u);
+	
+	for (uint32_t i = 0; i < RESAMPLER_CHANNELS; i += 4) {
+		const device_math_f4 pa = device_math_f4_load(a->values + i);
+		const device_math_f4 pb = device_math_f4_load(b->values + i);
+		
+		device_math_f4_store(values + i, device_math_f4_add(pa, device_math_f4_mul(weight, device_math_f4_sub(pb, pa))));
 	}
+}
 
-	if (!device->handle) {
-		device_imu_error("No handle");
-		return DEVICE_IMU_ERROR_NO_HANDLE;
+static void emit_resampled(device_imu_resampler_type* resampler,
+						   uint32_t index,
+						   int64_t time) {
+	device_imu_resampler_state_type* state = (device_imu_resampler_state_type*) resampler->state;
+	
+	const device_imu_resampler_entry_type* a = &(state->entries[index]);
+	const device_imu_resampler_entry_type* b = &(state->entries[index + 1]);
+	const float u = (float) (time - a->time) / (float) (b->time - a->time);
+	
+	float values [RESAMPLER_CHANNELS];
+	
+	if (resampler->interpolation == DEVICE_IMU_INTERPOLATION_CUBIC) {
+		interpolate_cubic(
+				index > 0? &(state->entries[index - 1]) : a,
+				a,
+				b,
+				&(state->entries[index + 2]),
+				u,
+				values
+		);
+	} else {
+		interpolate_linear(a, b, u, values);
 	}
 	
-	if (sizeof(device_imu_packet_type) > device->max_payload_size) {
-		device_imu_error("Not proper size");
-		return DEVICE_IMU_ERROR_WRONG_SIZE;
-	}
+	const FusionQuaternion orientation = device_math_quaternion_slerp(a->orientation, b->orientation, u);
+	device_imu_sample_type* sample = &(resampler->sample);
 	
-	device_imu_packet_type packet;
-	memset(&packet, 0, sizeof(device_imu_packet_type));
+	sample->sequence = a->sequence;
+	sample->timestamp = (uint64_t) time;
+	sample->host_timestamp = state->next;
+	sample->delta_time = (float) resampler->period * 1e-9f;
+	sample->temperature = values[15];
 	
-	int transferred = hid_read_timeout(
-		device->handle, 
-		(uint8_t*) &packet, 
-		sizeof(device_imu_packet_type),
-		timeout
-	);
+	sample->raw_gyroscope = (device_imu_vec3_type) { values[0], values[1], values[2] };
+	sample->raw_accelerometer = (device_imu_vec3_type) { values[3], values[4], values[5] };
+	sample->raw_magnetometer = a->raw_magnetometer;
+	
+	sample->gyroscope = (device_imu_vec3_type) { values[6], values[7], values[8] };
+	sample->accelerometer = (device_imu_vec3_type) { values[9], values[10], values[11] };
+	sample->magnetometer = (device_imu_vec3_type) { values[12], values[13], values[14] };
+	
+	sample->orientation.x = orientation.element.x;
+	sample->orientation.y = orientation.element.y;
+	sample->orientation.z = orientation.element.z;
+	sample->orientation.w = orientation.element.w;
+	sample->flags = a->flags;
+	
+	sample->acceleration_error = a->acceleration_error;
+	sample->acceleration_recovery = a->acceleration_recovery;
+	sample->magnetic_error = a->magnetic_error;
+	sample->magnetic_recovery = a->magnetic_recovery;
+	
+	if (resampler->callback) {
+		resampler->callback(sample, resampler->userdata);
+	}
+}
 
-	if (transferred == -1) {
-		device_imu_error("Device may be unplugged");
-		return DEVICE_IMU_ERROR_UNPLUGGED;
+device_imu_error_type device_imu_resampler_init(device_imu_resampler_type* resampler,
+												 uint64_t period,
+												 device_imu_interpolation_type interpolation,
+												 device_imu_sample_callback callback,
+												 void* userdata) {
+	if (!resampler) {
+		device_imu_error("No resampler");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
 	}
 	
-	if (transferred == 0) {
-		return DEVICE_IMU_ERROR_NO_ERROR;
+	memset(resampler, 0, sizeof(device_imu_resampler_type));
+	
+	if ((period == 0) || (interpolation < 0) || (interpolation >= DEVICE_IMU_INTERPOLATIONS)) {
+		device_imu_error("Invalid resampling");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
 	}
 	
-	if (sizeof(device_imu_packet_type) != transferred) {
-		device_imu_error("Unexpected packet size");
-		return DEVICE_IMU_ERROR_UNEXPECTED;
+	resampler->period = period;
+	resampler->interpolation = interpolation;
+	resampler->callback = callback;
+	resampler->userdata = userdata;
+	resampler->state = calloc(1, sizeof(device_imu_resampler_state_type));
+	
+	if (!resampler->state) {
+		device_imu_error("Not allocated");
+		return DEVICE_IMU_ERROR_NO_ALLOCATION;
 	}
 	
-	const uint64_t timestamp = le64toh(packet.timestamp);
+	return DEVICE_IMU_ERROR_NO_ERROR;
+}
+
+uint32_t device_imu_resampler_process(device_imu_resampler_type* resampler, const device_imu_sample_type* sample) {
+	if ((!resampler) || (!resampler->state) || (!sample)) {
+		return 0;
+	}
 	
-	if ((packet.signature[0] == 0xaa) && (packet.signature[1] == 0x53)) {
-		device_imu_callback(device, timestamp, DEVICE_IMU_EVENT_INIT);
-		return DEVICE_IMU_ERROR_NO_ERROR;
+	device_imu_resampler_state_type* state = (device_imu_resampler_state_type*) resampler->state;
+	const uint64_t retarget = __atomic_exchange_n(&(state->retarget), 0, __ATOMIC_ACQUIRE);
+	
+	// The history stays valid, only the grid gets aligned to the new spacing without going back in time
+	if (retarget) {
+		resampler->period = retarget;
+		state->next = ((state->next + retarget - 1) / retarget) * retarget;
 	}
 	
-	if ((packet.signature[0] != 0x01) || (packet.signature[1] != 0x02)) {
-		device_imu_error("Not matching signature");
-		return DEVICE_IMU_ERROR_WRONG_SIGNATURE;
+	// The lowest transport delay maps device time to host time without the jitter of the packet arrival,
+	// a slow leak upwards follows clock drift the same way as for the clock offset of the device
+	if (sample->host_timestamp > 0) {
+		const int64_t offset = (int64_t) (sample->host_timestamp - sample->timestamp);
+		
+		if ((!state->synchronised) || (offset < state->offset)) {
+			state->offset = offset;
+			state->synchronised = true;
+		} else {
+			state->offset += (offset - state->offset) / 4096;
+		}
 	}
 	
-	const uint64_t delta = timestamp - device->last_timestamp;
-	const float deltaTime = (float) ((double) delta / 1e9);
+	if (state->count > 0) {
+		const int64_t last = state->entries[state->count - 1].time;
+		
+		if ((int64_t) sample->timestamp <= last) {
+			return 0;
+		}
+		
+		// Starts over behind a gap instead of interpolating across it, the grid keeps its phase
+		if ((int64_t) sample->timestamp - last > DEVICE_IMU_RESAMPLER_GAP_MS * 1000000LL) {
+			state->count = 0;
+		}
+	}
 	
-	device->last_timestamp = timestamp;
+	push_resampler_entry(state, sample);
 	
-	int16_t temperature = pack16bit_signed(packet.temperature);
+	const uint32_t required = (resampler->interpolation == DEVICE_IMU_INTERPOLATION_CUBIC? 3 : 2);
 	
-	// According to the ICM-42688-P datasheet: (offset: 25 °C, sensitivity: 132.48 LSB/°C)
-	device->temperature = ((float) temperature) / 132.48f + 25.0f;
+	if (state->count < required) {
+		return 0;
+	}
 	
-	FusionVector gyroscope;
-	FusionVector accelerometer;
-	FusionVector magnetometer;
+	const uint32_t index = state->count - required;
+	const int64_t start = state->entries[index].time;
+	const int64_t end = state->entries[index + 1].time;
+	const int64_t period = (int64_t) resampler->period;
 	
-	readIMU_from_packet(&packet, &gyroscope, &accelerometer, &magnetometer);
-	apply_calibration(device, &gyroscope, &accelerometer, &magnetometer);
+	if (!state->started) {
+		const int64_t host = start + state->offset;
+		
+		state->next = (uint64_t) (((host + period - 1) / period) * period);
+		state->started = true;
+	}
 	
-	if (device->offset) {
-		gyroscope = FusionOffsetUpdate((FusionOffset*) device->offset, gyroscope);
+	int64_t time = (int64_t) state->next - state->offset;
+	
+	if (time < start) {
+		state->next += (uint64_t) (((start - time + period - 1) / period) * period);
+		time = (int64_t) state->next - state->offset;
 	}
 	
-#ifndef NDEBUG
-	printf("G: %.2f %.2f %.2f\n", gyroscope.axis.x, gyroscope.axis.y, gyroscope.axis.z);
-	printf("A: %.2f %.2f %.2f\n", accelerometer.axis.x, accelerometer.axis.y, accelerometer.axis.z);
-	printf("M: %.2f %.2f %.2f\n", magnetometer.axis.x, magnetometer.axis.y, magnetometer.axis.z);
-#endif
-
-	if (device->ahrs) {
-		if (isnan(magnetometer.axis.x) || isnan(magnetometer.axis.x) || isnan(magnetometer.axis.x)) {
-			FusionAhrsUpdateNoMagnetometer((FusionAhrs*) device->ahrs, gyroscope, accelerometer, deltaTime);
-		} else {
-			/* The magnetometer seems to make results of sensor fusion generally worse. So it is not used currently. */
-			// FusionAhrsUpdate((FusionAhrs*) device->ahrs, gyroscope, accelerometer, magnetometer, deltaTime);
-			FusionAhrsUpdateNoMagnetometer((FusionAhrs*) device->ahrs, gyroscope, accelerometer, deltaTime);
-		}
-
-		const device_imu_quat_type orientation = device_imu_get_orientation(device->ahrs);
-
-		// TODO: fix detection of this case; quat.x as a nan value is only a side-effect of some issue with ahrs or
-		//       the gyro/accel/magnet readings
-		if (isnan(orientation.x) || isnan(orientation.y) || isnan(orientation.z) || isnan(orientation.w)) {
-			device_imu_error("Invalid orientation reading");
-			return DEVICE_IMU_ERROR_INVALID_VALUE;
-		}
+	uint32_t emitted = 0;
+	
+	while (time < end) {
+		emit_resampled(resampler, index, time);
+		emitted++;
+		
+		state->next += resampler->period;
+		time = (int64_t) state->next - state->offset;
 	}
 	
-	device_imu_callback(device, timestamp, DEVICE_IMU_EVENT_UPDATE);
-	return DEVICE_IMU_ERROR_NO_ERROR;
+	return emitted;
 }
 
-device_imu_vec3_type device_imu_get_earth_acceleration(const device_imu_ahrs_type* ahrs) {
-	FusionVector acceleration = ahrs? FusionAhrsGetEarthAcceleration((const FusionAhrs*) ahrs) : FUSION_VECTOR_ZERO;
-	device_imu_vec3_type a;
-	a.x = acceleration.axis.x;
-	a.y = acceleration.axis.y;
-	a.z = acceleration.axis.z;
-	return a;
+device_imu_error_type device_imu_resampler_retarget(device_imu_resampler_type* resampler, uint64_t period) {
+	if ((!resampler) || (!resampler->state)) {
+		device_imu_error("Resampler not initialized");
+		return DEVICE_IMU_ERROR_NOT_INITIALIZED;
+	}
+	
+	if (period == 0) {
+		device_imu_error("Invalid resampling");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
+	}
+	
+	device_imu_resampler_state_type* state = (device_imu_resampler_state_type*) resampler->state;
+	__atomic_store_n(&(state->retarget), period, __ATOMIC_RELEASE);
+	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
-device_imu_vec3_type device_imu_get_linear_acceleration(const device_imu_ahrs_type* ahrs) {
-	FusionVector acceleration = ahrs? FusionAhrsGetLinearAcceleration((const FusionAhrs*) ahrs) : FUSION_VECTOR_ZERO;
-	device_imu_vec3_type a;
-	a.x = acceleration.axis.x;
-	a.y = acceleration.axis.y;
-	a.z = acceleration.axis.z;
-	return a;
+static bool resampler_stage(device_imu_sample_type* sample, void* userdata) {
+	device_imu_resampler_process((device_imu_resampler_type*) userdata, sample);
+	return true;
 }
 
-device_imu_quat_type device_imu_get_orientation(const device_imu_ahrs_type* ahrs) {
-	FusionQuaternion quaternion = ahrs? FusionAhrsGetQuaternion((const FusionAhrs*) ahrs) : FUSION_IDENTITY_QUATERNION;
-	device_imu_quat_type q;
-	q.x = quaternion.element.x;
-	q.y = quaternion.element.y;
-	q.z = quaternion.element.z;
-	q.w = quaternion.element.w;
-	return q;
+device_imu_error_type device_imu_resampler_attach(device_imu_resampler_type* resampler, device_imu_type* device) {
+	if ((!resampler) || (!resampler->state)) {
+		device_imu_error("Resampler not initialized");
+		return DEVICE_IMU_ERROR_NOT_INITIALIZED;
+	}
+	
+	return device_imu_add_stage(device, DEVICE_IMU_STAGE_POST_FUSION, resampler_stage, resampler);
 }
 
-device_imu_euler_type device_imu_get_euler(device_imu_quat_type quat) {
-	FusionQuaternion quaternion;
-	quaternion.element.x = quat.x;
-	quaternion.element.y = quat.y;
-	quaternion.element.z = quat.z;
-	quaternion.element.w = quat.w;
-	FusionEuler euler = FusionQuaternionToEuler(quaternion);
-	device_imu_euler_type e;
-	e.roll = euler.angle.roll;
-	e.pitch = euler.angle.pitch;
-	e.yaw = euler.angle.yaw;
-	return e;
+device_imu_error_type device_imu_resampler_free(device_imu_resampler_type* resampler) {
+	if (!resampler) {
+		device_imu_error("No resampler");
+		return DEVICE_IMU_ERROR_INVALID_VALUE;
+	}
+	
+	if (resampler->state) {
+		free(resampler->state);
+		resampler->state = NULL;
+	}
+	
+	return DEVICE_IMU_ERROR_NO_ERROR;
 }
 
 device_imu_error_type device_imu_close(device_imu_type* device) {
@@ -954,10 +3593,22 @@ device_imu_error_type device_imu_close(device_imu_type* device) {
 		return DEVICE_IMU_ERROR_NO_DEVICE;
 	}
 	
+	download_free(device);
+	device_imu_stop_capture(device);
+	device_imu_clear_stages(device);
+	
 	if (device->calibration) {
 		free(device->calibration);
 	}
 	
+	if (device->iron) {
+		free(device->iron);
+	}
+	
+	if (device->folded) {
+		free(device->folded);
+	}
+	
 	if (device->ahrs) {
 		free(device->ahrs);
 	}
@@ -965,14 +3616,32 @@ device_imu_error_type device_imu_close(device_imu_type* device) {
 	if (device->offset) {
 		free(device->offset);
 	}
+	
+	if (device->fixed) {
+		free(device->fixed);
+	}
+	
+	if (device->filter) {
+		free(device->filter);
+	}
+	
+	if (device->startup) {
+		free(device->startup);
+	}
 
 	if (device->handle) {
-		if ((!send_payload_msg_signal(device, DEVICE_IMU_MSG_START_IMU_DATA, 0x0)) ||
-			(!recv_payload_msg(device, DEVICE_IMU_MSG_START_IMU_DATA, 0, NULL))) {
+		const uint64_t start = device_time_now();
+		const uint64_t deadline = start + device->options.close_timeout * DEVICE_TIME_MS;
+		
+		if (!do_payload_msg_signal(device, DEVICE_IMU_MSG_START_IMU_DATA, 0x0, deadline)) {
 			device_imu_error("Failed sending payload to stop imu data stream");
 		}
 
 		hid_close(device->handle);
+
+#ifndef NDEBUG
+		printf("Closed IMU in %.1f ms\n", (double) (device_time_now() - start) / 1e6);
+#endif
 	}
 	
 	memset(device, 0, sizeof(device_imu_type));
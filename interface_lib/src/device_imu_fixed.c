@@ -0,0 +1,386 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "device_imu_fixed.h"
+
+#include <math.h>
+#include <string.h>
+
+#define FIXED_ONE(bits) (1LL << (bits))
+
+// Shifts right with rounding to the nearest value instead of towards negative infinity
+#define FIXED_SHIFT(value, bits) (((value) + (1LL << ((bits) - 1))) >> (bits))
+
+// Half of the conversion from °/s to rad/s (π / 360, Q2.30)
+#define FIXED_HALF_RADIANS ((int32_t) (0.00872664626 * 1073741824.0 + 0.5))
+
+// According to FusionOffset: (threshold: 3 °/s, timeout: 5 s, cutoff: 0.02 Hz)
+#define FIXED_OFFSET_THRESHOLD (3LL << DEVICE_IMU_FIXED_SENSOR)
+#define FIXED_OFFSET_TIMEOUT 5
+#define FIXED_OFFSET_CUTOFF 0.02
+
+// According to FusionAhrs: (initial gain: 10, initialisation: 3 s)
+#define FIXED_INITIAL_GAIN 10
+#define FIXED_INITIALISATION_PERIOD 3
+
+// Longest time step integrated at once (keeps the products within 64 bits)
+#define FIXED_MAX_DELTA (20ULL * 1000000ULL)
+
+static int32_t pack32bit_signed(const uint8_t* data) {
+	uint32_t unsigned_value = (data[0]) | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+	return ((int32_t) unsigned_value);
+}
+
+static int32_t pack24bit_signed(const uint8_t* data) {
+	uint32_t unsigned_value = (data[0]) | (data[1] << 8) | (data[2] << 16);
+	if ((data[2] & 0x80) != 0) unsigned_value |= (0xFF << 24);
+	return ((int32_t) unsigned_value);
+}
+
+static int16_t pack16bit_signed(const uint8_t* data) {
+	uint16_t unsigned_value = (data[1] << 8) | (data[0]);
+	return (int16_t) unsigned_value;
+}
+
+static uint32_t fixed_sqrt(uint64_t value) {
+	uint64_t result = 0;
+	uint64_t bit = 1ULL << 62;
+	
+	while (bit > value) {
+		bit >>= 2;
+	}
+	
+	while (bit) {
+		if (value >= result + bit) {
+			value -= result + bit;
+			result = (result >> 1) + bit;
+		} else {
+			result >>= 1;
+		}
+		
+		bit >>= 2;
+	}
+	
+	return (uint32_t) result;
+}
+
+static int64_t fixed_dot(const device_imu_fixed_vec3_type* a, const device_imu_fixed_vec3_type* b) {
+	return (int64_t) a->x * b->x + (int64_t) a->y * b->y + (int64_t) a->z * b->z;
+}
+
+static void fixed_normalise(device_imu_fixed_vec3_type* v, int bits) {
+	const uint32_t magnitude = fixed_sqrt((uint64_t) fixed_dot(v, v));
+	
+	if (!magnitude) {
+		return;
+	}
+	
+	// A single division for the reciprocal, which is in Q2.30 relative to the input format
+	const int64_t reciprocal = (FIXED_ONE(DEVICE_IMU_FIXED_UNIT + bits)) / magnitude;
+	
+	v->x = (int32_t) FIXED_SHIFT(v->x * reciprocal, bits);
+	v->y = (int32_t) FIXED_SHIFT(v->y * reciprocal, bits);
+	v->z = (int32_t) FIXED_SHIFT(v->z * reciprocal, bits);
+}
+
+static void fixed_decode(int32_t multiplier, int32_t divisor, const int32_t raw [3], device_imu_fixed_vec3_type* v) {
+	if (!divisor) {
+		memset(v, 0, sizeof(device_imu_fixed_vec3_type));
+		return;
+	}
+	
+	// The shared scale costs a single division per vector as long as it fits into the 32 bits
+	const int64_t scale = ((int64_t) multiplier << 32) / divisor;
+	
+	if ((scale <= INT32_MAX) && (scale >= -INT32_MAX)) {
+		v->x = (int32_t) FIXED_SHIFT(raw[0] * scale, 32 - DEVICE_IMU_FIXED_SENSOR);
+		v->y = (int32_t) FIXED_SHIFT(raw[1] * scale, 32 - DEVICE_IMU_FIXED_SENSOR);
+		v->z = (int32_t) FIXED_SHIFT(raw[2] * scale, 32 - DEVICE_IMU_FIXED_SENSOR);
+	} else {
+		v->x = (int32_t) (((int64_t) raw[0] * multiplier * FIXED_ONE(DEVICE_IMU_FIXED_SENSOR)) / divisor);
+		v->y = (int32_t) (((int64_t) raw[1] * multiplier * FIXED_ONE(DEVICE_IMU_FIXED_SENSOR)) / divisor);
+		v->z = (int32_t) (((int64_t) raw[2] * multiplier * FIXED_ONE(DEVICE_IMU_FIXED_SENSOR)) / divisor);
+	}
+}
+
+static void fixed_transform(const int32_t matrix [9], const device_imu_fixed_vec3_type* offset, device_imu_fixed_vec3_type* v) {
+	const int64_t x = v->x;
+	const int64_t y = v->y;
+	const int64_t z = v->z;
+	
+	v->x = (int32_t) FIXED_SHIFT(matrix[0] * x + matrix[1] * y + matrix[2] * z, DEVICE_IMU_FIXED_MATRIX) - offset->x;
+	v->y = (int32_t) FIXED_SHIFT(matrix[3] * x + matrix[4] * y + matrix[5] * z, DEVICE_IMU_FIXED_MATRIX) - offset->y;
+	v->z = (int32_t) FIXED_SHIFT(matrix[6] * x + matrix[7] * y + matrix[8] * z, DEVICE_IMU_FIXED_MATRIX) - offset->z;
+}
+
+static void fixed_set_inertial(const float matrix [9], const float offset [3], int32_t* fixed_matrix, device_imu_fixed_vec3_type* fixed_offset) {
+	for (int i = 0; i < 9; i++) {
+		fixed_matrix[i] = device_imu_fixed_from_float(matrix[i], DEVICE_IMU_FIXED_MATRIX);
+	}
+	
+	fixed_offset->x = device_imu_fixed_from_float(offset[0], DEVICE_IMU_FIXED_SENSOR);
+	fixed_offset->y = device_imu_fixed_from_float(offset[1], DEVICE_IMU_FIXED_SENSOR);
+	fixed_offset->z = device_imu_fixed_from_float(offset[2], DEVICE_IMU_FIXED_SENSOR);
+}
+
+void device_imu_fixed_init(device_imu_fixed_type* fixed,
+						   float gain,
+						   float rejection,
+						   uint32_t recovery_period,
+						   uint32_t sample_rate) {
+	memset(fixed, 0, sizeof(device_imu_fixed_type));
+	
+	const float identity [9] = {
+			1.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 1.0f
+	};
+	
+	const float zero [3] = { 0.0f, 0.0f, 0.0f };
+	
+	device_imu_fixed_set_calibration(fixed, identity, zero, identity, zero, 0);
+	
+	fixed->orientation.w = (int32_t) FIXED_ONE(DEVICE_IMU_FIXED_UNIT);
+	fixed->offset_timeout = FIXED_OFFSET_TIMEOUT * sample_rate;
+	fixed->offset_coefficient = device_imu_fixed_from_float(
+			6.283185307f * FIXED_OFFSET_CUTOFF / (float) sample_rate,
+			DEVICE_IMU_FIXED_UNIT
+	);
+	
+	fixed->gain = device_imu_fixed_from_float(gain, DEVICE_IMU_FIXED_SENSOR);
+	fixed->ramped_gain = (int32_t) (FIXED_INITIAL_GAIN * FIXED_ONE(DEVICE_IMU_FIXED_SENSOR));
+	fixed->ramped_gain_step = (fixed->ramped_gain - fixed->gain) / FIXED_INITIALISATION_PERIOD;
+	fixed->initialising = true;
+	
+	// Same as FusionAhrs: (rejection threshold of the half feedback magnitude squared)
+	const float threshold = 0.5f * sinf(rejection * 0.01745329252f);
+	fixed->rejection = (int64_t) ((double) (threshold * threshold) * (double) FIXED_ONE(2 * DEVICE_IMU_FIXED_UNIT));
+	fixed->recovery_period = recovery_period;
+	fixed->recovery_timeout = recovery_period;
+}
+
+void device_imu_fixed_set_calibration(device_imu_fixed_type* fixed,
+									  const float gyroscope_matrix [9],
+									  const float gyroscope_offset [3],
+									  const float accelerometer_matrix [9],
+									  const float accelerometer_offset [3],
+									  uint32_t version) {
+	fixed_set_inertial(
+			gyroscope_matrix,
+			gyroscope_offset,
+			fixed->calibration.gyroscope_matrix,
+			&(fixed->calibration.gyroscope_offset)
+	);
+	
+	fixed_set_inertial(
+			accelerometer_matrix,
+			accelerometer_offset,
+			fixed->calibration.accelerometer_matrix,
+			&(fixed->calibration.accelerometer_offset)
+	);
+	
+	fixed->calibration_version = version;
+}
+
+void device_imu_fixed_decode(const device_imu_packet_type* packet,
+							 device_imu_fixed_vec3_type* gyroscope,
+							 device_imu_fixed_vec3_type* accelerometer) {
+	const int32_t angular_velocity [3] = {
+			pack24bit_signed(packet->angular_velocity_x),
+			pack24bit_signed(packet->angular_velocity_y),
+			pack24bit_signed(packet->angular_velocity_z)
+	};
+	
+	const int32_t acceleration [3] = {
+			pack24bit_signed(packet->acceleration_x),
+			pack24bit_signed(packet->acceleration_y),
+			pack24bit_signed(packet->acceleration_z)
+	};
+	
+	fixed_decode(
+			pack16bit_signed(packet->angular_multiplier),
+			pack32bit_signed(packet->angular_divisor),
+			angular_velocity,
+			gyroscope
+	);
+	
+	fixed_decode(
+			pack16bit_signed(packet->acceleration_multiplier),
+			pack32bit_signed(packet->acceleration_divisor),
+			acceleration,
+			accelerometer
+	);
+}
+
+void device_imu_fixed_calibrate(const device_imu_fixed_type* fixed,
+								device_imu_fixed_vec3_type* gyroscope,
+								device_imu_fixed_vec3_type* accelerometer) {
+	fixed_transform(fixed->calibration.gyroscope_matrix, &(fixed->calibration.gyroscope_offset), gyroscope);
+	fixed_transform(fixed->calibration.accelerometer_matrix, &(fixed->calibration.accelerometer_offset), accelerometer);
+}
+
+void device_imu_fixed_offset(device_imu_fixed_type* fixed, device_imu_fixed_vec3_type* gyroscope) {
+	gyroscope->x -= (int32_t) FIXED_SHIFT(fixed->offset[0], 32 - DEVICE_IMU_FIXED_SENSOR);
+	gyroscope->y -= (int32_t) FIXED_SHIFT(fixed->offset[1], 32 - DEVICE_IMU_FIXED_SENSOR);
+	gyroscope->z -= (int32_t) FIXED_SHIFT(fixed->offset[2], 32 - DEVICE_IMU_FIXED_SENSOR);
+	
+	if ((gyroscope->x > FIXED_OFFSET_THRESHOLD) || (gyroscope->x < -FIXED_OFFSET_THRESHOLD) ||
+		(gyroscope->y > FIXED_OFFSET_THRESHOLD) || (gyroscope->y < -FIXED_OFFSET_THRESHOLD) ||
+		(gyroscope->z > FIXED_OFFSET_THRESHOLD) || (gyroscope->z < -FIXED_OFFSET_THRESHOLD)) {
+		fixed->offset_timer = 0;
+		return;
+	}
+	
+	if (fixed->offset_timer < fixed->offset_timeout) {
+		fixed->offset_timer++;
+		return;
+	}
+	
+	// The drift gets accumulated with 16 extra fractional bits, otherwise the tiny filter steps would vanish
+	const int64_t coefficient = fixed->offset_coefficient;
+	
+	fixed->offset[0] += FIXED_SHIFT(gyroscope->x * coefficient, DEVICE_IMU_FIXED_SENSOR + DEVICE_IMU_FIXED_UNIT - 32);
+	fixed->offset[1] += FIXED_SHIFT(gyroscope->y * coefficient, DEVICE_IMU_FIXED_SENSOR + DEVICE_IMU_FIXED_UNIT - 32);
+	fixed->offset[2] += FIXED_SHIFT(gyroscope->z * coefficient, DEVICE_IMU_FIXED_SENSOR + DEVICE_IMU_FIXED_UNIT - 32);
+}
+
+void device_imu_fixed_update(device_imu_fixed_type* fixed,
+							 const device_imu_fixed_vec3_type* gyroscope,
+							 const device_imu_fixed_vec3_type* accelerometer,
+							 uint64_t delta) {
+	if (delta > FIXED_MAX_DELTA) {
+		delta = FIXED_MAX_DELTA;
+	}
+	
+	// Time step in seconds (Q4.28)
+	const int64_t dt = (int64_t) (((delta << DEVICE_IMU_FIXED_MATRIX) + 500000000ULL) / 1000000000ULL);
+	
+	if (fixed->initialising) {
+		fixed->ramped_gain -= (int32_t) FIXED_SHIFT(fixed->ramped_gain_step * dt, DEVICE_IMU_FIXED_MATRIX);
+		
+		if ((fixed->ramped_gain < fixed->gain) || (!fixed->gain)) {
+			fixed->ramped_gain = fixed->gain;
+			fixed->initialising = false;
+		}
+	}
+	
+	const int64_t w = fixed->orientation.w;
+	const int64_t x = fixed->orientation.x;
+	const int64_t y = fixed->orientation.y;
+	const int64_t z = fixed->orientation.z;
+	
+	// Half of the gravity direction in the sensor frame for NED (same as FusionAhrs)
+	device_imu_fixed_vec3_type gravity;
+	gravity.x = (int32_t) FIXED_SHIFT(w * y - x * z, DEVICE_IMU_FIXED_UNIT);
+	gravity.y = (int32_t) -FIXED_SHIFT(y * z + w * x, DEVICE_IMU_FIXED_UNIT);
+	gravity.z = (int32_t) (FIXED_ONE(DEVICE_IMU_FIXED_UNIT - 1) - FIXED_SHIFT(w * w + z * z, DEVICE_IMU_FIXED_UNIT));
+	
+	device_imu_fixed_vec3_type feedback;
+	memset(&feedback, 0, sizeof(feedback));
+	
+	fixed->accelerometer_ignored = true;
+	
+	if ((accelerometer->x) || (accelerometer->y) || (accelerometer->z)) {
+		device_imu_fixed_vec3_type a = *accelerometer;
+		
+		fixed_normalise(&a, DEVICE_IMU_FIXED_SENSOR);
+		
+		feedback.x = (int32_t) FIXED_SHIFT((int64_t) a.y * gravity.z - (int64_t) a.z * gravity.y, DEVICE_IMU_FIXED_UNIT);
+		feedback.y = (int32_t) FIXED_SHIFT((int64_t) a.z * gravity.x - (int64_t) a.x * gravity.z, DEVICE_IMU_FIXED_UNIT);
+		feedback.z = (int32_t) FIXED_SHIFT((int64_t) a.x * gravity.y - (int64_t) a.y * gravity.x, DEVICE_IMU_FIXED_UNIT);
+		
+		// Beyond 90° of error only the direction of the correction is meaningful
+		if (fixed_dot(&a, &gravity) < 0) {
+			fixed_normalise(&feedback, DEVICE_IMU_FIXED_UNIT);
+		}
+		
+		fixed->feedback = feedback;
+		
+		int64_t trigger = fixed->recovery_trigger;
+		
+		// Rejected feedback builds up a trigger, accepted feedback drains it nine times as fast
+		if ((fixed->initialising) || (fixed_dot(&feedback, &feedback) <= fixed->rejection)) {
+			fixed->accelerometer_ignored = false;
+			trigger -= 9;
+		} else {
+			trigger += 1;
+		}
+		
+		// Same as FusionAhrs: once the trigger exceeds the timeout, feedback is used until the trigger drained again
+		if (trigger > fixed->recovery_timeout) {
+			fixed->recovery_timeout = 0;
+			fixed->accelerometer_ignored = false;
+		} else {
+			fixed->recovery_timeout = fixed->recovery_period;
+		}
+		
+		if (trigger < 0) {
+			trigger = 0;
+		} else if (trigger > fixed->recovery_period) {
+			trigger = fixed->recovery_period;
+		}
+		
+		fixed->recovery_trigger = (uint32_t) trigger;
+		
+		if (fixed->accelerometer_ignored) {
+			memset(&feedback, 0, sizeof(feedback));
+		}
+	}
+	
+	const int64_t gain = fixed->ramped_gain;
+	
+	// Half of the rotation during the time step in radians (Q2.30)
+	const int64_t rx = FIXED_SHIFT((FIXED_SHIFT(gyroscope->x * (int64_t) FIXED_HALF_RADIANS, DEVICE_IMU_FIXED_SENSOR) +
+									FIXED_SHIFT(feedback.x * gain, DEVICE_IMU_FIXED_SENSOR)) * dt, DEVICE_IMU_FIXED_MATRIX);
+	const int64_t ry = FIXED_SHIFT((FIXED_SHIFT(gyroscope->y * (int64_t) FIXED_HALF_RADIANS, DEVICE_IMU_FIXED_SENSOR) +
+									FIXED_SHIFT(feedback.y * gain, DEVICE_IMU_FIXED_SENSOR)) * dt, DEVICE_IMU_FIXED_MATRIX);
+	const int64_t rz = FIXED_SHIFT((FIXED_SHIFT(gyroscope->z * (int64_t) FIXED_HALF_RADIANS, DEVICE_IMU_FIXED_SENSOR) +
+									FIXED_SHIFT(feedback.z * gain, DEVICE_IMU_FIXED_SENSOR)) * dt, DEVICE_IMU_FIXED_MATRIX);
+	
+	const int64_t qw = w + FIXED_SHIFT(-x * rx - y * ry - z * rz, DEVICE_IMU_FIXED_UNIT);
+	const int64_t qx = x + FIXED_SHIFT(w * rx + y * rz - z * ry, DEVICE_IMU_FIXED_UNIT);
+	const int64_t qy = y + FIXED_SHIFT(w * ry - x * rz + z * rx, DEVICE_IMU_FIXED_UNIT);
+	const int64_t qz = z + FIXED_SHIFT(w * rz + x * ry - y * rx, DEVICE_IMU_FIXED_UNIT);
+	
+	// The quaternion stays close to unit length, so a single Newton step of the inverse square root normalises it
+	const int64_t norm = FIXED_SHIFT(qw * qw + qx * qx + qy * qy + qz * qz, DEVICE_IMU_FIXED_UNIT);
+	const int64_t scale = (3 * FIXED_ONE(DEVICE_IMU_FIXED_UNIT) - norm) / 2;
+	
+	fixed->orientation.w = (int32_t) FIXED_SHIFT(qw * scale, DEVICE_IMU_FIXED_UNIT);
+	fixed->orientation.x = (int32_t) FIXED_SHIFT(qx * scale, DEVICE_IMU_FIXED_UNIT);
+	fixed->orientation.y = (int32_t) FIXED_SHIFT(qy * scale, DEVICE_IMU_FIXED_UNIT);
+	fixed->orientation.z = (int32_t) FIXED_SHIFT(qz * scale, DEVICE_IMU_FIXED_UNIT);
+}
+
+void device_imu_fixed_integrate(device_imu_fixed_type* fixed, const device_imu_fixed_vec3_type* gyroscope, uint64_t delta) {
+	const device_imu_fixed_vec3_type zero = { 0, 0, 0 };
+	
+	// Longer gaps get split up, so none of the rotation is lost to the clamped time step
+	while (delta > 0) {
+		const uint64_t step = (delta > FIXED_MAX_DELTA? FIXED_MAX_DELTA : delta);
+		
+		device_imu_fixed_update(fixed, gyroscope, &zero, step);
+		delta -= step;
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_imu.h"
+
+// Fractional bits of the formats used by the fixed-point path
+#define DEVICE_IMU_FIXED_SENSOR 16 // (Q16.16 for °/s and g)
+#define DEVICE_IMU_FIXED_MATRIX 28 // (Q4.28 for calibration matrices)
+#define DEVICE_IMU_FIXED_UNIT 30 // (Q2.30 for quaternions and unit vectors)
+
+struct device_imu_fixed_vec3_t {
+	int32_t x;
+	int32_t y;
+	int32_t z;
+};
+
+struct device_imu_fixed_quat_t {
+	int32_t x;
+	int32_t y;
+	int32_t z;
+	int32_t w;
+};
+
+struct device_imu_fixed_calibration_t {
+	int32_t gyroscope_matrix [9]; // (axes swaps, misalignment and sensitivity folded in, row-major)
+	struct device_imu_fixed_vec3_t gyroscope_offset;
+	
+	int32_t accelerometer_matrix [9];
+	struct device_imu_fixed_vec3_t accelerometer_offset;
+};
+
+struct device_imu_fixed_t {
+	uint32_t calibration_version; // (of the calibration folded into the matrices)
+	struct device_imu_fixed_calibration_t calibration;
+	
+	struct device_imu_fixed_quat_t orientation;
+	
+	int64_t offset [3]; // (gyroscope drift, Q32.32 in °/s)
+	uint32_t offset_timer;
+	uint32_t offset_timeout;
+	int32_t offset_coefficient;
+	
+	int32_t gain;
+	int32_t ramped_gain;
+	int32_t ramped_gain_step; // (per second)
+	bool initialising;
+	
+	int64_t rejection; // (squared feedback magnitude rejecting the accelerometer, Q4.60)
+	struct device_imu_fixed_vec3_t feedback; // (half of the accelerometer feedback before the rejection, Q2.30)
+	bool accelerometer_ignored;
+	uint32_t recovery_trigger;
+	uint32_t recovery_timeout; // (drops to zero while recovering, same as FusionAhrs)
+	uint32_t recovery_period;
+};
+
+typedef struct device_imu_fixed_vec3_t device_imu_fixed_vec3_type;
+typedef struct device_imu_fixed_quat_t device_imu_fixed_quat_type;
+typedef struct device_imu_fixed_calibration_t device_imu_fixed_calibration_type;
+typedef struct device_imu_fixed_t device_imu_fixed_type;
+
+static inline int32_t device_imu_fixed_from_float(float value, int bits) {
+	const float scaled = value * (float) (1LL << bits);
+	return (int32_t) (scaled < 0.0f? scaled - 0.5f : scaled + 0.5f);
+}
+
+static inline float device_imu_fixed_to_float(int32_t value, int bits) {
+	return (float) value / (float) (1LL << bits);
+}
+
+void device_imu_fixed_init(device_imu_fixed_type* fixed,
+						   float gain,
+						   float rejection,
+						   uint32_t recovery_period,
+						   uint32_t sample_rate);
+
+void device_imu_fixed_set_calibration(device_imu_fixed_type* fixed,
+									  const float gyroscope_matrix [9],
+									  const float gyroscope_offset [3],
+									  const float accelerometer_matrix [9],
+									  const float accelerometer_offset [3],
+									  uint32_t version);
+
+void device_imu_fixed_decode(const device_imu_packet_type* packet,
+							 device_imu_fixed_vec3_type* gyroscope,
+							 device_imu_fixed_vec3_type* accelerometer);
+
+void device_imu_fixed_calibrate(const device_imu_fixed_type* fixed,
+								device_imu_fixed_vec3_type* gyroscope,
+								device_imu_fixed_vec3_type* accelerometer);
+
+void device_imu_fixed_offset(device_imu_fixed_type* fixed, device_imu_fixed_vec3_type* gyroscope);
+
+void device_imu_fixed_update(device_imu_fixed_type* fixed,
+							 const device_imu_fixed_vec3_type* gyroscope,
+							 const device_imu_fixed_vec3_type* accelerometer,
+							 uint64_t delta);
+
+void device_imu_fixed_integrate(device_imu_fixed_type* fixed, const device_imu_fixed_vec3_type* gyroscope, uint64_t delta);
@@ -0,0 +1,472 @@
+#pragma once
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Fusion/FusionMath.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+
+#if defined(__SSE__) && !defined(DEVICE_MATH_SCALAR)
+#include <xmmintrin.h>
+#define DEVICE_MATH_SSE
+#elif defined(__ARM_NEON) && !defined(DEVICE_MATH_SCALAR)
+#include <arm_neon.h>
+#define DEVICE_MATH_NEON
+#endif
+
+// Affine transformation with the linear part in the first three columns and the translation in the last
+struct device_math_affine_t {
+	float columns [4][4]; // (fourth row is padding for full vector loads)
+};
+
+typedef struct device_math_affine_t device_math_affine_type;
+
+static inline void device_math_affine_identity(device_math_affine_type* affine) {
+	for (int j = 0; j < 4; j++) {
+		for (int i = 0; i < 4; i++) {
+			affine->columns[j][i] = (i == j) && (j < 3)? 1.0f : 0.0f;
+		}
+	}
+}
+
+static inline FusionVector device_math_affine_apply(const device_math_affine_type* affine, const FusionVector v) {
+	FusionVector res;
+	
+#if defined(DEVICE_MATH_SSE)
+	__m128 r = _mm_loadu_ps(affine->columns[3]);
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(affine->columns[0]), _mm_set1_ps(v.axis.x)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(affine->columns[1]), _mm_set1_ps(v.axis.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(affine->columns[2]), _mm_set1_ps(v.axis.z)));
+	
+	float out [4];
+	_mm_storeu_ps(out, r);
+	
+	res.axis.x = out[0];
+	res.axis.y = out[1];
+	res.axis.z = out[2];
+#elif defined(DEVICE_MATH_NEON)
+	float32x4_t r = vld1q_f32(affine->columns[3]);
+	r = vmlaq_n_f32(r, vld1q_f32(affine->columns[0]), v.axis.x);
+	r = vmlaq_n_f32(r, vld1q_f32(affine->columns[1]), v.axis.y);
+	r = vmlaq_n_f32(r, vld1q_f32(affine->columns[2]), v.axis.z);
+	
+	res.axis.x = vgetq_lane_f32(r, 0);
+	res.axis.y = vgetq_lane_f32(r, 1);
+	res.axis.z = vgetq_lane_f32(r, 2);
+#else
+	for (int i = 0; i < 3; i++) {
+		res.array[i] = affine->columns[3][i] +
+				affine->columns[0][i] * v.axis.x +
+				affine->columns[1][i] * v.axis.y +
+				affine->columns[2][i] * v.axis.z;
+	}
+#endif
+	
+	return res;
+}
+
+static inline float device_math_quaternion_dot(const FusionQuaternion a, const FusionQuaternion b) {
+	return a.element.w * b.element.w + a.element.x * b.element.x + a.element.y * b.element.y + a.element.z * b.element.z;
+}
+
+// Same as FusionQuaternionMultiply, but inlined and with the products combined lane by lane
+static inline FusionQuaternion device_math_quaternion_multiply(const FusionQuaternion a, const FusionQuaternion b) {
+	FusionQuaternion res;
+	
+#if defined(DEVICE_MATH_SSE)
+	const __m128 q = _mm_loadu_ps(b.array);
+	
+	__m128 r = _mm_mul_ps(_mm_set1_ps(a.element.w), q);
+	r = _mm_add_ps(r, _mm_mul_ps(
+			_mm_mul_ps(_mm_set1_ps(a.element.x), _mm_shuffle_ps(q, q, _MM_SHUFFLE(2, 3, 0, 1))),
+			_mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f)
+	));
+	r = _mm_add_ps(r, _mm_mul_ps(
+			_mm_mul_ps(_mm_set1_ps(a.element.y), _mm_shuffle_ps(q, q, _MM_SHUFFLE(1, 0, 3, 2))),
+			_mm_setr_ps(-1.0f, 1.0f, 1.0f, -1.0f)
+	));
+	r = _mm_add_ps(r, _mm_mul_ps(
+			_mm_mul_ps(_mm_set1_ps(a.element.z), _mm_shuffle_ps(q, q, _MM_SHUFFLE(0, 1, 2, 3))),
+			_mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f)
+	));
+	
+	_mm_storeu_ps(res.array, r);
+#elif defined(DEVICE_MATH_NEON)
+	static const float signs [3][4] = {
+			{ -1.0f, 1.0f, -1.0f, 1.0f },
+			{ -1.0f, 1.0f, 1.0f, -1.0f },
+			{ -1.0f, -1.0f, 1.0f, 1.0f }
+	};
+	
+	const float32x4_t q = vld1q_f32(b.array);
+	const float32x4_t swapped = vextq_f32(q, q, 2);
+	
+	float32x4_t r = vmulq_n_f32(q, a.element.w);
+	r = vmlaq_n_f32(r, vmulq_f32(vrev64q_f32(q), vld1q_f32(signs[0])), a.element.x);
+	r = vmlaq_n_f32(r, vmulq_f32(swapped, vld1q_f32(signs[1])), a.element.y);
+	r = vmlaq_n_f32(r, vmulq_f32(vrev64q_f32(swapped), vld1q_f32(signs[2])), a.element.z);
+	
+	vst1q_f32(res.array, r);
+#else
+	res.element.w = a.element.w * b.element.w - a.element.x * b.element.x - a.element.y * b.element.y - a.element.z * b.element.z;
+	res.element.x = a.element.w * b.element.x + a.element.x * b.element.w + a.element.y * b.element.z - a.element.z * b.element.y;
+	res.element.y = a.element.w * b.element.y - a.element.x * b.element.z + a.element.y * b.element.w + a.element.z * b.element.x;
+	res.element.z = a.element.w * b.element.z + a.element.x * b.element.y - a.element.y * b.element.x + a.element.z * b.element.w;
+#endif
+	
+	return res;
+}
+
+// Uses the exact square root, unlike FusionQuaternionNormalise with its fast inverse square root by default
+static inline FusionQuaternion device_math_quaternion_normalise(const FusionQuaternion q) {
+	const float scale = 1.0f / sqrtf(device_math_quaternion_dot(q, q));
+	FusionQuaternion res;
+	
+#if defined(DEVICE_MATH_SSE)
+	_mm_storeu_ps(res.array, _mm_mul_ps(_mm_loadu_ps(q.array), _mm_set1_ps(scale)));
+#elif defined(DEVICE_MATH_NEON)
+	vst1q_f32(res.array, vmulq_n_f32(vld1q_f32(q.array), scale));
+#else
+	for (int i = 0; i < 4; i++) {
+		res.array[i] = q.array[i] * scale;
+	}
+#endif
+	
+	return res;
+}
+
+// Spherical interpolation along the shorter arc, falls back to a normalised lerp for nearly equal rotations
+static inline FusionQuaternion device_math_quaternion_slerp(const FusionQuaternion a, FusionQuaternion b, float t) {
+	float cosine = device_math_quaternion_dot(a, b);
+	
+	if (cosine < 0.0f) {
+		for (int i = 0; i < 4; i++) {
+			b.array[i] = -b.array[i];
+		}
+		
+		cosine = -cosine;
+	}
+	
+	float wa = 1.0f - t;
+	float wb = t;
+	
+	if (cosine < 0.9995f) {
+		const float angle = acosf(cosine);
+		const float scale = 1.0f / sinf(angle);
+		
+		wa = sinf(wa * angle) * scale;
+		wb = sinf(wb * angle) * scale;
+	}
+	
+	FusionQuaternion res;
+	
+	for (int i = 0; i < 4; i++) {
+		res.array[i] = wa * a.array[i] + wb * b.array[i];
+	}
+	
+	return device_math_quaternion_normalise(res);
+}
+
+// Four lanes of floats with the operations needed by the batch conversions, the fallback processes them one by one
+#if defined(DEVICE_MATH_SSE)
+typedef __m128 device_math_f4;
+typedef __m128 device_math_m4;
+
+static inline device_math_f4 device_math_f4_set(float v) { return _mm_set1_ps(v); }
+static inline device_math_f4 device_math_f4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void device_math_f4_store(float* p, device_math_f4 v) { _mm_storeu_ps(p, v); }
+
+static inline device_math_f4 device_math_f4_add(device_math_f4 a, device_math_f4 b) { return _mm_add_ps(a, b); }
+static inline device_math_f4 device_math_f4_sub(device_math_f4 a, device_math_f4 b) { return _mm_sub_ps(a, b); }
+static inline device_math_f4 device_math_f4_mul(device_math_f4 a, device_math_f4 b) { return _mm_mul_ps(a, b); }
+static inline device_math_f4 device_math_f4_div(device_math_f4 a, device_math_f4 b) { return _mm_div_ps(a, b); }
+static inline device_math_f4 device_math_f4_min(device_math_f4 a, device_math_f4 b) { return _mm_min_ps(a, b); }
+static inline device_math_f4 device_math_f4_max(device_math_f4 a, device_math_f4 b) { return _mm_max_ps(a, b); }
+static inline device_math_f4 device_math_f4_sqrt(device_math_f4 v) { return _mm_sqrt_ps(v); }
+static inline device_math_f4 device_math_f4_abs(device_math_f4 v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+
+static inline device_math_f4 device_math_f4_copysign(device_math_f4 magnitude, device_math_f4 sign) {
+	const __m128 mask = _mm_set1_ps(-0.0f);
+	return _mm_or_ps(_mm_andnot_ps(mask, magnitude), _mm_and_ps(mask, sign));
+}
+
+static inline device_math_m4 device_math_f4_less(device_math_f4 a, device_math_f4 b) { return _mm_cmplt_ps(a, b); }
+
+static inline device_math_f4 device_math_f4_select(device_math_m4 mask, device_math_f4 a, device_math_f4 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#elif defined(DEVICE_MATH_NEON)
+typedef float32x4_t device_math_f4;
+typedef uint32x4_t device_math_m4;
+
+static inline device_math_f4 device_math_f4_set(float v) { return vdupq_n_f32(v); }
+static inline device_math_f4 device_math_f4_load(const float* p) { return vld1q_f32(p); }
+static inline void device_math_f4_store(float* p, device_math_f4 v) { vst1q_f32(p, v); }
+
+static inline device_math_f4 device_math_f4_add(device_math_f4 a, device_math_f4 b) { return vaddq_f32(a, b); }
+static inline device_math_f4 device_math_f4_sub(device_math_f4 a, device_math_f4 b) { return vsubq_f32(a, b); }
+static inline device_math_f4 device_math_f4_mul(device_math_f4 a, device_math_f4 b) { return vmulq_f32(a, b); }
+static inline device_math_f4 device_math_f4_min(device_math_f4 a, device_math_f4 b) { return vminq_f32(a, b); }
+static inline device_math_f4 device_math_f4_max(device_math_f4 a, device_math_f4 b) { return vmaxq_f32(a, b); }
+static inline device_math_f4 device_math_f4_abs(device_math_f4 v) { return vabsq_f32(v); }
+
+static inline device_math_f4 device_math_f4_copysign(device_math_f4 magnitude, device_math_f4 sign) {
+	return vbslq_f32(vdupq_n_u32(0x80000000), sign, magnitude);
+}
+
+static inline device_math_m4 device_math_f4_less(device_math_f4 a, device_math_f4 b) { return vcltq_f32(a, b); }
+
+static inline device_math_f4 device_math_f4_select(device_math_m4 mask, device_math_f4 a, device_math_f4 b) {
+	return vbslq_f32(mask, a, b);
+}
+
+#if defined(__aarch64__)
+static inline device_math_f4 device_math_f4_div(device_math_f4 a, device_math_f4 b) { return vdivq_f32(a, b); }
+static inline device_math_f4 device_math_f4_sqrt(device_math_f4 v) { return vsqrtq_f32(v); }
+#else
+// ARMv7 has no vector division or square root, two Newton steps refine the estimates to full precision
+static inline device_math_f4 device_math_f4_div(device_math_f4 a, device_math_f4 b) {
+	float32x4_t r = vrecpeq_f32(b);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	return vmulq_f32(a, r);
+}
+
+static inline device_math_f4 device_math_f4_sqrt(device_math_f4 v) {
+	float32x4_t r = vrsqrteq_f32(v);
+	r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, r), r), r);
+	r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, r), r), r);
+	return vbslq_f32(vcgtq_f32(v, vdupq_n_f32(0.0f)), vmulq_f32(v, r), vdupq_n_f32(0.0f));
+}
+#endif
+#else
+struct device_math_f4_t {
+	float v [4];
+};
+
+struct device_math_m4_t {
+	bool v [4];
+};
+
+typedef struct device_math_f4_t device_math_f4;
+typedef struct device_math_m4_t device_math_m4;
+
+#define DEVICE_MATH_F4_MAP(expression) \
+	device_math_f4 r; for (int i = 0; i < 4; i++) { r.v[i] = (expression); } return r
+
+static inline device_math_f4 device_math_f4_set(float v) { DEVICE_MATH_F4_MAP(v); }
+static inline device_math_f4 device_math_f4_load(const float* p) { DEVICE_MATH_F4_MAP(p[i]); }
+static inline void device_math_f4_store(float* p, device_math_f4 v) { for (int i = 0; i < 4; i++) { p[i] = v.v[i]; } }
+
+static inline device_math_f4 device_math_f4_add(device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(a.v[i] + b.v[i]); }
+static inline device_math_f4 device_math_f4_sub(device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(a.v[i] - b.v[i]); }
+static inline device_math_f4 device_math_f4_mul(device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(a.v[i] * b.v[i]); }
+static inline device_math_f4 device_math_f4_div(device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(a.v[i] / b.v[i]); }
+static inline device_math_f4 device_math_f4_min(device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(a.v[i] < b.v[i]? a.v[i] : b.v[i]); }
+static inline device_math_f4 device_math_f4_max(device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(a.v[i] > b.v[i]? a.v[i] : b.v[i]); }
+static inline device_math_f4 device_math_f4_sqrt(device_math_f4 v) { DEVICE_MATH_F4_MAP(sqrtf(v.v[i])); }
+static inline device_math_f4 device_math_f4_abs(device_math_f4 v) { DEVICE_MATH_F4_MAP(fabsf(v.v[i])); }
+static inline device_math_f4 device_math_f4_copysign(device_math_f4 magnitude, device_math_f4 sign) { DEVICE_MATH_F4_MAP(copysignf(magnitude.v[i], sign.v[i])); }
+
+static inline device_math_m4 device_math_f4_less(device_math_f4 a, device_math_f4 b) {
+	device_math_m4 r;
+	for (int i = 0; i < 4; i++) { r.v[i] = (a.v[i] < b.v[i]); }
+	return r;
+}
+
+static inline device_math_f4 device_math_f4_select(device_math_m4 mask, device_math_f4 a, device_math_f4 b) { DEVICE_MATH_F4_MAP(mask.v[i]? a.v[i] : b.v[i]); }
+
+#undef DEVICE_MATH_F4_MAP
+#endif
+
+// According to Abramowitz and Stegun 4.4.49: (atan(x) / x on [0, 1] with an absolute error of at most 2e-8 rad)
+static inline device_math_f4 device_math_f4_atan2(device_math_f4 y, device_math_f4 x) {
+	const device_math_f4 ax = device_math_f4_abs(x);
+	const device_math_f4 ay = device_math_f4_abs(y);
+	
+	const device_math_f4 lo = device_math_f4_min(ax, ay);
+	const device_math_f4 hi = device_math_f4_max(ax, ay);
+	
+	// Both being zero results in zero like atan2f, the divisor only gets replaced to avoid NaN
+	const device_math_f4 divisor = device_math_f4_select(
+			device_math_f4_less(hi, device_math_f4_set(FLT_MIN)),
+			device_math_f4_set(1.0f),
+			hi
+	);
+	
+	const device_math_f4 a = device_math_f4_div(lo, divisor);
+	const device_math_f4 s = device_math_f4_mul(a, a);
+	
+	static const float coefficients [] = {
+			+0.0028662257f, -0.0161657367f, +0.0429096138f, -0.0752896400f,
+			+0.1065626393f, -0.1420889944f, +0.1999355085f, -0.3333314528f,
+			+1.0f
+	};
+	
+	device_math_f4 p = device_math_f4_set(coefficients[0]);
+	
+	for (int i = 1; i < (int) (sizeof(coefficients) / sizeof(coefficients[0])); i++) {
+		p = device_math_f4_add(device_math_f4_mul(p, s), device_math_f4_set(coefficients[i]));
+	}
+	
+	device_math_f4 r = device_math_f4_mul(p, a);
+	
+	r = device_math_f4_select(device_math_f4_less(ax, ay), device_math_f4_sub(device_math_f4_set(1.5707963268f), r), r);
+	r = device_math_f4_select(device_math_f4_less(x, device_math_f4_set(0.0f)), device_math_f4_sub(device_math_f4_set(3.1415926536f), r), r);
+	
+	return device_math_f4_copysign(r, y);
+}
+
+// Same as FusionQuaternionToEuler for four quaternions at once (in degrees)
+static inline void device_math_f4_euler(device_math_f4 x,
+										device_math_f4 y,
+										device_math_f4 z,
+										device_math_f4 w,
+										device_math_f4* roll,
+										device_math_f4* pitch,
+										device_math_f4* yaw) {
+	const device_math_f4 degrees = device_math_f4_set(57.295779513f);
+	const device_math_f4 half = device_math_f4_sub(device_math_f4_set(0.5f), device_math_f4_mul(y, y));
+	
+	*roll = device_math_f4_mul(degrees, device_math_f4_atan2(
+			device_math_f4_add(device_math_f4_mul(w, x), device_math_f4_mul(y, z)),
+			device_math_f4_sub(half, device_math_f4_mul(x, x))
+	));
+	
+	// The arcsine is evaluated as an arctangent, clamping keeps the result at ±90° like FusionAsin
+	device_math_f4 s = device_math_f4_mul(
+			device_math_f4_set(2.0f),
+			device_math_f4_sub(device_math_f4_mul(w, y), device_math_f4_mul(z, x))
+	);
+	
+	s = device_math_f4_min(device_math_f4_max(s, device_math_f4_set(-1.0f)), device_math_f4_set(1.0f));
+	
+	*pitch = device_math_f4_mul(degrees, device_math_f4_atan2(
+			s,
+			device_math_f4_sqrt(device_math_f4_max(
+					device_math_f4_sub(device_math_f4_set(1.0f), device_math_f4_mul(s, s)),
+					device_math_f4_set(0.0f)
+			))
+	));
+	
+	*yaw = device_math_f4_mul(degrees, device_math_f4_atan2(
+			device_math_f4_add(device_math_f4_mul(w, z), device_math_f4_mul(x, y)),
+			device_math_f4_sub(half, device_math_f4_mul(z, z))
+	));
+}
+
+// Same as FusionQuaternionToMatrix for four quaternions at once (row-major)
+static inline void device_math_f4_matrix(device_math_f4 x,
+										 device_math_f4 y,
+										 device_math_f4 z,
+										 device_math_f4 w,
+										 device_math_f4 matrix [9]) {
+	const device_math_f4 two = device_math_f4_set(2.0f);
+	const device_math_f4 diagonal = device_math_f4_sub(device_math_f4_mul(w, w), device_math_f4_set(0.5f));
+	
+	const device_math_f4 wx = device_math_f4_mul(w, x);
+	const device_math_f4 wy = device_math_f4_mul(w, y);
+	const device_math_f4 wz = device_math_f4_mul(w, z);
+	const device_math_f4 xy = device_math_f4_mul(x, y);
+	const device_math_f4 xz = device_math_f4_mul(x, z);
+	const device_math_f4 yz = device_math_f4_mul(y, z);
+	
+	matrix[0] = device_math_f4_mul(two, device_math_f4_add(diagonal, device_math_f4_mul(x, x)));
+	matrix[1] = device_math_f4_mul(two, device_math_f4_sub(xy, wz));
+	matrix[2] = device_math_f4_mul(two, device_math_f4_add(xz, wy));
+	matrix[3] = device_math_f4_mul(two, device_math_f4_add(xy, wz));
+	matrix[4] = device_math_f4_mul(two, device_math_f4_add(diagonal, device_math_f4_mul(y, y)));
+	matrix[5] = device_math_f4_mul(two, device_math_f4_sub(yz, wx));
+	matrix[6] = device_math_f4_mul(two, device_math_f4_sub(xz, wy));
+	matrix[7] = device_math_f4_mul(two, device_math_f4_add(yz, wx));
+	matrix[8] = device_math_f4_mul(two, device_math_f4_add(diagonal, device_math_f4_mul(z, z)));
+}
+
+// Second-order IIR section filtering all three axes at once (transposed direct form II)
+struct device_math_biquad_t {
+	float coefficients [5]; // (b0, b1, b2, a1, a2 normalised by a0)
+	float state [2][4];
+	bool primed;
+};
+
+typedef struct device_math_biquad_t device_math_biquad_type;
+
+// According to the Audio EQ Cookbook: (Butterworth low-pass with Q = 1 / sqrt(2))
+static inline void device_math_biquad_lowpass(device_math_biquad_type* biquad, float cutoff, float rate) {
+	const float omega = 6.283185307f * cutoff / rate;
+	const float alpha = sinf(omega) / (2.0f * 0.7071067812f);
+	const float c = cosf(omega);
+	const float a0 = 1.0f + alpha;
+	
+	biquad->coefficients[0] = (1.0f - c) / 2.0f / a0;
+	biquad->coefficients[1] = (1.0f - c) / a0;
+	biquad->coefficients[2] = (1.0f - c) / 2.0f / a0;
+	biquad->coefficients[3] = -2.0f * c / a0;
+	biquad->coefficients[4] = (1.0f - alpha) / a0;
+	biquad->primed = false;
+}
+
+static inline void device_math_biquad_reset(device_math_biquad_type* biquad) {
+	biquad->primed = false;
+}
+
+static inline FusionVector device_math_biquad_apply(device_math_biquad_type* biquad, const FusionVector v) {
+	const float in [4] = { v.axis.x, v.axis.y, v.axis.z, 0.0f };
+	const device_math_f4 x = device_math_f4_load(in);
+	
+	const device_math_f4 b0 = device_math_f4_set(biquad->coefficients[0]);
+	const device_math_f4 b1 = device_math_f4_set(biquad->coefficients[1]);
+	const device_math_f4 b2 = device_math_f4_set(biquad->coefficients[2]);
+	const device_math_f4 a1 = device_math_f4_set(biquad->coefficients[3]);
+	const device_math_f4 a2 = device_math_f4_set(biquad->coefficients[4]);
+	
+	// Starting from the steady state of the first input avoids the step response of an empty filter
+	if (!biquad->primed) {
+		device_math_f4_store(biquad->state[0], device_math_f4_mul(device_math_f4_sub(device_math_f4_set(1.0f), b0), x));
+		device_math_f4_store(biquad->state[1], device_math_f4_mul(device_math_f4_sub(b2, a2), x));
+		biquad->primed = true;
+	}
+	
+	const device_math_f4 z1 = device_math_f4_load(biquad->state[0]);
+	const device_math_f4 z2 = device_math_f4_load(biquad->state[1]);
+	
+	const device_math_f4 y = device_math_f4_add(device_math_f4_mul(b0, x), z1);
+	
+	device_math_f4_store(biquad->state[0], device_math_f4_add(
+			device_math_f4_sub(device_math_f4_mul(b1, x), device_math_f4_mul(a1, y)),
+			z2
+	));
+	
+	device_math_f4_store(biquad->state[1], device_math_f4_sub(device_math_f4_mul(b2, x), device_math_f4_mul(a2, y)));
+	
+	float out [4];
+	device_math_f4_store(out, y);
+	
+	FusionVector res;
+	res.axis.x = out[0];
+	res.axis.y = out[1];
+	res.axis.z = out[2];
+	return res;
+}
@@ -25,6 +25,8 @@
 #include "device_mcu.h"
 #include "device.h"
 
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -36,7 +38,9 @@
 
 #include "crc32.h"
 #include "hid_ids.h"
+#include "ring_buffer.h"
 
+#include "device_time.h"
 
 #include "endian_compat.h"
 
@@ -52,6 +56,63 @@
 #define MAX_PACKET_SIZE 64
 #define PACKET_HEAD 0xFD
 
+struct device_mcu_log_t {
+	ring_buffer_type* ring;
+	device_mcu_log_line_type line;
+	
+	FILE* file;
+	char* path;
+	uint32_t max_size;
+	uint16_t max_files;
+	uint32_t size;
+};
+
+typedef struct device_mcu_log_t device_mcu_log_type;
+
+// Pending requests and ownership are packed into single words, so any client thread can update them lock-free:
+// request = value (8 bits) | client (8 bits) | priority (7 bits) | pending (1 bit) | time of first request in ms (40 bits)
+// owner = priority (8 bits) | client (8 bits) | time of last acknowledged request in ms (48 bits)
+#define COMMAND_PENDING (1ULL << 23)
+#define COMMAND_TIME_SHIFT 24
+#define COMMAND_OWNER_TIME_SHIFT 16
+
+struct device_mcu_commands_t {
+	atomic_bool active;
+	atomic_bool poll_display_mode;
+	uint64_t polled;
+	
+	atomic_uint_fast64_t request [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast64_t owner [DEVICE_MCU_COMMAND_COUNT];
+	uint64_t inflight [DEVICE_MCU_COMMAND_COUNT]; // (request sent but not acknowledged yet, only used by the read thread)
+	uint64_t last_sent [DEVICE_MCU_COMMAND_COUNT];
+	
+	atomic_uint_fast32_t requested [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast32_t coalesced [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast32_t rejected [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast32_t sent [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast32_t failed [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast64_t latency [DEVICE_MCU_COMMAND_COUNT];
+	atomic_uint_fast64_t latency_max [DEVICE_MCU_COMMAND_COUNT];
+};
+
+typedef struct device_mcu_commands_t device_mcu_commands_type;
+
+static const device_mcu_display_mode_info_type display_modes [] = {
+	{ DEVICE_MCU_DISPLAY_MODE_1920x1080_60, 1920, 1080, 60, false },
+	{ DEVICE_MCU_DISPLAY_MODE_3840x1080_60_SBS, 3840, 1080, 60, true },
+	{ DEVICE_MCU_DISPLAY_MODE_3840x1080_72_SBS, 3840, 1080, 72, true },
+	{ DEVICE_MCU_DISPLAY_MODE_1920x1080_72, 1920, 1080, 72, false },
+	{ DEVICE_MCU_DISPLAY_MODE_1920x1080_60_SBS, 1920, 1080, 60, true },
+	{ DEVICE_MCU_DISPLAY_MODE_3840x1080_90_SBS, 3840, 1080, 90, true },
+	{ DEVICE_MCU_DISPLAY_MODE_1920x1080_90, 1920, 1080, 90, false },
+	{ DEVICE_MCU_DISPLAY_MODE_1920x1080_120, 1920, 1080, 120, false },
+};
+
+static const uint16_t command_msgids [DEVICE_MCU_COMMAND_COUNT] = {
+	DEVICE_MCU_MSG_W_BRIGHTNESS,
+	DEVICE_MCU_MSG_W_DISP_MODE
+};
+
 static bool send_payload(device_mcu_type* device, uint8_t size, const uint8_t* payload) {
 	int payload_size = size;
 	if (payload_size > MAX_PACKET_SIZE) {
@@ -68,28 +129,33 @@ static bool send_payload(device_mcu_type* device, uint8_t size, const uint8_t* p
 	return (transferred == size);
 }
 
-static bool recv_payload(device_mcu_type* device, uint8_t size, uint8_t* payload) {
+static int recv_payload(device_mcu_type* device, uint8_t size, uint8_t* payload, int timeout) {
 	int payload_size = size;
 	if (payload_size > MAX_PACKET_SIZE) {
 		payload_size = MAX_PACKET_SIZE;
 	}
 	
-	int transferred = hid_read(device->handle, payload, payload_size);
+	int transferred = hid_read_timeout(device->handle, payload, payload_size, timeout);
+	
+	if (transferred == -1) {
+		device_mcu_error("Device may be unplugged");
+		return -1;
+	}
 	
 	if (transferred >= payload_size) {
 		transferred = payload_size;
 	}
 	
 	if (transferred == 0) {
-		return false;
+		return 0;
 	}
 	
 	if (transferred != payload_size) {
 		device_mcu_error("Receiving payload failed");
-		return false;
+		return 0;
 	}
 	
-	return (transferred == size);
+	return (transferred == size)? 1 : 0;
 }
 
 static bool send_payload_action(device_mcu_type* device, uint16_t msgid, uint8_t len, const uint8_t* data) {
@@ -115,29 +181,342 @@ static bool send_payload_action(device_mcu_type* device, uint16_t msgid, uint8_t
 	return send_payload(device, payload_len, (uint8_t*) (&packet));
 }
 
-static bool recv_payload_msg(device_mcu_type* device, uint16_t msgid, uint8_t len, uint8_t* data) {
-	static device_mcu_packet_type packet;
+static void device_mcu_callback(device_mcu_type* device,
+							 const device_mcu_event_data_type* data) {
+	if (device->queue) {
+		ring_buffer_push((ring_buffer_type*) device->queue, data);
+	}
+	
+	if (!device->callback) {
+		return;
+	}
 	
-	packet.head = 0;
-	packet.length = 0;
-	packet.msgid = 0;
+	device->callback(
+			data->timestamp,
+			data->event,
+			device->brightness,
+			data->event == DEVICE_MCU_EVENT_MESSAGE? data->text : NULL
+	);
+}
+
+static void device_mcu_notify(device_mcu_type* device,
+							  uint64_t timestamp,
+							  device_mcu_event_type event,
+							  uint8_t value) {
+	device_mcu_event_data_type data;
+	memset(&data, 0, sizeof(device_mcu_event_data_type));
 	
-	const uint16_t packet_len = 18 + len;
-	const uint16_t payload_len = 5 + packet_len;
+	data.timestamp = timestamp;
+	data.event = event;
+	data.value = value;
 	
-	if (!recv_payload(device, payload_len, (uint8_t*) (&packet))) {
-		return false;
+	device_mcu_callback(device, &data);
+}
+
+static void device_mcu_notify_button(device_mcu_type* device,
+									 uint64_t timestamp,
+									 device_mcu_event_type event,
+									 uint8_t phys_button,
+									 uint8_t virt_button,
+									 uint8_t value) {
+	device_mcu_event_data_type data;
+	memset(&data, 0, sizeof(device_mcu_event_data_type));
+	
+	data.timestamp = timestamp;
+	data.event = event;
+	data.button.phys = phys_button;
+	data.button.virt = virt_button;
+	data.button.value = value;
+	
+	device_mcu_callback(device, &data);
+}
+
+static void update_display_mode(device_mcu_type* device, uint8_t disp_mode) {
+	if (device->disp_mode == disp_mode) {
+		return;
+	}
+	
+	device->disp_mode = disp_mode;
+	device_mcu_notify(device, 0, DEVICE_MCU_EVENT_DISPLAY_MODE_CHANGED, disp_mode);
+}
+
+#define STATE_VERSION_SHIFT 40
+#define STATE_FIELDS_MASK ((1ULL << STATE_VERSION_SHIFT) - 1)
+
+static void publish_state(device_mcu_type* device) {
+	const uint64_t fields = (
+			((uint64_t) device->brightness) |
+			((uint64_t) device->disp_mode << 8) |
+			((uint64_t) device->blend_state << 16) |
+			((uint64_t) device->control_mode << 24) |
+			((uint64_t) (device->active? 1 : 0) << 32)
+	);
+	
+	uint64_t state = __atomic_load_n(&(device->state), __ATOMIC_ACQUIRE);
+	uint64_t next;
+	
+	do {
+		if ((state & STATE_FIELDS_MASK) == fields) {
+			return;
+		}
+		
+		next = (((state >> STATE_VERSION_SHIFT) + 1) << STATE_VERSION_SHIFT) | fields;
+	} while (!__atomic_compare_exchange_n(&(device->state), &state, next, true,
+										  __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+static void log_finish_line(device_mcu_type* device, device_mcu_log_type* log) {
+	device_mcu_log_line_type* line = &(log->line);
+	
+	if (!line->length) {
+		return;
+	}
+	
+	line->text[line->length] = '\0';
+	
+	if (log->ring) {
+		ring_buffer_push(log->ring, line);
+	} else {
+		device_mcu_event_data_type data;
+		memset(&data, 0, sizeof(device_mcu_event_data_type));
+		
+		data.timestamp = line->device_timestamp;
+		data.event = DEVICE_MCU_EVENT_MESSAGE;
+		strncpy(data.text, line->text, DEVICE_MCU_EVENT_TEXT_LENGTH - 1);
+		
+		device_mcu_callback(device, &data);
 	}
+	
+	line->length = 0;
+}
 
-	if (packet.head != PACKET_HEAD) {
-		device_mcu_error("Invalid payload received");
-		return false;
+static void log_append(device_mcu_type* device, uint64_t timestamp, const char* text, size_t text_len, bool complete) {
+	device_mcu_log_type* log = (device_mcu_log_type*) device->log;
+	
+	if (!log) {
+		return;
+	}
+	
+	device_mcu_log_line_type* line = &(log->line);
+	const uint64_t now = device_time_now();
+	
+	for (size_t i = 0; i < text_len; i++) {
+		const char c = text[i];
+		
+		if (c == '\n') {
+			log_finish_line(device, log);
+			continue;
+		}
+		
+		if (c == '\r') {
+			continue;
+		}
+		
+		if (!line->length) {
+			line->timestamp = now;
+			line->device_timestamp = timestamp;
+		}
+		
+		line->text[line->length++] = c;
+		
+		if (line->length >= DEVICE_MCU_LOG_LINE_LENGTH - 1) {
+			log_finish_line(device, log);
+		}
+	}
+	
+	// Without a log ring every packet is delivered as message event right away, like before buffering lines
+	if ((complete) || (!log->ring)) {
+		log_finish_line(device, log);
+	}
+}
+
+static bool log_rotate(device_mcu_log_type* log) {
+	const bool rotate = (log->file != NULL);
+	
+	if (log->file) {
+		fclose(log->file);
+		log->file = NULL;
+	}
+	
+	if ((rotate) && (log->max_files > 0)) {
+		const size_t len = strlen(log->path) + 8;
+		char* from = malloc(len);
+		char* to = malloc(len);
+		
+		if ((from) && (to)) {
+			for (uint16_t i = log->max_files - 1; i > 0; i--) {
+				snprintf(from, len, "%s.%u", log->path, i);
+				snprintf(to, len, "%s.%u", log->path, i + 1);
+				rename(from, to);
+			}
+			
+			snprintf(to, len, "%s.1", log->path);
+			rename(log->path, to);
+		}
+		
+		free(from);
+		free(to);
 	}
 	
-	if (le16toh(packet.msgid) != msgid) {
-		device_mcu_error("Unexpected payload received");
+	log->file = fopen(log->path, rotate? "w" : "a");
+	log->size = 0;
+	
+	if (!log->file) {
 		return false;
 	}
+	
+	if (!rotate) {
+		fseek(log->file, 0, SEEK_END);
+		log->size = (uint32_t) ftell(log->file);
+	}
+	
+	return true;
+}
+
+static void link_activity(device_mcu_type* device, uint16_t msgid, uint64_t now) {
+	device_mcu_link_type* link = &(device->link);
+	
+	link->last_activity = now;
+	
+	switch (msgid) {
+		case DEVICE_MCU_MSG_P_HEARTBEAT: {
+			if (!link->pending_heartbeat) {
+				break;
+			}
+			
+			const uint64_t latency = now - link->pending_heartbeat;
+			
+			link->latency = latency;
+			
+			if ((!link->latency_min) || (latency < link->latency_min)) {
+				link->latency_min = latency;
+			}
+			
+			if (latency > link->latency_max) {
+				link->latency_max = latency;
+			}
+			
+			if (link->latency_avg) {
+				link->latency_avg = (link->latency_avg * 7 + latency) / 8;
+			} else {
+				link->latency_avg = latency;
+			}
+			
+			link->pending_heartbeat = 0;
+			link->heartbeats_received++;
+			link->armed = true;
+			break;
+		}
+		case DEVICE_MCU_MSG_P_START_HEARTBEAT:
+		case DEVICE_MCU_MSG_P_END_HEARTBEAT:
+			link->armed = true;
+			break;
+		default:
+			break;
+	}
+	
+	if ((!link->armed) || (link->alive)) {
+		return;
+	}
+	
+	link->alive = true;
+	
+	if (link->losses > 0) {
+		device_mcu_notify(device, 0, DEVICE_MCU_EVENT_LINK_RESTORED, 0);
+	}
+}
+
+static uint64_t link_deadline(const device_mcu_type* device) {
+	const device_mcu_link_type* link = &(device->link);
+	const uint64_t timeout = device->link_timeout * DEVICE_TIME_MS;
+	
+	uint64_t deadline = link->next_heartbeat;
+	
+	if (link->pending_heartbeat) {
+		deadline = link->pending_heartbeat + timeout;
+	}
+	
+	if ((link->alive) && (link->last_activity + timeout < deadline)) {
+		deadline = link->last_activity + timeout;
+	}
+	
+	return deadline;
+}
+
+static device_mcu_error_type link_check(device_mcu_type* device, uint64_t now) {
+	device_mcu_link_type* link = &(device->link);
+	const uint64_t timeout = device->link_timeout * DEVICE_TIME_MS;
+	
+	if (!device->heartbeat_interval) {
+		return DEVICE_MCU_ERROR_NO_ERROR;
+	}
+	
+	if ((link->pending_heartbeat) && (now - link->pending_heartbeat > timeout)) {
+		link->pending_heartbeat = 0;
+		link->heartbeats_missed++;
+	}
+	
+	if ((link->alive) && (now - link->last_activity > timeout)) {
+		link->alive = false;
+		link->losses++;
+		
+		device_mcu_error("Device stopped responding");
+		device_mcu_notify(device, 0, DEVICE_MCU_EVENT_LINK_LOST, 0);
+	}
+	
+	if ((!link->pending_heartbeat) && (now >= link->next_heartbeat)) {
+		const device_mcu_error_type error = device_mcu_heartbeat(device);
+		
+		if (error != DEVICE_MCU_ERROR_NO_ERROR) {
+			return error;
+		}
+	}
+	
+	// A lost link only gets reported via event, reading continues so late packets can restore it
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+static void handle_packet(device_mcu_type* device, const device_mcu_packet_type* packet);
+
+static bool recv_payload_msg(device_mcu_type* device, uint16_t msgid, uint8_t len, uint8_t* data, uint64_t deadline) {
+	static device_mcu_packet_type packet;
+	
+	// Events or stale replies may arrive in between, so only the deadline ends the wait
+	for (;;) {
+		packet.head = 0;
+		packet.length = 0;
+		packet.msgid = 0;
+		
+		const int timeout = device_time_until_ms(deadline);
+		
+		if (timeout <= 0) {
+			return false;
+		}
+		
+		// Whole reports get read, so events arriving in between can be dispatched as usual
+		const int received = recv_payload(device, MAX_PACKET_SIZE, (uint8_t*) (&packet), timeout);
+		
+		if (received < 0) {
+			return false;
+		}
+		
+		if (received == 0) {
+			continue;
+		}
+		
+		if (packet.head != PACKET_HEAD) {
+			device_mcu_error("Invalid payload received");
+			continue;
+		}
+		
+		link_activity(device, le16toh(packet.msgid), device_time_now());
+		
+		if (le16toh(packet.msgid) == msgid) {
+			break;
+		}
+		
+		handle_packet(device, &packet);
+	}
 
 	const uint8_t status = packet.data[0];
 	
@@ -163,31 +542,58 @@ static bool do_payload_action(device_mcu_type* device, uint16_t msgid, uint8_t l
 		return false;
 	}
 
-	const uint16_t attempts_per_second = (device->active? 60 : 1);
-	
-	uint16_t attempts = attempts_per_second * 5;
+	// Writes are not resent since they might not be idempotent (firmware transfers for example)
+	const uint64_t deadline = device_time_now() + DEVICE_MCU_ACTION_TIMEOUT_MS * DEVICE_TIME_MS;
+
+	return recv_payload_msg(device, msgid, 0, NULL, deadline);
+}
 
-	while (attempts > 0) {
-		if (recv_payload_msg(device, msgid, 0, NULL)) {
+static bool do_payload_request(device_mcu_type* device, uint16_t msgid, uint8_t len, uint8_t* data, uint64_t deadline) {
+	for (uint32_t attempt = 0; attempt < DEVICE_MCU_HANDSHAKE_ATTEMPTS; attempt++) {
+		const uint64_t now = device_time_now();
+		
+		if (now >= deadline) {
+			break;
+		}
+		
+		if (!send_payload_action(device, msgid, 0, NULL)) {
+			return false;
+		}
+		
+		uint64_t timeout = now + DEVICE_MCU_HANDSHAKE_TIMEOUT_MS * DEVICE_TIME_MS;
+		
+		if (timeout > deadline) {
+			timeout = deadline;
+		}
+		
+		if (recv_payload_msg(device, msgid, len, data, timeout)) {
 			return true;
 		}
-
-		attempts--;
 	}
-
+	
 	return false;
 }
 
+static uint64_t request_deadline() {
+	return device_time_now() + DEVICE_MCU_HANDSHAKE_ATTEMPTS * DEVICE_MCU_HANDSHAKE_TIMEOUT_MS * DEVICE_TIME_MS;
+}
+
 device_mcu_error_type device_mcu_open(device_mcu_type* device, device_mcu_event_callback callback) {
 	if (!device) {
 		device_mcu_error("No device");
 		return DEVICE_MCU_ERROR_NO_DEVICE;
 	}
 	
+	const uint64_t start = device_time_now();
+	const uint64_t deadline = start + DEVICE_MCU_OPEN_TIMEOUT_MS * DEVICE_TIME_MS;
+	
 	memset(device, 0, sizeof(device_mcu_type));
 	device->vendor_id 	= xreal_vendor_id;
 	device->product_id 	= 0;
 	device->callback 	= callback;
+	
+	device->heartbeat_interval 	= 0;
+	device->link_timeout 		= DEVICE_MCU_LINK_TIMEOUT_MS;
 
 	if (!device_init()) {
 		device_mcu_error("Not initialized");
@@ -223,13 +629,8 @@ device_mcu_error_type device_mcu_open(device_mcu_type* device, device_mcu_event_
 
 	device_mcu_clear(device);
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_ACTIVATION_TIME, 0, NULL)) {
-		device_mcu_error("Requesting activation time failed");
-		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
-	}
-
 	uint8_t activated;
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_ACTIVATION_TIME, 1, &activated)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_ACTIVATION_TIME, 1, &activated, deadline)) {
 		device_mcu_error("Receiving activation time failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
@@ -240,32 +641,17 @@ device_mcu_error_type device_mcu_open(device_mcu_type* device, device_mcu_event_
 		device_mcu_warning("Device is not activated");
 	}
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_MCU_APP_FW_VERSION, 0, NULL)) {
-		device_mcu_error("Requesting current MCU app firmware version");
-		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
-	}
-
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_MCU_APP_FW_VERSION, 41, (uint8_t*) device->mcu_app_fw_version)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_MCU_APP_FW_VERSION, 41, (uint8_t*) device->mcu_app_fw_version, deadline)) {
 		device_mcu_error("Receiving current MCU app firmware version failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_DP7911_FW_VERSION, 0, NULL)) {
-		device_mcu_error("Requesting current DP firmware version");
-		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
-	}
-
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_DP7911_FW_VERSION, 41, (uint8_t*) device->dp_fw_version)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_DP7911_FW_VERSION, 41, (uint8_t*) device->dp_fw_version, deadline)) {
 		device_mcu_error("Receiving current DP firmware version failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_DSP_APP_FW_VERSION, 0, NULL)) {
-		device_mcu_error("Requesting current DSP app firmware version");
-		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
-	}
-
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_DSP_APP_FW_VERSION, 41, (uint8_t*) device->dsp_fw_version)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_DSP_APP_FW_VERSION, 41, (uint8_t*) device->dsp_fw_version, deadline)) {
 		device_mcu_error("Receiving current DSP app firmware version failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
@@ -276,51 +662,178 @@ device_mcu_error_type device_mcu_open(device_mcu_type* device, device_mcu_event_
 	printf("DSP: %s\n", device->dsp_fw_version);
 #endif
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_BRIGHTNESS, 0, NULL)) {
-		device_mcu_error("Requesting initial brightness failed");
-		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
-	}
-
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_BRIGHTNESS, 1, &device->brightness)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_BRIGHTNESS, 1, &device->brightness, deadline)) {
 		device_mcu_error("Receiving initial brightness failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_DISP_MODE, 0, NULL)) {
-		device_mcu_error("Requesting display mode failed");
-		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
-	}
-
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_DISP_MODE, 1, &device->disp_mode)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_DISP_MODE, 1, &device->disp_mode, deadline)) {
 		device_mcu_error("Receiving display mode failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
+	
+	// Only allocate once the handshake succeeded, so failing to open leaves nothing to release
+	device->log 		= calloc(1, sizeof(device_mcu_log_type));
+	device->commands 	= calloc(1, sizeof(device_mcu_commands_type));
+
+	publish_state(device);
+	
+	device->open_duration = device_time_now() - start;
 
 #ifndef NDEBUG
 	printf("Brightness: %d\n", device->brightness);
 	printf("Disp-Mode: %d\n", device->disp_mode);
+	printf("Opened MCU in %.1f ms\n", (double) device->open_duration / 1e6);
 #endif
 
 	return DEVICE_MCU_ERROR_NO_ERROR;
 }
 
-static void device_mcu_callback(device_mcu_type* device,
-							 uint64_t timestamp,
-							 device_mcu_event_type event,
-							 uint8_t brightness,
-							 const char* msg) {
-	if (!device->callback) {
+static void process_commands(device_mcu_type* device, uint64_t now) {
+	device_mcu_commands_type* commands = (device_mcu_commands_type*) device->commands;
+	
+	if (!commands) {
 		return;
 	}
 	
-	device->callback(timestamp, event, brightness, msg);
+	// The device switches modes on its own when the 2D/3D buttons are used
+	if (atomic_exchange_explicit(&(commands->poll_display_mode), false, memory_order_relaxed)) {
+		device_mcu_poll_display_mode(device);
+	}
+	
+	if (!atomic_load_explicit(&(commands->active), memory_order_relaxed)) {
+		return;
+	}
+	
+	commands->polled = now;
+	
+	// Commands only get sent here, their acknowledgement is handled with all other packets so reading never blocks
+	for (int i = 0; i < DEVICE_MCU_COMMAND_COUNT; i++) {
+		if (commands->inflight[i]) {
+			if (now < commands->last_sent[i] + DEVICE_MCU_ACTION_TIMEOUT_MS * DEVICE_TIME_MS) {
+				continue;
+			}
+			
+			device_mcu_error("Requested command not acknowledged");
+			commands->inflight[i] = 0;
+			atomic_fetch_add_explicit(&(commands->failed[i]), 1, memory_order_relaxed);
+		}
+		
+		uint64_t request = atomic_load_explicit(&(commands->request[i]), memory_order_relaxed);
+		
+		if ((!(request & COMMAND_PENDING)) ||
+			(now < commands->last_sent[i] + DEVICE_MCU_COMMAND_INTERVAL_MS * DEVICE_TIME_MS)) {
+			continue;
+		}
+		
+		request = atomic_exchange_explicit(&(commands->request[i]), 0, memory_order_acquire);
+		
+		if (!(request & COMMAND_PENDING)) {
+			continue;
+		}
+		
+		const uint8_t value = (uint8_t) (request & 0xFF);
+		
+		if (!send_payload_action(device, command_msgids[i], 1, &value)) {
+			device_mcu_error("Sending requested command failed");
+			atomic_fetch_add_explicit(&(commands->failed[i]), 1, memory_order_relaxed);
+			continue;
+		}
+		
+		commands->inflight[i] = request;
+		commands->last_sent[i] = now;
+	}
 }
 
-device_mcu_error_type device_mcu_clear(device_mcu_type* device) {
-	return device_mcu_read(device, 10);
+static bool acknowledge_command(device_mcu_type* device, uint16_t msgid, uint8_t status) {
+	device_mcu_commands_type* commands = (device_mcu_commands_type*) device->commands;
+	
+	if (!commands) {
+		return false;
+	}
+	
+	int i = 0;
+	while ((i < DEVICE_MCU_COMMAND_COUNT) && ((command_msgids[i] != msgid) || (!commands->inflight[i]))) {
+		i++;
+	}
+	
+	if (i >= DEVICE_MCU_COMMAND_COUNT) {
+		return false;
+	}
+	
+	const uint64_t request = commands->inflight[i];
+	commands->inflight[i] = 0;
+	
+	if (status != 0) {
+		device_mcu_error("Requested command failed");
+		atomic_fetch_add_explicit(&(commands->failed[i]), 1, memory_order_relaxed);
+		return true;
+	}
+	
+	const uint8_t value = (uint8_t) (request & 0xFF);
+	const uint8_t client = (uint8_t) ((request >> 8) & 0xFF);
+	const uint8_t priority = (uint8_t) ((request >> 16) & DEVICE_MCU_COMMAND_MAX_PRIORITY);
+	const uint64_t requested = (request >> COMMAND_TIME_SHIFT) * DEVICE_TIME_MS;
+	const uint64_t acknowledged = device_time_now();
+	
+	atomic_store_explicit(
+			&(commands->owner[i]),
+			((acknowledged / DEVICE_TIME_MS) << COMMAND_OWNER_TIME_SHIFT) | ((uint64_t) client << 8) | priority,
+			memory_order_relaxed
+	);
+	
+	const uint64_t latency = (acknowledged > requested? acknowledged - requested : 0);
+	
+	atomic_fetch_add_explicit(&(commands->sent[i]), 1, memory_order_relaxed);
+	atomic_store_explicit(&(commands->latency[i]), latency, memory_order_relaxed);
+	
+	// Only the read thread writes these, so no compare-exchange is needed
+	if (latency > atomic_load_explicit(&(commands->latency_max[i]), memory_order_relaxed)) {
+		atomic_store_explicit(&(commands->latency_max[i]), latency, memory_order_relaxed);
+	}
+	
+	switch (i) {
+		case DEVICE_MCU_COMMAND_BRIGHTNESS:
+			device->brightness = value;
+			break;
+		case DEVICE_MCU_COMMAND_DISPLAY_MODE:
+			update_display_mode(device, value);
+			break;
+		default:
+			break;
+	}
+	
+	return true;
 }
 
-device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout) {
+static void request_display_mode_poll(device_mcu_type* device) {
+	device_mcu_commands_type* commands = (device_mcu_commands_type*) device->commands;
+	
+	if (commands) {
+		atomic_store_explicit(&(commands->poll_display_mode), true, memory_order_relaxed);
+	}
+}
+
+static uint64_t read_deadline(const device_mcu_type* device) {
+	const device_mcu_commands_type* commands = (const device_mcu_commands_type*) device->commands;
+	uint64_t deadline = 0;
+	
+	if (device->heartbeat_interval) {
+		deadline = link_deadline(device);
+	}
+	
+	if ((commands) && (atomic_load_explicit(&(commands->active), memory_order_relaxed))) {
+		const uint64_t poll = commands->polled + DEVICE_MCU_COMMAND_POLL_MS * DEVICE_TIME_MS;
+		
+		if ((!deadline) || (poll < deadline)) {
+			deadline = poll;
+		}
+	}
+	
+	return deadline;
+}
+
+device_mcu_error_type device_mcu_clear(device_mcu_type* device) {
 	if (!device) {
 		device_mcu_error("No device");
 		return DEVICE_MCU_ERROR_NO_DEVICE;
@@ -331,52 +844,51 @@ device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout) {
 		return DEVICE_MCU_ERROR_NO_HANDLE;
 	}
 	
-	if (MAX_PACKET_SIZE != sizeof(device_mcu_packet_type)) {
-		device_mcu_error("Not proper size");
-		return DEVICE_MCU_ERROR_WRONG_SIZE;
-	}
-	
 	device_mcu_packet_type packet;
-	memset(&packet, 0, sizeof(device_mcu_packet_type));
+	uint32_t discarded = 0;
 	
-	int transferred = hid_read_timeout(
-			device->handle,
-			(uint8_t*) &packet,
-			MAX_PACKET_SIZE,
-			timeout
-	);
-
-	if (transferred == -1) {
-		device_mcu_error("Device may be unplugged");
-		return DEVICE_MCU_ERROR_UNPLUGGED;
-	}
-
-	if (transferred == 0) {
-		return DEVICE_MCU_ERROR_NO_ERROR;
+	// Only reading without blocking makes sure nothing arriving after the backlog gets thrown away
+	while (discarded < DEVICE_MCU_FLUSH_LIMIT) {
+		const int transferred = hid_read_timeout(
+				device->handle,
+				(uint8_t*) &packet,
+				MAX_PACKET_SIZE,
+				0
+		);
+		
+		if (transferred == -1) {
+			device_mcu_error("Device may be unplugged");
+			return DEVICE_MCU_ERROR_UNPLUGGED;
+		}
+		
+		if (transferred == 0) {
+			break;
+		}
+		
+		if ((MAX_PACKET_SIZE == transferred) && (packet.head == PACKET_HEAD)) {
+			link_activity(device, le16toh(packet.msgid), device_time_now());
+		}
+		
+		discarded++;
 	}
 	
-	if (MAX_PACKET_SIZE != transferred) {
-		device_mcu_error("Unexpected packet size");
-		return DEVICE_MCU_ERROR_UNEXPECTED;
-	}
+	device->discarded += discarded;
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
 
-	if (packet.head != PACKET_HEAD) {
-		device_mcu_error("Wrong packet head");
-		return DEVICE_MCU_ERROR_WRONG_HEAD;
-	}
-
-	const uint32_t timestamp = le32toh(packet.timestamp);
-	const uint16_t msgid = le16toh(packet.msgid);
-	const uint16_t length = le16toh(packet.length);
+static void handle_packet(device_mcu_type* device, const device_mcu_packet_type* packet) {
+	const uint32_t timestamp = le32toh(packet->timestamp);
+	const uint16_t msgid = le16toh(packet->msgid);
+	const uint16_t length = le16toh(packet->length);
 
-	const size_t data_len = (size_t) &(packet.data) - (size_t) &(packet.length);
+	const size_t data_len = (size_t) &(packet->data) - (size_t) &(packet->length);
 
 #ifndef NDEBUG
 	printf("MSG: %d = %04x (%d)\n", msgid, msgid, length);
 
 	if (length > 11) {
 		for (int i = 0; i < length - 11; i++) {
-			printf("%02x ", packet.data[i]);
+			printf("%02x ", packet->data[i]);
 		}
 
 		printf("\n");
@@ -384,141 +896,104 @@ device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout) {
 #endif
 	
 	switch (msgid) {
+		case DEVICE_MCU_MSG_P_HEARTBEAT:
 		case DEVICE_MCU_MSG_P_START_HEARTBEAT: {
 			break;
 		}
 		case DEVICE_MCU_MSG_P_DISPLAY_TOGGLED: {
-			const uint8_t value = packet.data[0];
+			const uint8_t value = packet->data[0];
 
 			device->active = value;
 			
-			if (device->active) {
-				device_mcu_callback(
-						device,
-						timestamp,
-						DEVICE_MCU_EVENT_SCREEN_ON,
-						device->brightness,
-						NULL
-				);
-			} else {
-				device_mcu_callback(
-						device,
-						timestamp,
-						DEVICE_MCU_EVENT_SCREEN_OFF,
-						device->brightness,
-						NULL
-				);
-			}
+			device_mcu_notify(
+					device,
+					timestamp,
+					device->active? DEVICE_MCU_EVENT_SCREEN_ON : DEVICE_MCU_EVENT_SCREEN_OFF,
+					value
+			);
 			break;
 		}
 		case DEVICE_MCU_MSG_P_BUTTON_PRESSED: {
-			const uint8_t phys_button = packet.data[0];
-			const uint8_t virt_button = packet.data[4];
-			const uint8_t value = packet.data[8];
+			const uint8_t phys_button = packet->data[0];
+			const uint8_t virt_button = packet->data[4];
+			const uint8_t value = packet->data[8];
 			
 			switch (virt_button) {
 				case DEVICE_MCU_BUTTON_VIRT_DISPLAY_TOGGLE:
 					device->active = value;
 					
-					if (device->active) {
-						device_mcu_callback(
-								device,
-								timestamp,
-								DEVICE_MCU_EVENT_SCREEN_ON,
-								device->brightness,
-								NULL
-						);
-					} else {
-						device_mcu_callback(
-								device,
-								timestamp,
-								DEVICE_MCU_EVENT_SCREEN_OFF,
-								device->brightness,
-								NULL
-						);
-					}
+					device_mcu_notify(
+							device,
+							timestamp,
+							device->active? DEVICE_MCU_EVENT_SCREEN_ON : DEVICE_MCU_EVENT_SCREEN_OFF,
+							value
+					);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_BRIGHTNESS_UP:
 					device->brightness = value;
 					
-					device_mcu_callback(
-							device,
-							timestamp,
-							DEVICE_MCU_EVENT_BRIGHTNESS_UP,
-							device->brightness,
-							NULL
-					);
+					device_mcu_notify(device, timestamp, DEVICE_MCU_EVENT_BRIGHTNESS_UP, device->brightness);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_BRIGHTNESS_DOWN:
 					device->brightness = value;
 					
-					device_mcu_callback(
-							device,
-							timestamp,
-							DEVICE_MCU_EVENT_BRIGHTNESS_DOWN,
-							device->brightness,
-							NULL
-					);
+					device_mcu_notify(device, timestamp, DEVICE_MCU_EVENT_BRIGHTNESS_DOWN, device->brightness);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_UP:
 					if (device->control_mode == DEVICE_MCU_CONTROL_MODE_VOLUME)
-						device_mcu_callback(
+						device_mcu_notify_button(
 								device,
 								timestamp,
 								DEVICE_MCU_EVENT_VOLUME_UP,
-								device->brightness,
-								NULL
+								phys_button,
+								virt_button,
+								value
 						);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_DOWN:
 					if (device->control_mode == DEVICE_MCU_CONTROL_MODE_VOLUME)
-						device_mcu_callback(
+						device_mcu_notify_button(
 								device,
 								timestamp,
 								DEVICE_MCU_EVENT_VOLUME_DOWN,
-								device->brightness,
-								NULL
+								phys_button,
+								virt_button,
+								value
 						);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_MODE_2D:
-					device_mcu_callback(
+					request_display_mode_poll(device);
+					
+					device_mcu_notify_button(
 							device,
 							timestamp,
 							DEVICE_MCU_EVENT_DISPLAY_MODE_2D,
-							device->brightness,
-							NULL
+							phys_button,
+							virt_button,
+							value
 					);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_MODE_3D:
-					device_mcu_callback(
+					request_display_mode_poll(device);
+					
+					device_mcu_notify_button(
 							device,
 							timestamp,
 							DEVICE_MCU_EVENT_DISPLAY_MODE_3D,
-							device->brightness,
-							NULL
+							phys_button,
+							virt_button,
+							value
 					);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_BLEND_CYCLE:
 					device->blend_state = value;
 
-					device_mcu_callback(
-							device,
-							timestamp,
-							DEVICE_MCU_EVENT_BLEND_CYCLE,
-							device->brightness,
-							NULL		
-					);
+					device_mcu_notify(device, timestamp, DEVICE_MCU_EVENT_BLEND_CYCLE, device->blend_state);
 					break;
 				case DEVICE_MCU_BUTTON_VIRT_CONTROL_TOGGLE:
 					device->control_mode = value;
 
-					device_mcu_callback(
-							device,
-							timestamp,
-							DEVICE_MCU_EVENT_CONTROL_TOGGLE,
-							device->brightness,
-							NULL
-					);
+					device_mcu_notify(device, timestamp, DEVICE_MCU_EVENT_CONTROL_TOGGLE, device->control_mode);
 					break;
 				default:
 					break;
@@ -527,22 +1002,21 @@ device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout) {
 			break;
 		}
 		case DEVICE_MCU_MSG_P_ASYNC_TEXT_LOG: {
-			const char* text = packet.text;
-			const size_t text_len = strlen(text);
-			
-			device->active = true;
+			// The text is not guaranteed to be terminated, so it gets bound by the packet and its length field
+			size_t text_len = strnlen(packet->text, sizeof(packet->text));
 			
-			if (data_len + text_len != length) {
-				device_mcu_error("Not matching length");
-				return DEVICE_MCU_ERROR_INVALID_LENGTH;
+			if ((length >= data_len) && (length - data_len < text_len)) {
+				text_len = length - data_len;
 			}
 			
-			device_mcu_callback(
+			device->active = true;
+			
+			log_append(
 					device,
 					timestamp,
-					DEVICE_MCU_EVENT_MESSAGE,
-					device->brightness,
-					text
+					packet->text,
+					text_len,
+					text_len < sizeof(packet->text)
 			);
 			break;
 		}
@@ -550,20 +1024,17 @@ device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout) {
 			break;
 		}
 		default:
-			device_mcu_callback(
-					device,
-					timestamp,
-					DEVICE_MCU_EVENT_UNKNOWN,
-					device->brightness,
-					NULL
-			);
+			if (!acknowledge_command(device, msgid, packet->data[0])) {
+				device_mcu_notify(device, timestamp, DEVICE_MCU_EVENT_UNKNOWN, 0);
+			}
+			
 			break;
 	}
 	
-	return DEVICE_MCU_ERROR_NO_ERROR;
+	publish_state(device);
 }
 
-device_mcu_error_type device_mcu_poll_display_mode(device_mcu_type* device) {
+device_mcu_error_type device_mcu_read(device_mcu_type* device, int timeout) {
 	if (!device) {
 		device_mcu_error("No device");
 		return DEVICE_MCU_ERROR_NO_DEVICE;
@@ -573,17 +1044,499 @@ device_mcu_error_type device_mcu_poll_display_mode(device_mcu_type* device) {
 		device_mcu_error("No handle");
 		return DEVICE_MCU_ERROR_NO_HANDLE;
 	}
+	
+	if (MAX_PACKET_SIZE != sizeof(device_mcu_packet_type)) {
+		device_mcu_error("Not proper size");
+		return DEVICE_MCU_ERROR_WRONG_SIZE;
+	}
+	
+	__atomic_store_n(&(device->reading), true, __ATOMIC_RELEASE);
+	
+	device_mcu_packet_type packet;
+	memset(&packet, 0, sizeof(device_mcu_packet_type));
+	
+	const uint64_t start = device_time_now();
+	uint64_t now = start;
+	int transferred;
+	
+	// The wait gets split up to send heartbeats, notice a stalled link and issue requested commands in time
+	do {
+		const device_mcu_error_type link_error = link_check(device, now);
+		
+		if (link_error != DEVICE_MCU_ERROR_NO_ERROR) {
+			return link_error;
+		}
+		
+		process_commands(device, now);
+		
+		const uint64_t deadline = read_deadline(device);
+		int wait = timeout;
+		
+		if (deadline) {
+			const uint64_t until = (deadline > now? deadline - now : 0);
+			
+			wait = (int) ((until + DEVICE_TIME_MS - 1) / DEVICE_TIME_MS);
+			
+			if (wait < 1) {
+				wait = 1;
+			}
+			
+			if (timeout >= 0) {
+				const uint64_t elapsed = (now - start) / DEVICE_TIME_MS;
+				const int remaining = (elapsed < (uint64_t) timeout? timeout - (int) elapsed : 0);
+				
+				if (remaining < wait) {
+					wait = remaining;
+				}
+			}
+		}
+		
+		transferred = hid_read_timeout(
+				device->handle,
+				(uint8_t*) &packet,
+				MAX_PACKET_SIZE,
+				wait
+		);
+		
+		now = device_time_now();
+	} while ((transferred == 0) && (read_deadline(device)) &&
+			 ((timeout < 0) || (now - start < (uint64_t) timeout * DEVICE_TIME_MS)));
+
+	if (transferred == -1) {
+		device_mcu_error("Device may be unplugged");
+		return DEVICE_MCU_ERROR_UNPLUGGED;
+	}
+
+	if (transferred == 0) {
+		return DEVICE_MCU_ERROR_NO_ERROR;
+	}
+	
+	if (MAX_PACKET_SIZE != transferred) {
+		device_mcu_error("Unexpected packet size");
+		return DEVICE_MCU_ERROR_UNEXPECTED;
+	}
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_DISP_MODE, 0, NULL)) {
-		device_mcu_error("Requesting display mode failed");
+	if (packet.head != PACKET_HEAD) {
+		device_mcu_error("Wrong packet head");
+		return DEVICE_MCU_ERROR_WRONG_HEAD;
+	}
+
+	link_activity(device, le16toh(packet.msgid), now);
+	handle_packet(device, &packet);
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+uint32_t device_mcu_get_state_version(const device_mcu_type* device) {
+	if (!device) {
+		return 0;
+	}
+	
+	return (uint32_t) (__atomic_load_n(&(device->state), __ATOMIC_ACQUIRE) >> STATE_VERSION_SHIFT);
+}
+
+device_mcu_error_type device_mcu_get_state(const device_mcu_type* device, device_mcu_state_type* state) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	if (!state) {
+		device_mcu_error("No state");
+		return DEVICE_MCU_ERROR_UNEXPECTED;
+	}
+	
+	const uint64_t snapshot = __atomic_load_n(&(device->state), __ATOMIC_ACQUIRE);
+	
+	state->version = (uint32_t) (snapshot >> STATE_VERSION_SHIFT);
+	state->brightness = (uint8_t) (snapshot & 0xFF);
+	state->disp_mode = (uint8_t) ((snapshot >> 8) & 0xFF);
+	state->blend_state = (uint8_t) ((snapshot >> 16) & 0xFF);
+	state->control_mode = (uint8_t) ((snapshot >> 24) & 0xFF);
+	state->active = ((snapshot >> 32) & 0x1) != 0;
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_enable_event_queue(device_mcu_type* device, uint32_t capacity) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	// The read thread pushes without any lock, so the queue can't be replaced under it
+	if (__atomic_load_n(&(device->reading), __ATOMIC_ACQUIRE)) {
+		device_mcu_error("Already reading");
+		return DEVICE_MCU_ERROR_BUSY;
+	}
+	
+	if (device->queue) {
+		ring_buffer_destroy((ring_buffer_type*) device->queue);
+		device->queue = NULL;
+	}
+	
+	if (!capacity) {
+		capacity = DEVICE_MCU_EVENT_QUEUE_SIZE;
+	}
+	
+	device->queue = ring_buffer_create(capacity, sizeof(device_mcu_event_data_type));
+	
+	if (!device->queue) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+uint32_t device_mcu_drain_events(device_mcu_type* device, device_mcu_event_data_type* events, uint32_t count) {
+	if ((!device) || (!device->queue) || (!events)) {
+		return 0;
+	}
+	
+	return (uint32_t) ring_buffer_pop_batch((ring_buffer_type*) device->queue, events, count);
+}
+
+uint32_t device_mcu_dropped_events(const device_mcu_type* device) {
+	if ((!device) || (!device->queue)) {
+		return 0;
+	}
+	
+	return ring_buffer_dropped((const ring_buffer_type*) device->queue);
+}
+
+device_mcu_error_type device_mcu_enable_log(device_mcu_type* device, uint32_t capacity) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	device_mcu_log_type* log = (device_mcu_log_type*) device->log;
+	
+	if (!log) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	// Same as the event queue, lines get pushed by the read thread without any lock
+	if (__atomic_load_n(&(device->reading), __ATOMIC_ACQUIRE)) {
+		device_mcu_error("Already reading");
+		return DEVICE_MCU_ERROR_BUSY;
+	}
+	
+	if (log->ring) {
+		ring_buffer_destroy(log->ring);
+		log->ring = NULL;
+	}
+	
+	if (!capacity) {
+		capacity = DEVICE_MCU_LOG_QUEUE_SIZE;
+	}
+	
+	log->ring = ring_buffer_create(capacity, sizeof(device_mcu_log_line_type));
+	
+	if (!log->ring) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+uint32_t device_mcu_drain_log(device_mcu_type* device, device_mcu_log_line_type* lines, uint32_t count) {
+	if ((!device) || (!device->log) || (!lines)) {
+		return 0;
+	}
+	
+	device_mcu_log_type* log = (device_mcu_log_type*) device->log;
+	return (uint32_t) ring_buffer_pop_batch(log->ring, lines, count);
+}
+
+device_mcu_error_type device_mcu_set_log_file(device_mcu_type* device, const char* path, uint32_t max_size, uint16_t max_files) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	device_mcu_log_type* log = (device_mcu_log_type*) device->log;
+	
+	if (!log) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	if (log->file) {
+		fclose(log->file);
+		log->file = NULL;
+	}
+	
+	if (log->path) {
+		free(log->path);
+		log->path = NULL;
+	}
+	
+	log->max_size = max_size;
+	log->max_files = max_files;
+	log->size = 0;
+	
+	if (!path) {
+		return DEVICE_MCU_ERROR_NO_ERROR;
+	}
+	
+	log->path = strdup(path);
+	
+	if (!log->path) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_write_log(device_mcu_type* device) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	device_mcu_log_type* log = (device_mcu_log_type*) device->log;
+	
+	if ((!log) || (!log->ring) || (!log->path)) {
+		return DEVICE_MCU_ERROR_NO_ERROR;
+	}
+	
+	device_mcu_log_line_type line;
+	bool written = false;
+	
+	while (ring_buffer_pop(log->ring, &line)) {
+		const uint32_t expected = line.length + 32;
+		
+		if ((!log->file) || ((log->max_size > 0) && (log->size + expected > log->max_size))) {
+			if (!log_rotate(log)) {
+				device_mcu_error("Log file not opened");
+				return DEVICE_MCU_ERROR_UNKNOWN;
+			}
+		}
+		
+		const int count = fprintf(
+				log->file,
+				"[%" PRIu64 ".%06" PRIu64 "] %s\n",
+				(uint64_t) (line.timestamp / 1000000000ULL),
+				(uint64_t) ((line.timestamp / 1000ULL) % 1000000ULL),
+				line.text
+		);
+		
+		if (count < 0) {
+			device_mcu_error("Log file not written");
+			return DEVICE_MCU_ERROR_UNKNOWN;
+		}
+		
+		log->size += (uint32_t) count;
+		written = true;
+	}
+	
+	if (written) {
+		fflush(log->file);
+	}
+	
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_request(device_mcu_type* device, device_mcu_command_type command, uint8_t client, uint8_t priority, uint8_t value) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	device_mcu_commands_type* commands = (device_mcu_commands_type*) device->commands;
+	
+	if (!commands) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	if ((command < 0) || (command >= DEVICE_MCU_COMMAND_COUNT)) {
+		device_mcu_error("Unknown command");
+		return DEVICE_MCU_ERROR_UNEXPECTED;
+	}
+	
+	if (priority > DEVICE_MCU_COMMAND_MAX_PRIORITY) {
+		priority = DEVICE_MCU_COMMAND_MAX_PRIORITY;
+	}
+	
+	const uint64_t now = device_time_now() / DEVICE_TIME_MS;
+	const uint64_t owner = atomic_load_explicit(&(commands->owner[command]), memory_order_relaxed);
+	
+	atomic_fetch_add_explicit(&(commands->requested[command]), 1, memory_order_relaxed);
+	
+	// A client of higher priority keeps the setting for a while after its last change, only it may change it meanwhile
+	if ((client != ((owner >> 8) & 0xFF)) && (priority < (owner & 0xFF)) &&
+		(now < (owner >> COMMAND_OWNER_TIME_SHIFT) + DEVICE_MCU_COMMAND_HOLD_MS)) {
+		atomic_fetch_add_explicit(&(commands->rejected[command]), 1, memory_order_relaxed);
+		return DEVICE_MCU_ERROR_BUSY;
+	}
+	
+	uint64_t request = atomic_load_explicit(&(commands->request[command]), memory_order_relaxed);
+	uint64_t next;
+	
+	do {
+		uint64_t requested = now;
+		
+		if (request & COMMAND_PENDING) {
+			if ((client != ((request >> 8) & 0xFF)) && (priority < ((request >> 16) & DEVICE_MCU_COMMAND_MAX_PRIORITY))) {
+				atomic_fetch_add_explicit(&(commands->rejected[command]), 1, memory_order_relaxed);
+				return DEVICE_MCU_ERROR_BUSY;
+			}
+			
+			requested = (request >> COMMAND_TIME_SHIFT);
+		}
+		
+		next = (
+				((uint64_t) value) |
+				((uint64_t) client << 8) |
+				((uint64_t) priority << 16) |
+				COMMAND_PENDING |
+				(requested << COMMAND_TIME_SHIFT)
+		);
+	} while (!atomic_compare_exchange_weak_explicit(&(commands->request[command]), &request, next,
+													memory_order_release, memory_order_relaxed));
+	
+	if (request & COMMAND_PENDING) {
+		atomic_fetch_add_explicit(&(commands->coalesced[command]), 1, memory_order_relaxed);
+	}
+	
+	atomic_store_explicit(&(commands->active), true, memory_order_relaxed);
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_get_command_stats(const device_mcu_type* device, device_mcu_command_type command, device_mcu_command_stats_type* stats) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	device_mcu_commands_type* commands = (device_mcu_commands_type*) device->commands;
+	
+	if ((!commands) || (!stats)) {
+		device_mcu_error("Not allocated");
+		return DEVICE_MCU_ERROR_UNKNOWN;
+	}
+	
+	if ((command < 0) || (command >= DEVICE_MCU_COMMAND_COUNT)) {
+		device_mcu_error("Unknown command");
+		return DEVICE_MCU_ERROR_UNEXPECTED;
+	}
+	
+	stats->requested = (uint32_t) atomic_load_explicit(&(commands->requested[command]), memory_order_relaxed);
+	stats->coalesced = (uint32_t) atomic_load_explicit(&(commands->coalesced[command]), memory_order_relaxed);
+	stats->rejected = (uint32_t) atomic_load_explicit(&(commands->rejected[command]), memory_order_relaxed);
+	stats->sent = (uint32_t) atomic_load_explicit(&(commands->sent[command]), memory_order_relaxed);
+	stats->failed = (uint32_t) atomic_load_explicit(&(commands->failed[command]), memory_order_relaxed);
+	stats->latency = atomic_load_explicit(&(commands->latency[command]), memory_order_relaxed);
+	stats->latency_max = atomic_load_explicit(&(commands->latency_max[command]), memory_order_relaxed);
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_set_heartbeat(device_mcu_type* device, uint16_t interval, uint16_t timeout) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	if ((interval > 0) && (timeout <= interval)) {
+		device_mcu_error("Link timeout too short");
+		return DEVICE_MCU_ERROR_UNEXPECTED;
+	}
+	
+	device->heartbeat_interval = interval;
+	device->link_timeout = timeout;
+	
+	device->link.pending_heartbeat = 0;
+	device->link.next_heartbeat = 0;
+	
+	if (!interval) {
+		device->link.armed = false;
+		device->link.alive = false;
+	}
+	
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_heartbeat(device_mcu_type* device) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+
+	if (!device->handle) {
+		device_mcu_error("No handle");
+		return DEVICE_MCU_ERROR_NO_HANDLE;
+	}
+	
+	const uint64_t now = device_time_now();
+	
+	if (!send_payload_action(device, DEVICE_MCU_MSG_P_HEARTBEAT, 0, NULL)) {
+		device_mcu_error("Sending heartbeat failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
+	
+	device->link.pending_heartbeat = now;
+	device->link.next_heartbeat = now + device->heartbeat_interval * DEVICE_TIME_MS;
+	device->link.heartbeats_sent++;
+	
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+device_mcu_error_type device_mcu_get_link(const device_mcu_type* device, device_mcu_link_type* link) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+	
+	if (!link) {
+		device_mcu_error("No link");
+		return DEVICE_MCU_ERROR_UNEXPECTED;
+	}
+	
+	*link = device->link;
+	return DEVICE_MCU_ERROR_NO_ERROR;
+}
+
+const device_mcu_display_mode_info_type* device_mcu_get_display_modes(uint32_t* count) {
+	if (count) {
+		*count = sizeof(display_modes) / sizeof(display_modes[0]);
+	}
+	
+	return display_modes;
+}
+
+const device_mcu_display_mode_info_type* device_mcu_get_display_mode_info(uint8_t mode) {
+	for (size_t i = 0; i < sizeof(display_modes) / sizeof(display_modes[0]); i++) {
+		if (display_modes[i].mode == mode) {
+			return &(display_modes[i]);
+		}
+	}
+	
+	return NULL;
+}
+
+device_mcu_error_type device_mcu_poll_display_mode(device_mcu_type* device) {
+	if (!device) {
+		device_mcu_error("No device");
+		return DEVICE_MCU_ERROR_NO_DEVICE;
+	}
+
+	if (!device->handle) {
+		device_mcu_error("No handle");
+		return DEVICE_MCU_ERROR_NO_HANDLE;
+	}
 
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_DISP_MODE, 1, &device->disp_mode)) {
+	uint8_t disp_mode;
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_DISP_MODE, 1, &disp_mode, request_deadline())) {
 		device_mcu_error("Receiving display mode failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
 
+	update_display_mode(device, disp_mode);
+	publish_state(device);
 	return DEVICE_MCU_ERROR_NO_ERROR;
 }
 
@@ -598,11 +1551,18 @@ device_mcu_error_type device_mcu_update_display_mode(device_mcu_type* device) {
 		return DEVICE_MCU_ERROR_NO_HANDLE;
 	}
 
-	if (!do_payload_action(device, DEVICE_MCU_MSG_W_DISP_MODE, 1, &device->disp_mode)) {
+	// The requested mode is already stored in the device, so compare against the last published one
+	const uint8_t disp_mode = device->disp_mode;
+	const uint64_t state = __atomic_load_n(&(device->state), __ATOMIC_ACQUIRE);
+
+	if (!do_payload_action(device, DEVICE_MCU_MSG_W_DISP_MODE, 1, &disp_mode)) {
 		device_mcu_error("Sending display mode failed");
 		return DEVICE_MCU_ERROR_PAYLOAD_FAILED;
 	}
 
+	device->disp_mode = (uint8_t) ((state >> 8) & 0xFF);
+	update_display_mode(device, disp_mode);
+	publish_state(device);
 	return DEVICE_MCU_ERROR_NO_ERROR;
 }
 
@@ -654,13 +1614,8 @@ device_mcu_error_type device_mcu_update_firmware(device_mcu_type* device, const
 		goto cleanup;
 	}
 
-	if (!send_payload_action(device, DEVICE_MCU_MSG_R_ACTIVATION_TIME, 0, NULL)) {
-		device_mcu_error("Requesting activation time failed");
-		goto cleanup;
-	}
-
 	uint8_t activated;
-	if (!recv_payload_msg(device, DEVICE_MCU_MSG_R_ACTIVATION_TIME, 1, &activated)) {
+	if (!do_payload_request(device, DEVICE_MCU_MSG_R_ACTIVATION_TIME, 1, &activated, request_deadline())) {
 		device_mcu_error("Receiving activation time failed");
 		goto cleanup;
 	}
@@ -728,6 +1683,29 @@ device_mcu_error_type device_mcu_close(device_mcu_type* device) {
 		hid_close(device->handle);
 	}
 	
+	if (device->queue) {
+		ring_buffer_destroy((ring_buffer_type*) device->queue);
+	}
+	
+	if (device->log) {
+		device_mcu_log_type* log = (device_mcu_log_type*) device->log;
+		
+		if (log->file) {
+			fclose(log->file);
+		}
+		
+		if (log->path) {
+			free(log->path);
+		}
+		
+		ring_buffer_destroy(log->ring);
+		free(log);
+	}
+	
+	if (device->commands) {
+		free(device->commands);
+	}
+	
 	memset(device, 0, sizeof(device_mcu_type));
 	device_exit();
 
@@ -0,0 +1,51 @@
+#pragma once
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <stdint.h>
+#include <time.h>
+
+#define DEVICE_TIME_MS (1000000ULL)
+
+// Monotonic host time in nanoseconds (unaffected by wall clock adjustments)
+static inline uint64_t device_time_now() {
+	struct timespec ts;
+
+	if (0 != clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		return 0;
+	}
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Remaining milliseconds until a deadline (rounded up, zero once passed)
+static inline int device_time_until_ms(uint64_t deadline) {
+	const uint64_t now = device_time_now();
+
+	if (now >= deadline) {
+		return 0;
+	}
+
+	return (int) ((deadline - now + DEVICE_TIME_MS - 1) / DEVICE_TIME_MS);
+}
@@ -0,0 +1,183 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "ring_buffer.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounded multi-producer/multi-consumer queue after Dmitry Vyukov: every cell
+// carries a sequence number telling whether it's ready to be written or read.
+struct ring_buffer_cell_t {
+	atomic_size_t sequence;
+	alignas(max_align_t) unsigned char data [];
+};
+
+typedef struct ring_buffer_cell_t ring_buffer_cell_type;
+
+struct ring_buffer_t {
+	size_t mask;
+	size_t element_size;
+	size_t stride;
+	
+	alignas(64) atomic_size_t enqueue_pos;
+	alignas(64) atomic_size_t dequeue_pos;
+	alignas(64) atomic_uint_fast32_t dropped;
+	
+	unsigned char* cells;
+};
+
+static ring_buffer_cell_type* ring_buffer_cell(const ring_buffer_type* ring, size_t pos) {
+	return (ring_buffer_cell_type*) (ring->cells + (pos & ring->mask) * ring->stride);
+}
+
+ring_buffer_type* ring_buffer_create(size_t capacity, size_t element_size) {
+	if ((capacity < 2) || (element_size == 0)) {
+		return NULL;
+	}
+	
+	size_t size = 2;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	
+	// The cursors are over-aligned to separate cache lines, which malloc doesn't guarantee
+	const size_t ring_align = alignof(ring_buffer_type);
+	ring_buffer_type* ring = aligned_alloc(ring_align, (sizeof(ring_buffer_type) + ring_align - 1) / ring_align * ring_align);
+	
+	if (!ring) {
+		return NULL;
+	}
+	
+	const size_t align = alignof(ring_buffer_cell_type);
+	
+	ring->mask = size - 1;
+	ring->element_size = element_size;
+	ring->stride = (sizeof(ring_buffer_cell_type) + element_size + align - 1) / align * align;
+	ring->cells = malloc(size * ring->stride);
+	
+	if (!ring->cells) {
+		free(ring);
+		return NULL;
+	}
+	
+	for (size_t i = 0; i < size; i++) {
+		atomic_init(&(ring_buffer_cell(ring, i)->sequence), i);
+	}
+	
+	atomic_init(&(ring->enqueue_pos), 0);
+	atomic_init(&(ring->dequeue_pos), 0);
+	atomic_init(&(ring->dropped), 0);
+	return ring;
+}
+
+bool ring_buffer_push(ring_buffer_type* ring, const void* element) {
+	if (!ring) {
+		return false;
+	}
+	
+	ring_buffer_cell_type* cell;
+	size_t pos = atomic_load_explicit(&(ring->enqueue_pos), memory_order_relaxed);
+	
+	for (;;) {
+		cell = ring_buffer_cell(ring, pos);
+		
+		const size_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+		const intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+		
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&(ring->enqueue_pos), &pos, pos + 1,
+													  memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&(ring->dropped), 1, memory_order_relaxed);
+			return false;
+		} else {
+			pos = atomic_load_explicit(&(ring->enqueue_pos), memory_order_relaxed);
+		}
+	}
+	
+	memcpy(cell->data, element, ring->element_size);
+	atomic_store_explicit(&(cell->sequence), pos + 1, memory_order_release);
+	return true;
+}
+
+bool ring_buffer_pop(ring_buffer_type* ring, void* element) {
+	if (!ring) {
+		return false;
+	}
+	
+	ring_buffer_cell_type* cell;
+	size_t pos = atomic_load_explicit(&(ring->dequeue_pos), memory_order_relaxed);
+	
+	for (;;) {
+		cell = ring_buffer_cell(ring, pos);
+		
+		const size_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+		const intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+		
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&(ring->dequeue_pos), &pos, pos + 1,
+													  memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = atomic_load_explicit(&(ring->dequeue_pos), memory_order_relaxed);
+		}
+	}
+	
+	memcpy(element, cell->data, ring->element_size);
+	atomic_store_explicit(&(cell->sequence), pos + ring->mask + 1, memory_order_release);
+	return true;
+}
+
+size_t ring_buffer_pop_batch(ring_buffer_type* ring, void* elements, size_t count) {
+	unsigned char* it = (unsigned char*) elements;
+	size_t popped = 0;
+	
+	while ((popped < count) && (ring_buffer_pop(ring, it))) {
+		it += ring->element_size;
+		popped++;
+	}
+	
+	return popped;
+}
+
+uint32_t ring_buffer_dropped(const ring_buffer_type* ring) {
+	return ring? (uint32_t) atomic_load_explicit(&(ring->dropped), memory_order_relaxed) : 0;
+}
+
+void ring_buffer_destroy(ring_buffer_type* ring) {
+	if (!ring) {
+		return;
+	}
+	
+	free(ring->cells);
+	free(ring);
+}
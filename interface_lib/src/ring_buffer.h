@@ -0,0 +1,61 @@
+#pragma once
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifndef __cplusplus
+#include <stddef.h>
+#include <stdint.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ring_buffer_t;
+
+typedef struct ring_buffer_t ring_buffer_type;
+
+// Bounded lock-free queue of fixed size elements (any thread may push or pop)
+ring_buffer_type* ring_buffer_create(size_t capacity, size_t element_size);
+
+bool ring_buffer_push(ring_buffer_type* ring, const void* element);
+
+bool ring_buffer_pop(ring_buffer_type* ring, void* element);
+
+size_t ring_buffer_pop_batch(ring_buffer_type* ring, void* elements, size_t count);
+
+uint32_t ring_buffer_dropped(const ring_buffer_type* ring);
+
+void ring_buffer_destroy(ring_buffer_type* ring);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,303 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "sim_device_imu.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <hidapi/hidapi.h>
+
+#include "crc32.h"
+#include "device_imu.h"
+#include "device_time.h"
+#include "endian_compat.h"
+#include "hid_ids.h"
+
+struct hid_device_ {
+	int unused;
+};
+
+sim_imu_type sim;
+static hid_device sim_device;
+static struct hid_device_info sim_info;
+
+static void sim_calibration() {
+	const char* json = "{\"IMU\":{\"device_1\":{"
+					   "\"accel_bias\":[0,0,0],\"accel_q_gyro\":[0,0,0,1],"
+					   "\"gyro_bias\":[0.01,0,0],\"gyro_q_mag\":[0,0,0,1],"
+					   "\"mag_bias\":[0,0,0],\"imu_noises\":[0,0,0,0],"
+					   "\"scale_accel\":[1,1,1],\"scale_gyro\":[1,1,1],\"scale_mag\":[1,1,1]"
+					   "}},\"padding\":\"";
+
+	// Padded with a string value, so the download takes as many segments as a real calibration file
+	memset(sim.calibration, 'x', SIM_CALIBRATION_SIZE);
+	memcpy(sim.calibration, json, strlen(json));
+	memcpy(sim.calibration + SIM_CALIBRATION_SIZE - 2, "\"}", 2);
+
+	sim.calibration[SIM_CALIBRATION_SIZE] = '\0';
+	sim.calibration_len = SIM_CALIBRATION_SIZE;
+}
+
+void sim_reset(uint16_t product_id) {
+	memset(&sim, 0, sizeof(sim));
+
+	sim.product_id = product_id;
+	sim.report_size = xreal_imu_max_payload_size(product_id);
+	sim.accelerometer[1] = 1.0f;
+
+	sim_calibration();
+}
+
+static void sim_reply(uint8_t msgid, const void* data, uint16_t len, uint64_t delay) {
+	if ((sim.count >= SIM_QUEUE_SIZE) || (8 + len > SIM_REPORT_SIZE)) {
+		return;
+	}
+
+	sim_reply_type* reply = &(sim.replies[sim.count++]);
+	memset(reply, 0, sizeof(sim_reply_type));
+
+	const uint16_t length = 3 + len;
+
+	reply->data[0] = 0xAA;
+	reply->data[5] = (uint8_t) (length & 0xFF);
+	reply->data[6] = (uint8_t) (length >> 8);
+	reply->data[7] = msgid;
+
+	if (len > 0) {
+		memcpy(reply->data + 8, data, len);
+	}
+
+	const uint32_t checksum = (sim.zero_checksums? 0 : htole32(crc32_checksum(reply->data + 5, length)));
+	memcpy(reply->data + 1, &checksum, 4);
+
+	reply->ready = device_time_now() + delay;
+	reply->size = 8 + len;
+}
+
+static void sim_pack24(uint8_t* data, float value, int32_t divisor) {
+	const int32_t raw = (int32_t) (value * (float) divisor);
+
+	data[0] = (uint8_t) (raw & 0xFF);
+	data[1] = (uint8_t) ((raw >> 8) & 0xFF);
+	data[2] = (uint8_t) ((raw >> 16) & 0xFF);
+}
+
+static void sim_report(device_imu_packet_type* packet, uint64_t index) {
+	memset(packet, 0, sizeof(device_imu_packet_type));
+
+	packet->signature[0] = 0x01;
+	packet->signature[1] = 0x02;
+	packet->timestamp = htole64(SIM_DEVICE_EPOCH + index * DEVICE_TIME_MS);
+
+	if (sim.motion) {
+		sim.motion(index);
+	}
+
+	const uint32_t gyroscope_divisor = htole32(SIM_GYROSCOPE_DIVISOR);
+	const uint32_t accelerometer_divisor = htole32(SIM_ACCELEROMETER_DIVISOR);
+
+	packet->angular_multiplier[0] = 1;
+	memcpy(packet->angular_divisor, &gyroscope_divisor, 4);
+	sim_pack24(packet->angular_velocity_x, sim.gyroscope[0], SIM_GYROSCOPE_DIVISOR);
+	sim_pack24(packet->angular_velocity_y, sim.gyroscope[1], SIM_GYROSCOPE_DIVISOR);
+	sim_pack24(packet->angular_velocity_z, sim.gyroscope[2], SIM_GYROSCOPE_DIVISOR);
+
+	packet->acceleration_multiplier[0] = 1;
+	memcpy(packet->acceleration_divisor, &accelerometer_divisor, 4);
+	sim_pack24(packet->acceleration_x, sim.accelerometer[0], SIM_ACCELEROMETER_DIVISOR);
+	sim_pack24(packet->acceleration_y, sim.accelerometer[1], SIM_ACCELEROMETER_DIVISOR);
+	sim_pack24(packet->acceleration_z, sim.accelerometer[2], SIM_ACCELEROMETER_DIVISOR);
+
+	// Big-endian scale and zero values with the flipped sign bit
+	packet->magnetic_multiplier[1] = 1;
+	packet->magnetic_divisor[3] = 1;
+	packet->magnetic_x[1] = 0x80;
+	packet->magnetic_y[1] = 0x80;
+	packet->magnetic_z[1] = 0x80;
+}
+
+static uint64_t sim_report_due(uint64_t index) {
+	if (sim.unpaced) {
+		return 0;
+	}
+
+	return sim.stream_start + index * DEVICE_TIME_MS + SIM_REPORT_LATENCY_US * 1000ULL;
+}
+
+int hid_init(void) {
+	return 0;
+}
+
+int hid_exit(void) {
+	return 0;
+}
+
+struct hid_device_info* hid_enumerate(unsigned short vendor_id, unsigned short product_id) {
+	(void) product_id;
+
+	memset(&sim_info, 0, sizeof(sim_info));
+	sim_info.path = "sim";
+	sim_info.vendor_id = vendor_id;
+	sim_info.product_id = sim.product_id;
+	sim_info.interface_number = xreal_imu_interface_id(sim.product_id);
+	return &sim_info;
+}
+
+void hid_free_enumeration(struct hid_device_info* devs) {
+	(void) devs;
+}
+
+hid_device* hid_open_path(const char* path) {
+	(void) path;
+	return &sim_device;
+}
+
+void hid_close(hid_device* dev) {
+	(void) dev;
+}
+
+int hid_write(hid_device* dev, const unsigned char* data, size_t length) {
+	(void) dev;
+
+	if ((length < 8) || (data[0] != 0xAA)) {
+		return -1;
+	}
+
+	const uint8_t msgid = data[7];
+	const uint32_t static_id = htole32(0x20230101);
+
+	switch (msgid) {
+		case DEVICE_IMU_MSG_START_IMU_DATA: {
+			uint64_t delay = sim.reply_delay;
+
+			if (data[8]) {
+				if (sim.starts < 2) {
+					delay = sim.start_delays[sim.starts];
+				}
+
+				sim.starts++;
+
+				if (!sim.streaming) {
+					sim.stream_start = device_time_now();
+					sim.reports = 0;
+				}
+			}
+
+			sim.streaming = (data[8] != 0);
+			sim_reply(msgid, NULL, 0, delay);
+			break;
+		}
+		case DEVICE_IMU_MSG_GET_STATIC_ID:
+			sim_reply(msgid, &static_id, 4, sim.reply_delay);
+			break;
+		case DEVICE_IMU_MSG_GET_CAL_DATA_LENGTH: {
+			const uint32_t len = htole32(sim.calibration_len);
+
+			sim.calibration_sent = 0;
+			sim_reply(msgid, &len, 4, sim.reply_delay);
+			break;
+		}
+		case DEVICE_IMU_MSG_CAL_DATA_GET_NEXT_SEGMENT: {
+			const uint32_t remaining = sim.calibration_len - sim.calibration_sent;
+			const uint16_t segment = (remaining > sim.report_size - 8u? sim.report_size - 8u : remaining);
+
+			sim_reply(msgid, sim.calibration + sim.calibration_sent, segment, sim.reply_delay);
+			sim.calibration_sent += segment;
+
+			if ((++sim.segments == sim.corrupt_segment) && (sim.count > 0)) {
+				sim.replies[sim.count - 1].data[1] ^= 0xFF;
+			}
+			break;
+		}
+		default:
+			sim_reply(msgid, NULL, 0, sim.reply_delay);
+			break;
+	}
+
+	return (int) length;
+}
+
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds) {
+	(void) dev;
+
+	const uint64_t start = device_time_now();
+	const uint64_t deadline = start + (uint64_t) (milliseconds > 0? milliseconds : 0) * DEVICE_TIME_MS;
+	const size_t size = (length < sim.report_size? length : sim.report_size);
+
+	for (;;) {
+		const uint64_t now = device_time_now();
+		uint64_t next = deadline;
+
+		// Replies leave in the order they become ready, the reports in between keep their own schedule
+		for (uint32_t i = 0; i < sim.count; i++) {
+			if (sim.replies[i].ready <= now) {
+				memcpy(data, sim.replies[i].data, size);
+
+				sim.count--;
+				memmove(&(sim.replies[i]), &(sim.replies[i + 1]), (sim.count - i) * sizeof(sim_reply_type));
+				return (int) size;
+			}
+
+			if (sim.replies[i].ready < next) {
+				next = sim.replies[i].ready;
+			}
+		}
+
+		if (sim.streaming) {
+			const uint64_t due = sim_report_due(sim.reports);
+
+			if (due <= now) {
+				uint8_t report [SIM_REPORT_SIZE];
+				memset(report, 0, sizeof(report));
+
+				sim_report((device_imu_packet_type*) report, sim.reports++);
+				memcpy(data, report, size);
+				return (int) size;
+			}
+
+			if (due < next) {
+				next = due;
+			}
+		}
+
+		// Blocking without anything scheduled would never return
+		if ((milliseconds < 0) && (next == deadline)) {
+			return 0;
+		}
+
+		if ((milliseconds >= 0) && (now >= deadline)) {
+			return 0;
+		}
+
+		const uint64_t wait = (next > now? next - now : 0);
+		const struct timespec ts = { (time_t) (wait / 1000000000ULL), (long) (wait % 1000000000ULL) };
+		nanosleep(&ts, NULL);
+	}
+}
+
+int hid_read(hid_device* dev, unsigned char* data, size_t length) {
+	return hid_read_timeout(dev, data, length, -1);
+}
@@ -0,0 +1,102 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Simulated IMU for the tests, it takes the place of hidapi with the hid_* functions. Reports stream at 1 kHz in
+// host time, commands get answered through a queue of delayed replies and the factory calibration gets served in
+// segments of the payload size of the product.
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifndef __cplusplus
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#define SIM_QUEUE_SIZE 64
+#define SIM_REPORT_SIZE 512
+#define SIM_CALIBRATION_SIZE 4096 // (several segments even with the largest payload)
+#define SIM_REPORT_LATENCY_US 200
+#define SIM_REPLY_DELAY_US 1000 // (one round trip per USB frame)
+#define SIM_GYROSCOPE_BIAS 0.01f // (of the factory calibration in rad/s, shows whether it got applied)
+#define SIM_DEVICE_EPOCH (1000000000000ULL) // (device time of the first report in ns)
+
+#define SIM_GYROSCOPE_DIVISOR 1000 // (raw values in m°/s)
+#define SIM_ACCELEROMETER_DIVISOR 100000 // (raw values in 10 µg)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sim_reply_t {
+	uint64_t ready; // (host time in ns)
+	uint16_t size;
+	uint8_t data [SIM_REPORT_SIZE];
+};
+
+typedef struct sim_reply_t sim_reply_type;
+
+typedef void (*sim_motion_func)(uint64_t index);
+
+struct sim_imu_t {
+	uint16_t product_id;
+	uint16_t report_size;
+
+	sim_reply_type replies [SIM_QUEUE_SIZE];
+	uint32_t count;
+
+	uint64_t reply_delay; // (in ns)
+	uint64_t start_delays [2]; // (of the replies to the first two commands starting the stream in ns)
+	uint32_t starts;
+
+	char calibration [SIM_CALIBRATION_SIZE + 1];
+	uint32_t calibration_len;
+	uint32_t calibration_sent;
+	uint32_t segments;
+
+	bool zero_checksums; // (replies leave the checksum empty)
+	uint32_t corrupt_segment; // (number of the one segment sent with a wrong checksum, 0 for none)
+
+	bool streaming;
+	bool unpaced; // (every report is due right away, for benchmarks)
+	uint64_t stream_start; // (host time in ns)
+	uint64_t reports;
+
+	sim_motion_func motion; // (updates the vectors below before each report, NULL keeps them constant)
+	float gyroscope [3]; // (in °/s)
+	float accelerometer [3]; // (in g)
+};
+
+typedef struct sim_imu_t sim_imu_type;
+
+extern sim_imu_type sim;
+
+void sim_reset(uint16_t product_id);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,459 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Runs the IMU against the simulated device, covering the handshake, stalls, the calibration download and capturing.
+
+#include "device_imu.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_time.h"
+#include "hid_ids.h"
+#include "sim_device_imu.h"
+
+#define TEST_HANDSHAKE_TIMEOUT_MS 50
+#define TEST_STREAM_MS 300
+#define TEST_STALL_MS 400 // (beyond the stall threshold)
+#define TEST_ROTATION_RATE 30.0f // (about the gravity axis in °/s)
+#define TEST_CAPTURE_PATH "test_device_imu.capture"
+#define TEST_DECIMATOR_RATE 100
+#define TEST_DROP_INTERVAL 3 // (every third sample gets dropped before the fusion)
+#define TEST_STARTUP_RATE -2.0f // (still device with a gyroscope bias, seeded as a negative offset)
+
+static uint64_t test_samples = 0;
+static device_imu_sample_type test_previous;
+static device_imu_sample_type test_before_catchup;
+static device_imu_sample_type test_after_catchup;
+
+static void test_sample(const device_imu_sample_type* sample, void* userdata) {
+	(void) userdata;
+
+	if ((sample->flags & DEVICE_IMU_SAMPLE_FLAG_CAUGHT_UP) && (!test_after_catchup.timestamp)) {
+		test_before_catchup = test_previous;
+		test_after_catchup = *sample;
+	}
+
+	test_previous = *sample;
+	test_samples++;
+}
+
+static void test_reset_samples() {
+	test_samples = 0;
+
+	memset(&test_previous, 0, sizeof(test_previous));
+	memset(&test_before_catchup, 0, sizeof(test_before_catchup));
+	memset(&test_after_catchup, 0, sizeof(test_after_catchup));
+}
+
+// Rotation between two orientations in degrees
+static float test_angle(const device_imu_quat_type* a, const device_imu_quat_type* b) {
+	const float dot = fabsf(a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w);
+	return 2.0f * acosf(dot < 1.0f? dot : 1.0f) * 180.0f / (float) M_PI;
+}
+
+static bool test_check(const char* name, bool passed) {
+	if (!passed) {
+		printf("%s: FAILED\n", name);
+	}
+
+	return passed;
+}
+
+static uint32_t test_read_until(device_imu_type* device, uint64_t until) {
+	uint32_t errors = 0;
+
+	while (device_time_now() < until) {
+		if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_read(device, 10)) {
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+static void test_options(device_imu_options_type* options) {
+	device_imu_default_options(options);
+
+	options->handshake_timeout = TEST_HANDSHAKE_TIMEOUT_MS;
+}
+
+// The factory calibration is the only one removing a gyroscope bias, so the rate of a still device shows it
+static bool test_calibrated(device_imu_type* device) {
+	const uint64_t until = device_time_now() + TEST_STREAM_MS * DEVICE_TIME_MS;
+
+	test_reset_samples();
+	device_imu_set_sample_callback(device, test_sample, NULL);
+
+	while ((test_samples < 10) && (device_time_now() < until)) {
+		device_imu_read(device, 10);
+	}
+
+	const device_imu_vec3_type g = test_previous.gyroscope;
+	const float rate = sqrtf(g.x * g.x + g.y * g.y + g.z * g.z);
+
+	return (test_samples >= 10) && (fabsf(rate - SIM_GYROSCOPE_BIAS * 180.0f / (float) M_PI) < 0.01f);
+}
+
+static bool test_lost_reply() {
+	device_imu_type dev;
+	device_imu_options_type options;
+
+	sim_reset(0x0424);
+	test_options(&options);
+
+	// The first reply arrives after the resend, so the reply to the resend only shows up while streaming
+	sim.start_delays[0] = (TEST_HANDSHAKE_TIMEOUT_MS + 20) * DEVICE_TIME_MS;
+	sim.start_delays[1] = (2 * TEST_HANDSHAKE_TIMEOUT_MS) * DEVICE_TIME_MS;
+
+	if (!test_check("lost reply open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	test_reset_samples();
+	device_imu_set_sample_callback(&dev, test_sample, NULL);
+
+	const uint32_t errors = test_read_until(&dev, device_time_now() + TEST_STREAM_MS * DEVICE_TIME_MS);
+
+	device_imu_stats_type stats;
+	device_imu_get_stats(&dev, &stats);
+	device_imu_close(&dev);
+
+	printf("lost reply: %u starts, %u stray replies, %u errors, %lu samples\n",
+		   sim.starts, stats.stray_replies, errors, (unsigned long) test_samples);
+
+	bool passed = true;
+
+	passed &= test_check("command resent", sim.starts == 2);
+	passed &= test_check("stray reply skipped", stats.stray_replies == 1);
+	passed &= test_check("no read errors", errors == 0);
+	passed &= test_check("samples delivered", test_samples > TEST_STREAM_MS / 2);
+	return passed;
+}
+
+static bool test_stall(bool fixed_point) {
+	device_imu_type dev;
+	device_imu_options_type options;
+
+	sim_reset(0x0424);
+	test_options(&options);
+
+	// The fixed-point path catches up on its own integrator
+	options.fixed_point = fixed_point;
+
+	// Turning about the gravity axis keeps the accelerometer constant, so only the gyroscope moves the orientation
+	sim.gyroscope[1] = TEST_ROTATION_RATE;
+
+	if (!test_check("stall open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	test_reset_samples();
+	device_imu_set_sample_callback(&dev, test_sample, NULL);
+
+	uint32_t errors = test_read_until(&dev, device_time_now() + TEST_STREAM_MS * DEVICE_TIME_MS);
+
+	device_imu_stats_type before;
+	device_imu_get_stats(&dev, &before);
+
+	const struct timespec ts = { 0, TEST_STALL_MS * 1000000L };
+	nanosleep(&ts, NULL);
+
+	errors += test_read_until(&dev, device_time_now() + TEST_STREAM_MS * DEVICE_TIME_MS);
+
+	device_imu_stats_type stats;
+	device_imu_get_stats(&dev, &stats);
+	device_imu_close(&dev);
+
+	const float elapsed = (float) ((double) (test_after_catchup.timestamp - test_before_catchup.timestamp) / 1e9);
+	const float expected = TEST_ROTATION_RATE * elapsed;
+	const float rotation = test_angle(&(test_before_catchup.orientation), &(test_after_catchup.orientation));
+
+	printf("stall%s: %u stalls, %lu caught up, %lu discarded, %.2f° over the stall (expected %.2f°)\n",
+		   fixed_point? " (fixed point)" : "", stats.stalls, (unsigned long) stats.catchup_samples, (unsigned long) (stats.discarded - before.discarded),
+		   rotation, expected);
+
+	bool passed = true;
+
+	passed &= test_check("stall detected", stats.stalls == 1);
+	passed &= test_check("no reports discarded", stats.discarded == before.discarded);
+	passed &= test_check("backlog caught up", stats.catchup_samples >= TEST_STALL_MS / 2);
+	passed &= test_check("rotation kept", (elapsed > 0.0f) && (fabsf(rotation - expected) < 0.5f));
+	passed &= test_check("no read errors", errors == 0);
+	return passed;
+}
+
+static bool test_download() {
+	bool passed = true;
+
+	for (uint32_t i = 0; i < NUM_SUPPORTED_PRODUCTS; i++) {
+		const uint16_t product_id = xreal_product_ids[i];
+		const uint32_t windows [2] = { 1, DEVICE_IMU_CALIBRATION_WINDOW };
+		uint64_t durations [2];
+		uint32_t segments = 0;
+
+		for (uint32_t j = 0; j < 2; j++) {
+			device_imu_type dev;
+			device_imu_options_type options;
+
+			sim_reset(product_id);
+			test_options(&options);
+
+			sim.reply_delay = SIM_REPLY_DELAY_US * 1000ULL;
+			options.calibration_window = windows[j];
+
+			if (!test_check("download open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+				return false;
+			}
+
+			durations[j] = dev.calibration_duration;
+			segments = sim.segments;
+
+			passed &= test_check("download calibrated", test_calibrated(&dev));
+			passed &= test_check("download without retries", dev.stats.calibration_retries == 0);
+
+			device_imu_close(&dev);
+		}
+
+		printf("download 0x%04x: %u byte payload, %u segments, %.1f ms sequential, %.1f ms with %u in flight\n",
+			   product_id, xreal_imu_max_payload_size(product_id), segments,
+			   (double) durations[0] / 1e6, (double) durations[1] / 1e6, windows[1]);
+
+		passed &= test_check("download pipelined", durations[1] < durations[0]);
+	}
+
+	return passed;
+}
+
+static bool test_checksums() {
+	device_imu_type dev;
+	device_imu_options_type options;
+	bool passed = true;
+
+	sim_reset(0x0424);
+	test_options(&options);
+
+	sim.zero_checksums = true;
+
+	if (!test_check("checksum open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	passed &= test_check("zero checksum unchecked", (dev.stats.checksum_errors == 0) && (test_calibrated(&dev)));
+	device_imu_close(&dev);
+
+	sim_reset(0x0424);
+	sim.corrupt_segment = 3;
+
+	if (!test_check("checksum open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	printf("checksums: %u errors, %u retries\n", dev.stats.checksum_errors, dev.stats.calibration_retries);
+
+	passed &= test_check("wrong checksum rejected", dev.stats.checksum_errors == 1);
+	passed &= test_check("download retried", (dev.stats.calibration_retries == 1) && (test_calibrated(&dev)));
+	device_imu_close(&dev);
+	return passed;
+}
+
+static bool test_capture() {
+	device_imu_type dev;
+	device_imu_options_type options;
+
+	sim_reset(0x0426);
+	test_options(&options);
+
+	sim.reply_delay = SIM_REPLY_DELAY_US * 1000ULL;
+	options.deferred_calibration = true;
+
+	if (!test_check("capture open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	const uint32_t version = dev.calibration_version;
+	bool passed = true;
+
+	passed &= test_check("capture start", DEVICE_IMU_ERROR_NO_ERROR == device_imu_start_capture(&dev, TEST_CAPTURE_PATH, 1000));
+
+	// Only capturing while the deferred download runs, so its replies have to be handled by the capture
+	const uint64_t until = device_time_now() + TEST_STREAM_MS * DEVICE_TIME_MS;
+	uint32_t errors = 0;
+
+	while (device_time_now() < until) {
+		if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_capture(&dev, 10)) {
+			errors++;
+		}
+	}
+
+	const uint64_t captured = device_imu_captured(&dev);
+
+	device_imu_stop_capture(&dev);
+	remove(TEST_CAPTURE_PATH);
+
+	printf("capture: %lu reports, calibration swapped in after %.1f ms\n",
+		   (unsigned long) captured, (double) dev.calibration_duration / 1e6);
+
+	passed &= test_check("capture without errors", errors == 0);
+	passed &= test_check("reports captured", captured > TEST_STREAM_MS / 2);
+	passed &= test_check("download finished while capturing", dev.calibration_version != version);
+	passed &= test_check("capture calibrated", test_calibrated(&dev));
+
+	device_imu_close(&dev);
+	return passed;
+}
+
+static uint32_t test_stage_samples = 0;
+static uint32_t test_dropped_callbacks = 0;
+static uint32_t test_decimated = 0;
+
+static bool test_drop_stage(device_imu_sample_type* sample, void* userdata) {
+	(void) sample;
+	(void) userdata;
+
+	return (++test_stage_samples % TEST_DROP_INTERVAL != 0);
+}
+
+static void test_dropped_sample(const device_imu_sample_type* sample, void* userdata) {
+	(void) userdata;
+
+	if (sample->flags & DEVICE_IMU_SAMPLE_FLAG_DROPPED) {
+		test_dropped_callbacks++;
+	}
+
+	test_samples++;
+}
+
+static void test_decimated_sample(const device_imu_sample_type* sample, void* userdata) {
+	(void) sample;
+	(void) userdata;
+
+	test_decimated++;
+}
+
+static bool test_dropped() {
+	device_imu_type dev;
+	device_imu_options_type options;
+	device_imu_decimator_type decimator;
+
+	sim_reset(0x0424);
+	test_options(&options);
+
+	if (!test_check("drop open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	bool passed = true;
+
+	test_reset_samples();
+	device_imu_set_sample_callback(&dev, test_dropped_sample, NULL);
+
+	passed &= test_check("drop stage", DEVICE_IMU_ERROR_NO_ERROR == device_imu_add_stage(
+			&dev, DEVICE_IMU_STAGE_PRE_FUSION, test_drop_stage, NULL
+	));
+
+	passed &= test_check("decimator init", DEVICE_IMU_ERROR_NO_ERROR == device_imu_decimator_init(
+			&decimator, TEST_DECIMATOR_RATE, test_decimated_sample, NULL
+	));
+
+	device_imu_decimator_attach(&decimator, &dev);
+
+	const uint32_t errors = test_read_until(&dev, device_time_now() + TEST_STREAM_MS * DEVICE_TIME_MS);
+	const uint32_t expected = (test_stage_samples + DEVICE_IMU_SAMPLE_RATE / TEST_DECIMATOR_RATE - 1) / (DEVICE_IMU_SAMPLE_RATE / TEST_DECIMATOR_RATE);
+
+	device_imu_close(&dev);
+	device_imu_decimator_free(&decimator);
+
+	printf("dropped: %u samples, %lu passed on, %u decimated (expected %u)\n",
+		   test_stage_samples, (unsigned long) test_samples, test_decimated, expected);
+
+	passed &= test_check("decimator keeps its rate", test_decimated == expected);
+	passed &= test_check("callback skips dropped", (test_dropped_callbacks == 0) &&
+			(test_samples == test_stage_samples - test_stage_samples / TEST_DROP_INTERVAL));
+	passed &= test_check("no read errors", errors == 0);
+	return passed;
+}
+
+static bool test_startup(bool fixed_point) {
+	device_imu_type dev;
+	device_imu_options_type options;
+
+	sim_reset(0x0424);
+	test_options(&options);
+
+	options.fixed_point = fixed_point;
+	options.adaptive_startup = true;
+	sim.gyroscope[0] = TEST_STARTUP_RATE;
+
+	if (!test_check("startup open", DEVICE_IMU_ERROR_NO_ERROR == device_imu_open_ex(&dev, NULL, &options))) {
+		return false;
+	}
+
+	test_reset_samples();
+	device_imu_set_sample_callback(&dev, test_sample, NULL);
+
+	// The fixed ramp of FusionAhrs takes 3 s, the controller has to converge well before
+	const uint32_t errors = test_read_until(&dev, device_time_now() + 5 * TEST_STREAM_MS * DEVICE_TIME_MS);
+	const uint64_t stable = dev.stable_duration;
+
+	device_imu_close(&dev);
+
+	// The seeded offset removes the whole bias, the gain ramp would still take seconds to get there
+	const device_imu_vec3_type g = test_previous.gyroscope;
+	const float rate = sqrtf(g.x * g.x + g.y * g.y + g.z * g.z);
+
+	printf("startup%s: stable after %.1f ms, %.4f °/s left of the bias\n",
+		   fixed_point? " (fixed point)" : "", (double) stable / 1e6, rate);
+
+	bool passed = true;
+
+	passed &= test_check("startup converged", stable > 0);
+	passed &= test_check("offset seeded", rate < 0.01f);
+	passed &= test_check("no read errors", errors == 0);
+	return passed;
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+
+	bool passed = true;
+
+	passed &= test_lost_reply();
+	passed &= test_stall(false);
+	passed &= test_stall(true);
+	passed &= test_download();
+	passed &= test_checksums();
+	passed &= test_capture();
+	passed &= test_dropped();
+	passed &= test_startup(false);
+	passed &= test_startup(true);
+
+	return passed? 0 : 1;
+}
@@ -0,0 +1,228 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Times device_imu_get_euler_batch() and device_imu_get_matrix_batch() against converting each quaternion on its own
+// through Fusion, and measures how far the polynomial arctangent of the batch path strays from the scalar float path
+// and from a double reference of the same formulas.
+
+#include "device_imu.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <Fusion/Fusion.h>
+
+#include "device_time.h"
+
+#define TEST_QUATERNIONS 4000000
+#define TEST_RUNS 3
+
+#define TEST_EULER_DEGREES 2e-4 // (largest difference to the scalar float path)
+#define TEST_MATRIX_ERROR 1e-6f
+
+static uint64_t test_state = 0x9E3779B97F4A7C15ULL;
+
+static float test_random(float min, float max) {
+	// xorshift64*, deterministic so failures can be reproduced
+	test_state ^= test_state >> 12;
+	test_state ^= test_state << 25;
+	test_state ^= test_state >> 27;
+	
+	const uint64_t bits = (test_state * 0x2545F4914F6CDD1DULL) >> 40;
+	return min + (max - min) * ((float) bits / (float) (1 << 24));
+}
+
+// Difference of two angles in degrees, wrapped around ±180°
+static double test_difference(double a, double b) {
+	double difference = fmod(fabs(a - b), 360.0);
+	return (difference > 180.0? 360.0 - difference : difference);
+}
+
+// Same formulas as FusionQuaternionToEuler() in double
+static void test_reference(const device_imu_quat_type* q, double angles [3]) {
+	const double x = q->x;
+	const double y = q->y;
+	const double z = q->z;
+	const double w = q->w;
+	
+	const double sine = 2.0 * (w * y - z * x);
+	
+	angles[0] = atan2(w * x + y * z, 0.5 - y * y - x * x) * 180.0 / M_PI;
+	angles[1] = asin(sine < -1.0? -1.0 : (sine > 1.0? 1.0 : sine)) * 180.0 / M_PI;
+	angles[2] = atan2(w * z + x * y, 0.5 - y * y - z * z) * 180.0 / M_PI;
+}
+
+static bool test_euler(const device_imu_quat_type* quats, device_imu_euler_type* batch, device_imu_euler_type* scalar) {
+	uint64_t best_batch = 0;
+	uint64_t best_scalar = 0;
+	
+	for (uint32_t run = 0; run < TEST_RUNS; run++) {
+		uint64_t start = device_time_now();
+		device_imu_get_euler_batch(quats, batch, TEST_QUATERNIONS);
+		const uint64_t batch_duration = device_time_now() - start;
+		
+		start = device_time_now();
+		
+		for (uint32_t i = 0; i < TEST_QUATERNIONS; i++) {
+			scalar[i] = device_imu_get_euler(quats[i]);
+		}
+		
+		const uint64_t scalar_duration = device_time_now() - start;
+		
+		if ((run == 0) || (batch_duration < best_batch)) {
+			best_batch = batch_duration;
+		}
+		
+		if ((run == 0) || (scalar_duration < best_scalar)) {
+			best_scalar = scalar_duration;
+		}
+	}
+	
+	double max_scalar = 0.0;
+	double max_batch_reference = 0.0;
+	double max_scalar_reference = 0.0;
+	
+	for (uint32_t i = 0; i < TEST_QUATERNIONS; i++) {
+		double reference [3];
+		test_reference(&(quats[i]), reference);
+		
+		const float values [3] = { batch[i].roll, batch[i].pitch, batch[i].yaw };
+		const float expected [3] = { scalar[i].roll, scalar[i].pitch, scalar[i].yaw };
+		
+		for (int j = 0; j < 3; j++) {
+			const double difference = test_difference(values[j], expected[j]);
+			const double batch_reference = test_difference(values[j], reference[j]);
+			const double scalar_reference = test_difference(expected[j], reference[j]);
+			
+			if (difference > max_scalar) {
+				max_scalar = difference;
+			}
+			
+			if (batch_reference > max_batch_reference) {
+				max_batch_reference = batch_reference;
+			}
+			
+			if (scalar_reference > max_scalar_reference) {
+				max_scalar_reference = scalar_reference;
+			}
+		}
+	}
+	
+	const bool passed = (max_scalar <= TEST_EULER_DEGREES);
+	
+	printf("euler: %s, %.1f ns batch vs %.1f ns scalar per quaternion, max %.2g° from scalar (bound %.0e°), "
+		   "max %.2g° batch %.2g° scalar from double\n",
+		   passed? "passed" : "FAILED", (double) best_batch / TEST_QUATERNIONS, (double) best_scalar / TEST_QUATERNIONS,
+		   max_scalar, TEST_EULER_DEGREES, max_batch_reference, max_scalar_reference);
+	return passed;
+}
+
+static bool test_matrix(const device_imu_quat_type* quats, float* batch, float* scalar) {
+	uint64_t best_batch = 0;
+	uint64_t best_scalar = 0;
+	
+	for (uint32_t run = 0; run < TEST_RUNS; run++) {
+		uint64_t start = device_time_now();
+		device_imu_get_matrix_batch(quats, batch, TEST_QUATERNIONS, false);
+		const uint64_t batch_duration = device_time_now() - start;
+		
+		start = device_time_now();
+		
+		for (uint32_t i = 0; i < TEST_QUATERNIONS; i++) {
+			const FusionQuaternion q = {
+					.element = { .w = quats[i].w, .x = quats[i].x, .y = quats[i].y, .z = quats[i].z }
+			};
+			
+			const FusionMatrix matrix = FusionQuaternionToMatrix(q);
+			
+			for (int j = 0; j < 9; j++) {
+				scalar[i * 9 + j] = matrix.array[j / 3][j % 3];
+			}
+		}
+		
+		const uint64_t scalar_duration = device_time_now() - start;
+		
+		if ((run == 0) || (batch_duration < best_batch)) {
+			best_batch = batch_duration;
+		}
+		
+		if ((run == 0) || (scalar_duration < best_scalar)) {
+			best_scalar = scalar_duration;
+		}
+	}
+	
+	float max_error = 0.0f;
+	
+	for (uint64_t i = 0; i < 9ULL * TEST_QUATERNIONS; i++) {
+		const float error = fabsf(batch[i] - scalar[i]);
+		
+		if (error > max_error) {
+			max_error = error;
+		}
+	}
+	
+	const bool passed = (max_error <= TEST_MATRIX_ERROR);
+	
+	printf("matrix: %s, %.1f ns batch vs %.1f ns scalar per quaternion, max %.2g from scalar (bound %.0e)\n",
+		   passed? "passed" : "FAILED", (double) best_batch / TEST_QUATERNIONS, (double) best_scalar / TEST_QUATERNIONS,
+		   max_error, TEST_MATRIX_ERROR);
+	return passed;
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	device_imu_quat_type* quats = malloc(sizeof(device_imu_quat_type) * TEST_QUATERNIONS);
+	device_imu_euler_type* eulers = malloc(sizeof(device_imu_euler_type) * 2 * TEST_QUATERNIONS);
+	float* matrices = malloc(sizeof(float) * 9 * 2 * TEST_QUATERNIONS);
+	
+	if ((!quats) || (!eulers) || (!matrices)) {
+		printf("allocation: FAILED\n");
+		return 1;
+	}
+	
+	for (uint32_t i = 0; i < TEST_QUATERNIONS; i++) {
+		const FusionQuaternion q = FusionQuaternionNormalise((FusionQuaternion) {
+				.array = { test_random(-1.0f, 1.0f), test_random(-1.0f, 1.0f), test_random(-1.0f, 1.0f), test_random(-1.0f, 1.0f) }
+		});
+		
+		quats[i].w = q.element.w;
+		quats[i].x = q.element.x;
+		quats[i].y = q.element.y;
+		quats[i].z = q.element.z;
+	}
+	
+	bool passed = true;
+	
+	passed &= test_euler(quats, eulers, eulers + TEST_QUATERNIONS);
+	passed &= test_matrix(quats, matrices, matrices + 9 * TEST_QUATERNIONS);
+	
+	free(quats);
+	free(eulers);
+	free(matrices);
+	
+	return passed? 0 : 1;
+}
@@ -0,0 +1,167 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Feeds a 10 °/s, 5 Hz gyroscope signal with a 5 °/s tone at 0.7 of the output rate through the decimator for every
+// output rate from 500 Hz down to 100 Hz. Keeping every n-th sample folds the tone back into the band, the filtered
+// outputs must stay close to the signal alone. The time per input sample gets measured against full-rate delivery.
+
+#include "device_imu.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "device_time.h"
+
+#define TEST_DURATION_S 20
+#define TEST_BENCH_SAMPLES 100000
+#define TEST_BENCH_RUNS 10
+#define TEST_SIGNAL_AMPLITUDE 10.0 // (in °/s)
+#define TEST_SIGNAL_FREQUENCY 5.0 // (in Hz)
+#define TEST_TONE_AMPLITUDE 5.0 // (in °/s)
+#define TEST_TONE_RATIO 0.7 // (of the output rate, above its Nyquist frequency)
+#define TEST_RESIDUAL 0.08 // (largest error of a filtered output in °/s, the passband droop at 100 Hz adds most of it)
+
+static const uint32_t test_rates [] = { 500, 250, 200, 125, 100 };
+
+static uint64_t test_delivered = 0;
+static device_imu_sample_type test_samples [TEST_BENCH_SAMPLES];
+
+static double test_signal(double t) {
+	return TEST_SIGNAL_AMPLITUDE * sin(2.0 * M_PI * TEST_SIGNAL_FREQUENCY * t);
+}
+
+static void test_input(device_imu_sample_type* sample, uint64_t index, uint32_t rate) {
+	const double t = (double) index / DEVICE_IMU_SAMPLE_RATE;
+	const double tone = TEST_TONE_AMPLITUDE * sin(2.0 * M_PI * TEST_TONE_RATIO * rate * t + 0.5);
+	
+	memset(sample, 0, sizeof(device_imu_sample_type));
+	
+	sample->sequence = index;
+	sample->timestamp = index * (1000000000ULL / DEVICE_IMU_SAMPLE_RATE);
+	sample->gyroscope.x = (float) (test_signal(t) + tone);
+	sample->raw_gyroscope = sample->gyroscope;
+	sample->orientation.w = 1.0f;
+}
+
+static void test_deliver(const device_imu_sample_type* sample, void* userdata) {
+	(void) userdata;
+	
+	test_delivered += sample->sequence;
+}
+
+static bool test_aliasing(uint32_t rate) {
+	device_imu_decimator_type decimator;
+	
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_decimator_init(&decimator, rate, NULL, NULL)) {
+		printf("%u Hz init: FAILED\n", rate);
+		return false;
+	}
+	
+	double naive_error = 0.0;
+	double filtered_error = 0.0;
+	
+	for (uint64_t i = 0; i < TEST_DURATION_S * DEVICE_IMU_SAMPLE_RATE; i++) {
+		device_imu_sample_type sample;
+		device_imu_sample_type output;
+		
+		test_input(&sample, i, rate);
+		
+		// The primed history only holds copies of the first sample, so the outputs start once it got replaced
+		const bool settled = (i >= decimator.taps);
+		
+		if ((settled) && (i % decimator.factor == 0)) {
+			const double error = fabs(sample.gyroscope.x - test_signal((double) sample.timestamp / 1e9));
+			
+			if (error > naive_error) {
+				naive_error = error;
+			}
+		}
+		
+		if ((device_imu_decimator_process(&decimator, &sample, &output)) && (settled)) {
+			const double error = fabs(output.gyroscope.x - test_signal((double) output.timestamp / 1e9));
+			
+			if (error > filtered_error) {
+				filtered_error = error;
+			}
+		}
+	}
+	
+	// Same stream through the decimator and through a callback for every sample, which full-rate delivery costs
+	device_imu_sample_type* samples = &(decimator.sample);
+	device_imu_sample_callback deliver = test_deliver;
+	
+	for (uint64_t i = 0; i < TEST_BENCH_SAMPLES; i++) {
+		test_input(&(test_samples[i]), i, rate);
+	}
+	
+	uint64_t start = device_time_now();
+	
+	for (uint32_t run = 0; run < TEST_BENCH_RUNS; run++) {
+		for (uint64_t i = 0; i < TEST_BENCH_SAMPLES; i++) {
+			deliver(&(test_samples[i]), NULL);
+		}
+	}
+	
+	const uint64_t full_rate = device_time_now() - start;
+	
+	start = device_time_now();
+	
+	for (uint32_t run = 0; run < TEST_BENCH_RUNS; run++) {
+		for (uint64_t i = 0; i < TEST_BENCH_SAMPLES; i++) {
+			if (device_imu_decimator_process(&decimator, &(test_samples[i]), samples)) {
+				deliver(samples, NULL);
+			}
+		}
+	}
+	
+	const uint64_t decimated = device_time_now() - start;
+	
+	device_imu_decimator_free(&decimator);
+	
+	const bool passed = (filtered_error <= TEST_RESIDUAL) && (naive_error > TEST_TONE_AMPLITUDE / 2);
+	
+	printf("%u Hz: %s, max error %.3f °/s naive, %.4f °/s filtered (bound %.3f), "
+		   "%.1f ns per input decimated vs %.1f ns full rate (checksum %lu)\n",
+		   rate, passed? "passed" : "FAILED", naive_error, filtered_error, TEST_RESIDUAL,
+		   (double) decimated / (TEST_BENCH_RUNS * TEST_BENCH_SAMPLES), (double) full_rate / (TEST_BENCH_RUNS * TEST_BENCH_SAMPLES),
+		   (unsigned long) test_delivered);
+	return passed;
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	bool passed = true;
+	
+	for (uint32_t i = 0; i < sizeof(test_rates) / sizeof(test_rates[0]); i++) {
+		passed &= test_aliasing(test_rates[i]);
+	}
+	
+	return passed? 0 : 1;
+}
@@ -0,0 +1,213 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Streams a still device with vibration on top of gravity through the simulated IMU, with and without the low-pass
+// pre-filter, and counts how many fusion updates reject the accelerometer. The tilt of the orientation shows what the
+// rejections and the phase lag of the filter cost. The biquad kernel gets timed on its own as well.
+
+#include "device_imu.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "device_math.h"
+#include "device_time.h"
+#include "sim_device_imu.h"
+
+#define TEST_DURATION_S 300
+#define TEST_SETTLE_S 10 // (past the initialisation of the fusion)
+#define TEST_CUTOFF 10.0f // (in Hz)
+#define TEST_KERNEL_SAMPLES 10000000
+
+static const float test_frequencies [3] = { 23.0f, 31.0f, 47.0f }; // (of the vibration per axis in Hz)
+static const float test_amplitudes [3] = { 0.0f, 0.2f, 0.4f }; // (of the vibration in g)
+
+static float test_amplitude = 0.0f;
+
+static uint64_t test_samples = 0;
+static double test_tilt_sum = 0.0;
+static float test_reference [3]; // (gravity direction a still device without vibration converges to)
+static float test_gravity [3];
+
+static void test_motion(uint64_t index) {
+	const float t = (float) index / DEVICE_IMU_SAMPLE_RATE;
+	
+	// Cancels the gyroscope bias of the simulated calibration, so the device stays still
+	sim.gyroscope[0] = -SIM_GYROSCOPE_BIAS * 180.0f / (float) M_PI;
+	
+	for (int i = 0; i < 3; i++) {
+		sim.accelerometer[i] = (i == 1? 1.0f : 0.0f) + test_amplitude * sinf(2.0f * (float) M_PI * test_frequencies[i] * t);
+	}
+}
+
+static void test_sample(const device_imu_sample_type* sample, void* userdata) {
+	(void) userdata;
+	
+	// Gravity direction in the sensor frame as estimated by the orientation, the yaw doesn't change it
+	const device_imu_quat_type q = sample->orientation;
+	
+	test_gravity[0] = 2.0f * (q.x * q.z - q.w * q.y);
+	test_gravity[1] = 2.0f * (q.y * q.z + q.w * q.x);
+	test_gravity[2] = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+	
+	if (++test_samples <= TEST_SETTLE_S * DEVICE_IMU_SAMPLE_RATE) {
+		return;
+	}
+	
+	const float cosine = (test_gravity[0] * test_reference[0] +
+						  test_gravity[1] * test_reference[1] +
+						  test_gravity[2] * test_reference[2]);
+	
+	test_tilt_sum += acosf(cosine < 1.0f? (cosine > -1.0f? cosine : -1.0f) : 1.0f) * 180.0f / (float) M_PI;
+}
+
+static bool test_run(float amplitude, float cutoff, uint32_t duration, device_imu_stats_type* stats, double* tilt) {
+	device_imu_type dev;
+	device_imu_options_type options;
+	
+	sim_reset(0x0424);
+	sim.unpaced = true;
+	sim.motion = test_motion;
+	
+	device_imu_default_options(&options);
+	
+	// Unpaced reports run ahead of the host clock, which must not count as falling behind
+	options.stall_threshold = 0;
+	options.catchup_threshold = 0;
+	options.gyroscope_cutoff = cutoff;
+	options.accelerometer_cutoff = cutoff;
+	
+	test_amplitude = amplitude;
+	test_samples = 0;
+	test_tilt_sum = 0.0;
+	
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_open_ex(&dev, NULL, &options)) {
+		printf("open: FAILED\n");
+		return false;
+	}
+	
+	device_imu_set_sample_callback(&dev, test_sample, NULL);
+	
+	for (uint32_t i = 0; i < duration * DEVICE_IMU_SAMPLE_RATE; i++) {
+		device_imu_read(&dev, 0);
+	}
+	
+	device_imu_get_stats(&dev, stats);
+	device_imu_close(&dev);
+	
+	*tilt = (test_samples > TEST_SETTLE_S * DEVICE_IMU_SAMPLE_RATE?
+			test_tilt_sum / (double) (test_samples - TEST_SETTLE_S * DEVICE_IMU_SAMPLE_RATE) : 0.0
+	);
+	
+	return true;
+}
+
+static bool test_rejections() {
+	device_imu_stats_type reference_stats;
+	double reference_tilt;
+	
+	if (!test_run(0.0f, 0.0f, TEST_SETTLE_S, &reference_stats, &reference_tilt)) {
+		return false;
+	}
+	
+	for (int i = 0; i < 3; i++) {
+		test_reference[i] = test_gravity[i];
+	}
+	
+	bool passed = true;
+	
+	for (uint32_t i = 0; i < sizeof(test_amplitudes) / sizeof(test_amplitudes[0]); i++) {
+		device_imu_stats_type stats [2];
+		double tilts [2];
+		double rejected [2];
+		
+		for (uint32_t j = 0; j < 2; j++) {
+			if (!test_run(test_amplitudes[i], j? TEST_CUTOFF : 0.0f, TEST_DURATION_S, &(stats[j]), &(tilts[j]))) {
+				return false;
+			}
+			
+			rejected[j] = 100.0 * (double) stats[j].acceleration_rejections / (double) (stats[j].reports? stats[j].reports : 1);
+		}
+		
+		printf("%.1f g vibration: %.1f%% rejected, %u recoveries, %.2f° mean tilt unfiltered, "
+			   "%.1f%% rejected, %u recoveries, %.2f° mean tilt at %.0f Hz\n",
+			   test_amplitudes[i], rejected[0], stats[0].acceleration_recoveries, tilts[0],
+			   rejected[1], stats[1].acceleration_recoveries, tilts[1], TEST_CUTOFF);
+		
+		// The filter must remove the vibration before it reaches the rejection, without vibration there is nothing to gain
+		if (test_amplitudes[i] > 0.0f) {
+			const bool filtered = (rejected[1] < 1.0) && (rejected[0] > 10.0 * rejected[1]) && (tilts[1] < tilts[0]);
+			
+			if (!filtered) {
+				printf("%.1f g vibration: FAILED\n", test_amplitudes[i]);
+				passed = false;
+			}
+		}
+	}
+	
+	return passed;
+}
+
+static void test_kernel() {
+	device_math_biquad_type gyroscope;
+	device_math_biquad_type accelerometer;
+	
+	device_math_biquad_lowpass(&gyroscope, TEST_CUTOFF, (float) DEVICE_IMU_SAMPLE_RATE);
+	device_math_biquad_lowpass(&accelerometer, TEST_CUTOFF, (float) DEVICE_IMU_SAMPLE_RATE);
+	
+	FusionVector g = FUSION_VECTOR_ZERO;
+	FusionVector a = FUSION_VECTOR_ZERO;
+	FusionVector sum = FUSION_VECTOR_ZERO;
+	
+	const uint64_t start = device_time_now();
+	
+	for (uint32_t i = 0; i < TEST_KERNEL_SAMPLES; i++) {
+		g.axis.x = (float) (i & 0xFF);
+		a.axis.y = (float) (i & 0x7F);
+		
+		sum = FusionVectorAdd(sum, device_math_biquad_apply(&gyroscope, g));
+		sum = FusionVectorAdd(sum, device_math_biquad_apply(&accelerometer, a));
+	}
+	
+	const uint64_t duration = device_time_now() - start;
+	
+	// The sum keeps the loop from being optimised away
+	printf("kernel: %.1f ns per sample for both sensors (checksum %.3g)\n",
+		   (double) duration / TEST_KERNEL_SAMPLES, (double) (sum.axis.x + sum.axis.y));
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	const bool passed = test_rejections();
+	
+	// Only printed, the time depends on the host
+	test_kernel();
+	
+	return passed? 0 : 1;
+}
@@ -0,0 +1,410 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Runs the fixed-point filter and FusionAhrs side by side over the same synthetic 1 kHz motion (up to 200 °/s with
+// the matching gravity direction), reporting how far the orientations drift apart and the time per update. The
+// gyroscope-only integration of a catch-up gets compared against the exact rotation as well.
+
+#include "device_imu_fixed.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <Fusion/Fusion.h>
+
+#include "device_time.h"
+
+#define TEST_SAMPLE_RATE 1000
+#define TEST_DURATION_S 60
+#define TEST_BENCH_SAMPLES 100000
+#define TEST_BENCH_RUNS 3
+#define TEST_CATCHUP_MS 400
+
+#define TEST_GAIN 0.5f
+#define TEST_REJECTION 10.0f
+#define TEST_RECOVERY_PERIOD (5 * TEST_SAMPLE_RATE)
+
+#define TEST_FIXED_DEGREES 0.1 // (largest difference to FusionAhrs, the gain ramp at the start accounts for most of it)
+#define TEST_CATCHUP_DEGREES 0.05 // (largest difference to the exact rotation)
+
+struct test_motion_t {
+	double time;
+	double orientation [4]; // (w, x, y, z)
+	float gyroscope [3];
+	float accelerometer [3];
+};
+
+typedef struct test_motion_t test_motion_type;
+
+static void test_motion_init(test_motion_type* motion) {
+	motion->time = 0.0;
+	motion->orientation[0] = 1.0;
+	motion->orientation[1] = 0.0;
+	motion->orientation[2] = 0.0;
+	motion->orientation[3] = 0.0;
+}
+
+// Advances the exact orientation by one sample and fills in what the sensors would measure
+static void test_motion_step(test_motion_type* motion) {
+	static const double amplitudes [3] = { 200.0, 120.0, 80.0 };
+	static const double frequencies [3] = { 0.3, 0.7, 1.1 };
+	
+	const double dt = 1.0 / TEST_SAMPLE_RATE;
+	
+	for (int i = 0; i < 3; i++) {
+		motion->gyroscope[i] = (float) (amplitudes[i] * sin(2.0 * M_PI * frequencies[i] * motion->time + i));
+	}
+	
+	const double rx = motion->gyroscope[0] * M_PI / 180.0;
+	const double ry = motion->gyroscope[1] * M_PI / 180.0;
+	const double rz = motion->gyroscope[2] * M_PI / 180.0;
+	const double angle = sqrt(rx * rx + ry * ry + rz * rz) * dt;
+	
+	double r [4] = { 1.0, 0.0, 0.0, 0.0 };
+	
+	if (angle > 0.0) {
+		const double s = sin(angle * 0.5) / (angle / dt);
+		
+		r[0] = cos(angle * 0.5);
+		r[1] = rx * s;
+		r[2] = ry * s;
+		r[3] = rz * s;
+	}
+	
+	const double* q = motion->orientation;
+	const double w = q[0] * r[0] - q[1] * r[1] - q[2] * r[2] - q[3] * r[3];
+	const double x = q[0] * r[1] + q[1] * r[0] + q[2] * r[3] - q[3] * r[2];
+	const double y = q[0] * r[2] - q[1] * r[3] + q[2] * r[0] + q[3] * r[1];
+	const double z = q[0] * r[3] + q[1] * r[2] - q[2] * r[1] + q[3] * r[0];
+	
+	motion->orientation[0] = w;
+	motion->orientation[1] = x;
+	motion->orientation[2] = y;
+	motion->orientation[3] = z;
+	motion->time += dt;
+	
+	// Gravity direction in the sensor frame for NED (same as FusionAhrs)
+	motion->accelerometer[0] = (float) (2.0 * (w * y - x * z));
+	motion->accelerometer[1] = (float) (-2.0 * (y * z + w * x));
+	motion->accelerometer[2] = (float) (1.0 - 2.0 * (w * w + z * z));
+}
+
+static device_imu_fixed_vec3_type test_fixed_vector(const float vector [3]) {
+	device_imu_fixed_vec3_type fixed;
+	fixed.x = device_imu_fixed_from_float(vector[0], DEVICE_IMU_FIXED_SENSOR);
+	fixed.y = device_imu_fixed_from_float(vector[1], DEVICE_IMU_FIXED_SENSOR);
+	fixed.z = device_imu_fixed_from_float(vector[2], DEVICE_IMU_FIXED_SENSOR);
+	return fixed;
+}
+
+static FusionVector test_fusion_vector(const float vector [3]) {
+	const FusionVector fusion = {
+			.axis = { .x = vector[0], .y = vector[1], .z = vector[2] }
+	};
+	
+	return fusion;
+}
+
+// Angle between two orientations in degrees, either sign of a quaternion describes the same one
+static double test_angle(const double a [4], const double b [4]) {
+	const double dot = fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+	return 2.0 * acos(dot < 1.0? dot : 1.0) * 180.0 / M_PI;
+}
+
+// Rotation from one orientation to the next in the sensor frame
+static void test_relative(const double from [4], const double to [4], double r [4]) {
+	r[0] = from[0] * to[0] + from[1] * to[1] + from[2] * to[2] + from[3] * to[3];
+	r[1] = from[0] * to[1] - from[1] * to[0] - from[2] * to[3] + from[3] * to[2];
+	r[2] = from[0] * to[2] + from[1] * to[3] - from[2] * to[0] - from[3] * to[1];
+	r[3] = from[0] * to[3] - from[1] * to[2] + from[2] * to[1] - from[3] * to[0];
+}
+
+static void test_fixed_orientation(const device_imu_fixed_type* fixed, double q [4]) {
+	q[0] = device_imu_fixed_to_float(fixed->orientation.w, DEVICE_IMU_FIXED_UNIT);
+	q[1] = device_imu_fixed_to_float(fixed->orientation.x, DEVICE_IMU_FIXED_UNIT);
+	q[2] = device_imu_fixed_to_float(fixed->orientation.y, DEVICE_IMU_FIXED_UNIT);
+	q[3] = device_imu_fixed_to_float(fixed->orientation.z, DEVICE_IMU_FIXED_UNIT);
+}
+
+static void test_fusion_orientation(const FusionAhrs* ahrs, double q [4]) {
+	const FusionQuaternion quaternion = FusionAhrsGetQuaternion(ahrs);
+	
+	q[0] = quaternion.element.w;
+	q[1] = quaternion.element.x;
+	q[2] = quaternion.element.y;
+	q[3] = quaternion.element.z;
+}
+
+static void test_init(device_imu_fixed_type* fixed, FusionAhrs* ahrs) {
+	device_imu_fixed_init(fixed, TEST_GAIN, TEST_REJECTION, TEST_RECOVERY_PERIOD, TEST_SAMPLE_RATE);
+	
+	const FusionAhrsSettings settings = {
+			.convention = FusionConventionNed,
+			.gain = TEST_GAIN,
+			.accelerationRejection = TEST_REJECTION,
+			.magneticRejection = 20.0f,
+			.recoveryTriggerPeriod = TEST_RECOVERY_PERIOD,
+	};
+	
+	FusionAhrsInitialise(ahrs);
+	FusionAhrsSetSettings(ahrs, &settings);
+}
+
+static bool test_accuracy() {
+	device_imu_fixed_type fixed;
+	FusionAhrs ahrs;
+	test_motion_type motion;
+	
+	test_init(&fixed, &ahrs);
+	test_motion_init(&motion);
+	
+	const uint64_t delta = 1000000000ULL / TEST_SAMPLE_RATE;
+	const uint32_t samples = TEST_DURATION_S * TEST_SAMPLE_RATE;
+	
+	double max_difference = 0.0;
+	double sum_difference = 0.0;
+	double max_fixed_error = 0.0;
+	double max_fusion_error = 0.0;
+	
+	for (uint32_t n = 0; n < samples; n++) {
+		test_motion_step(&motion);
+		
+		const device_imu_fixed_vec3_type gyroscope = test_fixed_vector(motion.gyroscope);
+		const device_imu_fixed_vec3_type accelerometer = test_fixed_vector(motion.accelerometer);
+		
+		device_imu_fixed_update(&fixed, &gyroscope, &accelerometer, delta);
+		
+		FusionAhrsUpdateNoMagnetometer(
+				&ahrs,
+				test_fusion_vector(motion.gyroscope),
+				test_fusion_vector(motion.accelerometer),
+				1.0f / TEST_SAMPLE_RATE
+		);
+		
+		double q_fixed [4];
+		double q_fusion [4];
+		
+		test_fixed_orientation(&fixed, q_fixed);
+		test_fusion_orientation(&ahrs, q_fusion);
+		
+		const double difference = test_angle(q_fixed, q_fusion);
+		const double fixed_error = test_angle(q_fixed, motion.orientation);
+		const double fusion_error = test_angle(q_fusion, motion.orientation);
+		
+		sum_difference += difference;
+		
+		if (difference > max_difference) {
+			max_difference = difference;
+		}
+		
+		if (fixed_error > max_fixed_error) {
+			max_fixed_error = fixed_error;
+		}
+		
+		if (fusion_error > max_fusion_error) {
+			max_fusion_error = fusion_error;
+		}
+	}
+	
+	const bool passed = (max_difference <= TEST_FIXED_DEGREES);
+	
+	printf("accuracy: %s, fixed vs float max %.4f° mean %.4f° (bound %.1f°), error max %.4f° fixed %.4f° float\n",
+		   passed? "passed" : "FAILED", max_difference, sum_difference / samples, TEST_FIXED_DEGREES,
+		   max_fixed_error, max_fusion_error);
+	return passed;
+}
+
+static bool test_catchup() {
+	device_imu_fixed_type fixed;
+	FusionAhrs ahrs;
+	test_motion_type motion;
+	
+	test_init(&fixed, &ahrs);
+	test_motion_init(&motion);
+	
+	const uint64_t delta = 1000000000ULL / TEST_SAMPLE_RATE;
+	
+	// Settles both filters on the exact orientation before the accelerometer drops out
+	for (uint32_t n = 0; n < 10 * TEST_SAMPLE_RATE; n++) {
+		test_motion_step(&motion);
+		
+		const device_imu_fixed_vec3_type gyroscope = test_fixed_vector(motion.gyroscope);
+		const device_imu_fixed_vec3_type accelerometer = test_fixed_vector(motion.accelerometer);
+		
+		device_imu_fixed_update(&fixed, &gyroscope, &accelerometer, delta);
+		
+		FusionAhrsUpdateNoMagnetometer(
+				&ahrs,
+				test_fusion_vector(motion.gyroscope),
+				test_fusion_vector(motion.accelerometer),
+				1.0f / TEST_SAMPLE_RATE
+		);
+	}
+	
+	double start_fixed [4];
+	double start_fusion [4];
+	double start [4];
+	
+	test_fixed_orientation(&fixed, start_fixed);
+	test_fusion_orientation(&ahrs, start_fusion);
+	
+	for (int i = 0; i < 4; i++) {
+		start[i] = motion.orientation[i];
+	}
+	
+	// Same as a catch-up of device_imu_read(): the fixed-point filter integrates each report, the float one the mean rate
+	FusionVector rotation = FUSION_VECTOR_ZERO;
+	
+	for (uint32_t n = 0; n < TEST_CATCHUP_MS * TEST_SAMPLE_RATE / 1000; n++) {
+		test_motion_step(&motion);
+		
+		const device_imu_fixed_vec3_type gyroscope = test_fixed_vector(motion.gyroscope);
+		
+		device_imu_fixed_integrate(&fixed, &gyroscope, delta);
+		rotation = FusionVectorAdd(rotation, FusionVectorMultiplyScalar(test_fusion_vector(motion.gyroscope), 1.0f / TEST_SAMPLE_RATE));
+	}
+	
+	const float deltaTime = TEST_CATCHUP_MS / 1000.0f;
+	FusionAhrsUpdateNoMagnetometer(&ahrs, FusionVectorMultiplyScalar(rotation, 1.0f / deltaTime), FUSION_VECTOR_ZERO, deltaTime);
+	
+	double q_fixed [4];
+	double q_fusion [4];
+	
+	test_fixed_orientation(&fixed, q_fixed);
+	test_fusion_orientation(&ahrs, q_fusion);
+	
+	// Only the rotation during the catch-up counts, not the error both filters started with
+	double turned [3][4];
+	
+	test_relative(start, motion.orientation, turned[0]);
+	test_relative(start_fixed, q_fixed, turned[1]);
+	test_relative(start_fusion, q_fusion, turned[2]);
+	
+	const double identity [4] = { 1.0, 0.0, 0.0, 0.0 };
+	const double fixed_error = test_angle(turned[1], turned[0]);
+	const double fusion_error = test_angle(turned[2], turned[0]);
+	
+	// A single gap longer than the clamped time step of an update must keep its whole rotation
+	const float rate [3] = { 30.0f, 0.0f, 0.0f };
+	const device_imu_fixed_vec3_type gyroscope = test_fixed_vector(rate);
+	
+	test_fixed_orientation(&fixed, start_fixed);
+	device_imu_fixed_integrate(&fixed, &gyroscope, TEST_CATCHUP_MS * 1000000ULL);
+	test_fixed_orientation(&fixed, q_fixed);
+	test_relative(start_fixed, q_fixed, turned[1]);
+	
+	const double gap_error = fabs(test_angle(turned[1], identity) - rate[0] * TEST_CATCHUP_MS / 1000.0);
+	
+	const bool passed = (fixed_error <= TEST_CATCHUP_DEGREES) && (gap_error <= TEST_CATCHUP_DEGREES);
+	
+	printf("catch-up: %s, %.1f° turned in %u ms, error %.4f° fixed %.4f° float, gap error %.4f° (bound %.2f°)\n",
+		   passed? "passed" : "FAILED", test_angle(turned[0], identity), TEST_CATCHUP_MS, fixed_error, fusion_error, gap_error,
+		   TEST_CATCHUP_DEGREES);
+	return passed;
+}
+
+static float test_gyroscope [TEST_BENCH_SAMPLES][3];
+static float test_accelerometer [TEST_BENCH_SAMPLES][3];
+static device_imu_fixed_vec3_type test_fixed_gyroscope [TEST_BENCH_SAMPLES];
+static device_imu_fixed_vec3_type test_fixed_accelerometer [TEST_BENCH_SAMPLES];
+
+static void test_speed() {
+	test_motion_type motion;
+	test_motion_init(&motion);
+	
+	for (uint32_t n = 0; n < TEST_BENCH_SAMPLES; n++) {
+		test_motion_step(&motion);
+		
+		for (int i = 0; i < 3; i++) {
+			test_gyroscope[n][i] = motion.gyroscope[i];
+			test_accelerometer[n][i] = motion.accelerometer[i];
+		}
+		
+		test_fixed_gyroscope[n] = test_fixed_vector(motion.gyroscope);
+		test_fixed_accelerometer[n] = test_fixed_vector(motion.accelerometer);
+	}
+	
+	const uint64_t delta = 1000000000ULL / TEST_SAMPLE_RATE;
+	
+	uint64_t best_fixed = 0;
+	uint64_t best_fusion = 0;
+	double checksum = 0.0;
+	
+	for (uint32_t run = 0; run < TEST_BENCH_RUNS; run++) {
+		device_imu_fixed_type fixed;
+		FusionAhrs ahrs;
+		
+		test_init(&fixed, &ahrs);
+		
+		uint64_t start = device_time_now();
+		
+		for (uint32_t n = 0; n < TEST_BENCH_SAMPLES; n++) {
+			device_imu_fixed_update(&fixed, &(test_fixed_gyroscope[n]), &(test_fixed_accelerometer[n]), delta);
+		}
+		
+		const uint64_t fixed_duration = device_time_now() - start;
+		
+		start = device_time_now();
+		
+		for (uint32_t n = 0; n < TEST_BENCH_SAMPLES; n++) {
+			FusionAhrsUpdateNoMagnetometer(
+					&ahrs,
+					test_fusion_vector(test_gyroscope[n]),
+					test_fusion_vector(test_accelerometer[n]),
+					1.0f / TEST_SAMPLE_RATE
+			);
+		}
+		
+		const uint64_t fusion_duration = device_time_now() - start;
+		
+		if ((run == 0) || (fixed_duration < best_fixed)) {
+			best_fixed = fixed_duration;
+		}
+		
+		if ((run == 0) || (fusion_duration < best_fusion)) {
+			best_fusion = fusion_duration;
+		}
+		
+		// Keeps both loops from being optimised away
+		checksum += device_imu_fixed_to_float(fixed.orientation.w, DEVICE_IMU_FIXED_UNIT) + FusionAhrsGetQuaternion(&ahrs).element.w;
+	}
+	
+	printf("speed: %.1f ns per update fixed, %.1f ns per update float (checksum %.3g)\n",
+		   (double) best_fixed / TEST_BENCH_SAMPLES, (double) best_fusion / TEST_BENCH_SAMPLES, checksum);
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	bool passed = true;
+	
+	passed &= test_accuracy();
+	passed &= test_catchup();
+	
+	// Only printed, the ratio depends on the floating-point unit of the host
+	test_speed();
+	
+	return passed? 0 : 1;
+}
@@ -0,0 +1,190 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Times device_imu_read() per report with the same chain (decimation, convention change and a sink) set up three
+// ways: the monolithic read with the convention option and a sample callback, a flat array of C stages and a fused
+// C++ pipeline. The simulated device hands out reports without pacing, so only the processing gets measured.
+
+#include "device_imu.h"
+#include "device_imu_pipeline.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "device_time.h"
+#include "sim_device_imu.h"
+
+#define BENCH_REPORTS 20000
+#define BENCH_RUNS 3
+#define BENCH_FACTOR 4
+#define BENCH_CONVENTION DEVICE_IMU_CONVENTION_OPENGL
+
+enum bench_mode_t {
+	BENCH_MONOLITHIC = 0,
+	BENCH_C_STAGES = 1,
+	BENCH_FUSED = 2,
+	BENCH_MODES = 3,
+};
+
+static const char* bench_names [BENCH_MODES] = { "monolithic", "C stages", "fused C++" };
+
+struct bench_output_t {
+	uint32_t count;
+	uint32_t outputs;
+	device_imu_quat_type orientation;
+};
+
+typedef struct bench_output_t bench_output_type;
+
+static void bench_store(bench_output_type* output, const device_imu_sample_type* sample) {
+	output->orientation = sample->orientation;
+	output->outputs++;
+}
+
+static void bench_callback(const device_imu_sample_type* sample, void* userdata) {
+	bench_output_type* output = static_cast<bench_output_type*>(userdata);
+
+	if (++(output->count) % BENCH_FACTOR == 0) {
+		bench_store(output, sample);
+	}
+}
+
+static bool bench_decimate_stage(device_imu_sample_type* sample, void* userdata) {
+	(void) sample;
+
+	bench_output_type* output = static_cast<bench_output_type*>(userdata);
+	return (++(output->count) % BENCH_FACTOR == 0);
+}
+
+static bool bench_convert_stage(device_imu_sample_type* sample, void* userdata) {
+	(void) userdata;
+
+	sample->gyroscope = device_imu_convert_vec3(sample->gyroscope, BENCH_CONVENTION);
+	sample->accelerometer = device_imu_convert_vec3(sample->accelerometer, BENCH_CONVENTION);
+	sample->magnetometer = device_imu_convert_vec3(sample->magnetometer, BENCH_CONVENTION);
+	sample->orientation = device_imu_convert_quat(sample->orientation, BENCH_CONVENTION);
+	return true;
+}
+
+static bool bench_sink_stage(device_imu_sample_type* sample, void* userdata) {
+	bench_store(static_cast<bench_output_type*>(userdata), sample);
+	return true;
+}
+
+static uint64_t bench_run(bench_mode_t mode, bench_output_type* output) {
+	device_imu_type dev;
+	device_imu_options_type options;
+
+	sim_reset(0x0424);
+	sim.unpaced = true;
+
+	device_imu_default_options(&options);
+
+	// Unpaced reports run ahead of the host clock, which must not count as falling behind
+	options.stall_threshold = 0;
+	options.catchup_threshold = 0;
+	options.convention = (mode == BENCH_MONOLITHIC? BENCH_CONVENTION : DEVICE_IMU_CONVENTION_NED);
+
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_open_ex(&dev, nullptr, &options)) {
+		printf("open: FAILED\n");
+		return 0;
+	}
+
+	std::memset(output, 0, sizeof(bench_output_type));
+
+	auto fused = device_imu::make_pipeline(
+			device_imu::decimate(BENCH_FACTOR),
+			device_imu::convert<BENCH_CONVENTION>(),
+			device_imu::make_sink([output](const device_imu_sample_type& sample) {
+				bench_store(output, &sample);
+			})
+	);
+
+	switch (mode) {
+		case BENCH_MONOLITHIC:
+			device_imu_set_sample_callback(&dev, bench_callback, output);
+			break;
+		case BENCH_C_STAGES:
+			device_imu_add_stage(&dev, DEVICE_IMU_STAGE_POST_FUSION, bench_decimate_stage, output);
+			device_imu_add_stage(&dev, DEVICE_IMU_STAGE_POST_FUSION, bench_convert_stage, output);
+			device_imu_add_stage(&dev, DEVICE_IMU_STAGE_POST_FUSION, bench_sink_stage, output);
+			break;
+		case BENCH_FUSED:
+			fused.attach(&dev, DEVICE_IMU_STAGE_POST_FUSION);
+			break;
+		default:
+			break;
+	}
+
+	const uint64_t start = device_time_now();
+
+	for (uint32_t i = 0; i < BENCH_REPORTS; i++) {
+		device_imu_read(&dev, 0);
+	}
+
+	const uint64_t duration = device_time_now() - start;
+
+	device_imu_close(&dev);
+	return duration;
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+
+	bench_output_type outputs [BENCH_MODES];
+	uint64_t best [BENCH_MODES];
+
+	// Alternating the modes spreads any slow phase of the machine over all of them
+	for (uint32_t run = 0; run < BENCH_RUNS; run++) {
+		for (uint32_t mode = 0; mode < BENCH_MODES; mode++) {
+			const uint64_t duration = bench_run(static_cast<bench_mode_t>(mode), &(outputs[mode]));
+
+			if ((run == 0) || (duration < best[mode])) {
+				best[mode] = duration;
+			}
+		}
+	}
+
+	bool passed = true;
+
+	for (uint32_t mode = 0; mode < BENCH_MODES; mode++) {
+		const device_imu_quat_type& q = outputs[mode].orientation;
+		const device_imu_quat_type& reference = outputs[BENCH_MONOLITHIC].orientation;
+
+		const float difference = std::fabs(q.x - reference.x) + std::fabs(q.y - reference.y) +
+								 std::fabs(q.z - reference.z) + std::fabs(q.w - reference.w);
+
+		printf("%-10s: %.0f ns per report, %u outputs\n",
+			   bench_names[mode], (double) best[mode] / BENCH_REPORTS, outputs[mode].outputs);
+
+		if ((outputs[mode].outputs != BENCH_REPORTS / BENCH_FACTOR) || (difference > 1e-5f)) {
+			printf("%s: FAILED\n", bench_names[mode]);
+			passed = false;
+		}
+	}
+
+	return passed? 0 : 1;
+}
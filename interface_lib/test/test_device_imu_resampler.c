@@ -0,0 +1,431 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Streams 600 s of synthetic samples with jittered device timestamps, random transport delays and one 50 ms gap
+// through the resampler. The grid has to stay exact in host time, the interpolated gyroscope and orientation get
+// compared with the exact signal (and with a zero-order hold). Clock drift, retargeting the grid mid-stream and the
+// time per input sample are covered as well.
+
+#include "device_imu.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_time.h"
+
+#define TEST_DURATION_S 600
+#define TEST_JITTER_NS 150000 // (of the device timestamps, uniform in both directions)
+#define TEST_MIN_DELAY_NS 200000 // (lowest transport delay)
+#define TEST_MEAN_DELAY_NS 1000000 // (of the exponential part of the transport delay)
+#define TEST_GAP_START_S 300
+#define TEST_GAP_NS 50000000
+#define TEST_SETTLE_NS 1000000000ULL // (device time until the host timestamps get checked)
+#define TEST_DRIFT_PPM 200.0 // (of a device clock running slower than the host)
+#define TEST_CHUNK 10000 // (inputs generated ahead of each timed run of the resampler)
+#define TEST_RATE 90.0 // (of the rotation about z in °/s)
+
+#define TEST_LINEAR_ERROR 0.2 // (largest mean gyroscope error in °/s)
+#define TEST_CUBIC_ERROR 0.02
+#define TEST_ORIENTATION_ERROR 0.001 // (largest orientation error in degrees)
+#define TEST_HOST_ERROR 500000 // (largest distance of an emitted host timestamp to true host time in ns)
+
+struct test_result_t {
+	uint64_t period;
+	uint64_t outputs;
+	uint64_t steps; // (outputs exactly one period after the previous one)
+	uint64_t skips; // (outputs whole periods after the previous one, behind a gap)
+	uint64_t irregular; // (outputs off the grid)
+	uint64_t last_host;
+	
+	double gyroscope_error; // (sum of the absolute errors in °/s)
+	double hold_error; // (sum of the absolute errors of a zero-order hold in °/s)
+	double orientation_error; // (largest error in degrees)
+	int64_t host_error; // (largest distance to true host time in ns)
+	double host_error_sum;
+	uint64_t host_errors;
+};
+
+typedef struct test_result_t test_result_type;
+
+static uint64_t test_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t* test_times = NULL; // (device timestamps of the inputs in ns)
+static uint64_t test_inputs = 0;
+static uint64_t test_cursor = 0;
+static double test_drift = 0.0; // (device time per host time minus one)
+static device_imu_sample_type test_chunk [TEST_CHUNK];
+
+static double test_random() {
+	// xorshift64*, deterministic so failures can be reproduced
+	test_state ^= test_state >> 12;
+	test_state ^= test_state << 25;
+	test_state ^= test_state >> 27;
+	
+	return (double) ((test_state * 0x2545F4914F6CDD1DULL) >> 11) / (double) (1ULL << 53);
+}
+
+// Gyroscope signal at a device time in °/s (3 Hz motion with 40 Hz vibration)
+static double test_signal(uint64_t time) {
+	const double t = (double) time / 1e9;
+	return 100.0 * sin(2.0 * M_PI * 3.0 * t) + 10.0 * sin(2.0 * M_PI * 40.0 * t);
+}
+
+static void test_orientation(uint64_t time, double q [4]) {
+	const double angle = TEST_RATE * (double) time / 1e9 * M_PI / 180.0;
+	
+	q[0] = cos(0.5 * angle);
+	q[1] = 0.0;
+	q[2] = 0.0;
+	q[3] = sin(0.5 * angle);
+}
+
+static void test_output(const device_imu_sample_type* sample, void* userdata) {
+	test_result_type* result = (test_result_type*) userdata;
+	
+	if (result->last_host) {
+		const uint64_t step = sample->host_timestamp - result->last_host;
+		
+		if (step == result->period) {
+			result->steps++;
+		} else if ((step > result->period) && (step % result->period == 0)) {
+			result->skips++;
+		} else {
+			result->irregular++;
+		}
+	}
+	
+	if (sample->host_timestamp % result->period != 0) {
+		result->irregular++;
+	}
+	
+	result->last_host = sample->host_timestamp;
+	result->outputs++;
+	
+	const double expected = test_signal(sample->timestamp);
+	result->gyroscope_error += fabs(sample->gyroscope.x - expected);
+	
+	// The inputs arrive in order, so the latest one up to the grid time only moves forward
+	while ((test_cursor + 1 < test_inputs) && (test_times[test_cursor + 1] <= sample->timestamp)) {
+		test_cursor++;
+	}
+	
+	result->hold_error += fabs(test_signal(test_times[test_cursor]) - expected);
+	
+	double q [4];
+	test_orientation(sample->timestamp, q);
+	
+	// Angle of the rotation between both from its vector part, which stays accurate for small angles unlike acos()
+	const double w = sample->orientation.w;
+	const double z = sample->orientation.z;
+	const double x = sample->orientation.x;
+	const double y = sample->orientation.y;
+	
+	const double dw = q[0] * w + q[3] * z;
+	const double dx = q[0] * x + q[3] * y;
+	const double dy = q[0] * y - q[3] * x;
+	const double dz = q[0] * z - q[3] * w;
+	
+	const double error = 2.0 * atan2(sqrt(dx * dx + dy * dy + dz * dz), fabs(dw)) * 180.0 / M_PI;
+	
+	if (error > result->orientation_error) {
+		result->orientation_error = error;
+	}
+	
+	// The offset needs a few samples to find the lowest transport delay
+	if (sample->timestamp < TEST_SETTLE_NS) {
+		return;
+	}
+	
+	// The grid time maps back through the lowest transport delay, which is all the emitted timestamp may be ahead by
+	const int64_t host = (int64_t) ((double) sample->timestamp / (1.0 + test_drift));
+	const int64_t distance = llabs((int64_t) sample->host_timestamp - TEST_MIN_DELAY_NS - host);
+	
+	result->host_errors++;
+	result->host_error_sum += (double) distance;
+	
+	if (distance > result->host_error) {
+		result->host_error = distance;
+	}
+}
+
+// Generates the inputs once, the resampler runs over them for every configuration
+static bool test_generate(double drift_ppm) {
+	test_drift = -drift_ppm * 1e-6;
+	test_inputs = 0;
+	test_state = 0x9E3779B97F4A7C15ULL;
+	
+	if (!test_times) {
+		test_times = malloc(sizeof(uint64_t) * TEST_DURATION_S * DEVICE_IMU_SAMPLE_RATE);
+	}
+	
+	if (!test_times) {
+		printf("allocation: FAILED\n");
+		return false;
+	}
+	
+	const uint64_t period = 1000000000ULL / DEVICE_IMU_SAMPLE_RATE;
+	
+	for (uint64_t i = 1; i < TEST_DURATION_S * DEVICE_IMU_SAMPLE_RATE; i++) {
+		const uint64_t nominal = i * period;
+		
+		if ((nominal > TEST_GAP_START_S * 1000000000ULL) && (nominal <= TEST_GAP_START_S * 1000000000ULL + TEST_GAP_NS)) {
+			continue;
+		}
+		
+		const double jitter = (2.0 * test_random() - 1.0) * TEST_JITTER_NS;
+		test_times[test_inputs++] = (uint64_t) ((double) nominal * (1.0 + test_drift) + jitter);
+	}
+	
+	return true;
+}
+
+static void test_input(device_imu_sample_type* sample, uint64_t index) {
+	const uint64_t time = test_times[index];
+	double q [4];
+	
+	test_orientation(time, q);
+	
+	memset(sample, 0, sizeof(device_imu_sample_type));
+	
+	sample->sequence = index;
+	sample->timestamp = time;
+	sample->host_timestamp = (uint64_t) ((double) time / (1.0 + test_drift)) + TEST_MIN_DELAY_NS +
+			(uint64_t) (-log(1.0 - test_random()) * TEST_MEAN_DELAY_NS);
+	sample->gyroscope.x = (float) test_signal(time);
+	sample->orientation.w = (float) q[0];
+	sample->orientation.z = (float) q[3];
+}
+
+static void test_count(const device_imu_sample_type* sample, void* userdata) {
+	(void) sample;
+	
+	((test_result_type*) userdata)->outputs++;
+}
+
+static bool test_run(uint64_t period,
+					 device_imu_interpolation_type interpolation,
+					 device_imu_sample_callback callback,
+					 test_result_type* result,
+					 uint64_t* duration) {
+	device_imu_resampler_type resampler;
+	
+	memset(result, 0, sizeof(test_result_type));
+	result->period = period;
+	
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_resampler_init(&resampler, period, interpolation, callback, result)) {
+		printf("init: FAILED\n");
+		return false;
+	}
+	
+	test_cursor = 0;
+	test_state = 0x2545F4914F6CDD1DULL;
+	
+	uint64_t elapsed = 0;
+	
+	// Generating the inputs takes longer than resampling them, so only the resampling of each chunk gets timed
+	for (uint64_t i = 0; i < test_inputs; i += TEST_CHUNK) {
+		const uint64_t count = (test_inputs - i < TEST_CHUNK? test_inputs - i : TEST_CHUNK);
+		
+		for (uint64_t j = 0; j < count; j++) {
+			test_input(&(test_chunk[j]), i + j);
+		}
+		
+		const uint64_t start = device_time_now();
+		
+		for (uint64_t j = 0; j < count; j++) {
+			device_imu_resampler_process(&resampler, &(test_chunk[j]));
+		}
+		
+		elapsed += device_time_now() - start;
+	}
+	
+	device_imu_resampler_free(&resampler);
+	
+	if (duration) {
+		*duration = elapsed;
+	}
+	
+	return true;
+}
+
+static bool test_accuracy() {
+	if (!test_generate(0.0)) {
+		return false;
+	}
+	
+	static const device_imu_interpolation_type interpolations [DEVICE_IMU_INTERPOLATIONS] = {
+			DEVICE_IMU_INTERPOLATION_LINEAR,
+			DEVICE_IMU_INTERPOLATION_CUBIC
+	};
+	
+	static const char* names [DEVICE_IMU_INTERPOLATIONS] = { "linear", "cubic" };
+	static const double bounds [DEVICE_IMU_INTERPOLATIONS] = { TEST_LINEAR_ERROR, TEST_CUBIC_ERROR };
+	
+	bool passed = true;
+	
+	for (uint32_t i = 0; i < DEVICE_IMU_INTERPOLATIONS; i++) {
+		test_result_type result;
+		
+		if (!test_run(1000000, interpolations[i], test_output, &result, NULL)) {
+			return false;
+		}
+		
+		const double error = result.gyroscope_error / (double) result.outputs;
+		const double hold = result.hold_error / (double) result.outputs;
+		
+		const bool grid = (result.irregular == 0) && (result.skips == 1) && (result.steps + 2 == result.outputs);
+		const bool accurate = (error <= bounds[i]) && (result.orientation_error <= TEST_ORIENTATION_ERROR);
+		
+		printf("%s: %s, %lu outputs, %lu irregular, %lu skipped gaps, mean gyroscope error %.4f °/s "
+			   "(bound %.2f, hold %.2f), orientation error %.5f°\n",
+			   names[i], (grid) && (accurate)? "passed" : "FAILED", (unsigned long) result.outputs,
+			   (unsigned long) result.irregular, (unsigned long) result.skips, error, bounds[i], hold,
+			   result.orientation_error);
+		
+		passed &= (grid) && (accurate);
+	}
+	
+	return passed;
+}
+
+static bool test_drift_offset() {
+	if (!test_generate(TEST_DRIFT_PPM)) {
+		return false;
+	}
+	
+	test_result_type result;
+	
+	if (!test_run(1000000, DEVICE_IMU_INTERPOLATION_LINEAR, test_output, &result, NULL)) {
+		return false;
+	}
+	
+	const bool passed = (result.host_error <= TEST_HOST_ERROR) && (result.irregular == 0);
+	
+	printf("drift: %s, %.0f ppm slower device clock, emitted host timestamps within %.3f ms of true host time "
+		   "(mean %.3f ms, bound %.1f ms)\n",
+		   passed? "passed" : "FAILED", TEST_DRIFT_PPM, (double) result.host_error / 1e6,
+		   result.host_error_sum / (double) (result.host_errors? result.host_errors : 1) / 1e6, TEST_HOST_ERROR / 1e6);
+	return passed;
+}
+
+static test_result_type test_retarget_result;
+static uint64_t test_retarget_period = 0;
+
+static void test_retarget_output(const device_imu_sample_type* sample, void* userdata) {
+	device_imu_resampler_type* resampler = (device_imu_resampler_type*) userdata;
+	test_result_type* result = &test_retarget_result;
+	
+	// Outputs before the new spacing got applied still follow the old grid
+	if (resampler->period != result->period) {
+		result->period = resampler->period;
+		result->last_host = 0;
+		test_retarget_period++;
+	}
+	
+	test_output(sample, result);
+}
+
+static bool test_retarget() {
+	if (!test_generate(0.0)) {
+		return false;
+	}
+	
+	device_imu_resampler_type resampler;
+	
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_resampler_init(
+			&resampler, 1000000, DEVICE_IMU_INTERPOLATION_CUBIC, test_retarget_output, &resampler)) {
+		printf("init: FAILED\n");
+		return false;
+	}
+	
+	memset(&test_retarget_result, 0, sizeof(test_retarget_result));
+	test_retarget_result.period = resampler.period;
+	test_retarget_period = 0;
+	test_cursor = 0;
+	
+	// A display mode change from 1 kHz to 240 Hz and on to 4 ms per sample
+	static const uint64_t periods [2] = { 4166667, 4000000 };
+	
+	for (uint64_t i = 0; i < 30 * DEVICE_IMU_SAMPLE_RATE; i++) {
+		if ((i % (10 * DEVICE_IMU_SAMPLE_RATE) == 0) && (i > 0)) {
+			device_imu_resampler_retarget(&resampler, periods[i / (10 * DEVICE_IMU_SAMPLE_RATE) - 1]);
+		}
+		
+		device_imu_sample_type sample;
+		test_input(&sample, i);
+		device_imu_resampler_process(&resampler, &sample);
+	}
+	
+	device_imu_resampler_free(&resampler);
+	
+	const test_result_type* result = &test_retarget_result;
+	const bool passed = (test_retarget_period == 2) && (result->irregular == 0) && (result->skips == 0);
+	
+	printf("retarget: %s, %lu grid changes, %lu irregular, mean gyroscope error %.4f °/s\n",
+		   passed? "passed" : "FAILED", (unsigned long) test_retarget_period, (unsigned long) result->irregular,
+		   result->gyroscope_error / (double) result->outputs);
+	return passed;
+}
+
+static void test_speed() {
+	if (!test_generate(0.0)) {
+		return;
+	}
+	
+	static const uint64_t periods [3] = { 4000000, 2000000, 1000000 };
+	
+	for (uint32_t i = 0; i < 3; i++) {
+		for (uint32_t j = 0; j < DEVICE_IMU_INTERPOLATIONS; j++) {
+			test_result_type result;
+			uint64_t duration;
+			
+			if (test_run(periods[i], (device_imu_interpolation_type) j, test_count, &result, &duration)) {
+				printf("speed: %.0f ns per input with a %.0f ms period (%s)\n",
+					   (double) duration / (double) test_inputs, periods[i] / 1e6, j? "cubic" : "linear");
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	bool passed = true;
+	
+	passed &= test_accuracy();
+	passed &= test_drift_offset();
+	passed &= test_retarget();
+	
+	// Only printed, the time depends on the host
+	test_speed();
+	
+	free(test_times);
+	return passed? 0 : 1;
+}
@@ -0,0 +1,246 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// Streams 30 s of a still device with 10 s of strong vibration in the middle through the float and the fixed-point
+// paths and compares the fusion stats both report. The Fusion getters read per update for the samples and the stats
+// get timed on their own against a plain update.
+
+#include "device_imu.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <Fusion/Fusion.h>
+
+#include "device_time.h"
+#include "sim_device_imu.h"
+
+#define TEST_DURATION_S 30
+#define TEST_VIBRATION_START_S 10 // (past the initialisation of the fusion)
+#define TEST_VIBRATION_END_S 20
+#define TEST_AMPLITUDE 1.5f // (of the vibration in g)
+#define TEST_RECOVERY_S 5 // (trigger period of the fusion)
+#define TEST_COST_UPDATES 1000000
+
+static const float test_frequencies [3] = { 23.0f, 31.0f, 47.0f }; // (of the vibration per axis in Hz)
+
+struct test_count_t {
+	uint64_t samples;
+	uint64_t ignored; // (samples flagged with the accelerometer ignored)
+	uint64_t ignored_before; // (before the vibration started)
+};
+
+typedef struct test_count_t test_count_type;
+
+static bool test_vibrating(uint64_t index) {
+	return (index >= TEST_VIBRATION_START_S * DEVICE_IMU_SAMPLE_RATE) && (index < TEST_VIBRATION_END_S * DEVICE_IMU_SAMPLE_RATE);
+}
+
+static void test_accelerometer(uint64_t index, float* accelerometer) {
+	const float t = (float) index / DEVICE_IMU_SAMPLE_RATE;
+	const float amplitude = test_vibrating(index)? TEST_AMPLITUDE : 0.0f;
+	
+	for (int i = 0; i < 3; i++) {
+		accelerometer[i] = (i == 1? 1.0f : 0.0f) + amplitude * sinf(2.0f * (float) M_PI * test_frequencies[i] * t);
+	}
+}
+
+static void test_motion(uint64_t index) {
+	// Cancels the gyroscope bias of the simulated calibration, so the device stays still
+	sim.gyroscope[0] = -SIM_GYROSCOPE_BIAS * 180.0f / (float) M_PI;
+	
+	test_accelerometer(index, sim.accelerometer);
+}
+
+static void test_sample(const device_imu_sample_type* sample, void* userdata) {
+	test_count_type* count = (test_count_type*) userdata;
+	
+	if (sample->flags & DEVICE_IMU_SAMPLE_FLAG_ACCELEROMETER_IGNORED) {
+		count->ignored++;
+		
+		if (count->samples < TEST_VIBRATION_START_S * DEVICE_IMU_SAMPLE_RATE) {
+			count->ignored_before++;
+		}
+	}
+	
+	count->samples++;
+}
+
+static bool test_run(bool fixed_point, device_imu_stats_type* stats, test_count_type* count) {
+	device_imu_type dev;
+	device_imu_options_type options;
+	
+	sim_reset(0x0424);
+	sim.unpaced = true;
+	sim.motion = test_motion;
+	
+	device_imu_default_options(&options);
+	
+	// Unpaced reports run ahead of the host clock, which must not count as falling behind
+	options.stall_threshold = 0;
+	options.catchup_threshold = 0;
+	options.fixed_point = fixed_point;
+	
+	if (DEVICE_IMU_ERROR_NO_ERROR != device_imu_open_ex(&dev, NULL, &options)) {
+		printf("open: FAILED\n");
+		return false;
+	}
+	
+	count->samples = 0;
+	count->ignored = 0;
+	count->ignored_before = 0;
+	
+	device_imu_set_sample_callback(&dev, test_sample, count);
+	
+	for (uint32_t i = 0; i < TEST_DURATION_S * DEVICE_IMU_SAMPLE_RATE; i++) {
+		device_imu_read(&dev, 0);
+	}
+	
+	device_imu_get_stats(&dev, stats);
+	device_imu_close(&dev);
+	return true;
+}
+
+static bool test_agreement() {
+	const char* names [2] = { "float", "fixed" };
+	
+	device_imu_stats_type stats [2];
+	test_count_type counts [2];
+	
+	bool passed = true;
+	
+	for (uint32_t j = 0; j < 2; j++) {
+		if (!test_run(j == 1, &(stats[j]), &(counts[j]))) {
+			return false;
+		}
+		
+		printf("%s: %llu of %llu updates rejected, %u recoveries, %.1f° max acceleration error\n",
+			   names[j], (unsigned long long) stats[j].acceleration_rejections, (unsigned long long) stats[j].reports,
+			   stats[j].acceleration_recoveries, stats[j].acceleration_error_max);
+		
+		// The stats and the sample flags come from the same read, a still device gets no rejections and the vibration
+		// gets rejected at least until the recovery trigger fires after its period
+		const bool consistent = (stats[j].acceleration_rejections == counts[j].ignored) &&
+								(counts[j].ignored_before == 0) &&
+								(stats[j].acceleration_rejections >= TEST_RECOVERY_S * DEVICE_IMU_SAMPLE_RATE) &&
+								(stats[j].acceleration_recoveries > 0);
+		
+		if (!consistent) {
+			printf("%s: FAILED\n", names[j]);
+			passed = false;
+		}
+	}
+	
+	const double difference = fabs((double) stats[1].acceleration_rejections - (double) stats[0].acceleration_rejections);
+	
+	printf("agreement: %.0f rejections apart\n", difference);
+	
+	// Both paths decide on the same rounded error, only updates right at the threshold may go either way
+	if ((difference > 0.01 * (double) stats[0].acceleration_rejections) ||
+		(stats[0].acceleration_recoveries != stats[1].acceleration_recoveries) ||
+		(fabsf(stats[0].acceleration_error_max - stats[1].acceleration_error_max) > 1.0f)) {
+		printf("agreement: FAILED\n");
+		passed = false;
+	}
+	
+	return passed;
+}
+
+static uint64_t test_updates(bool collect, float* checksum) {
+	const FusionAhrsSettings settings = {
+			.convention = FusionConventionNed,
+			.gain = 0.5f,
+			.accelerationRejection = 10.0f,
+			.magneticRejection = 20.0f,
+			.recoveryTriggerPeriod = TEST_RECOVERY_S * DEVICE_IMU_SAMPLE_RATE,
+	};
+	
+	FusionAhrs ahrs;
+	FusionAhrsInitialise(&ahrs);
+	FusionAhrsSetSettings(&ahrs, &settings);
+	
+	const FusionVector gyroscope = FUSION_VECTOR_ZERO;
+	FusionVector accelerometer;
+	
+	float sum = 0.0f;
+	const uint64_t start = device_time_now();
+	
+	for (uint32_t i = 0; i < TEST_COST_UPDATES; i++) {
+		// Vibrating throughout, so both the rejections and the recoveries get their share
+		test_accelerometer(TEST_VIBRATION_START_S * DEVICE_IMU_SAMPLE_RATE + (i % 1000), accelerometer.array);
+		
+		FusionAhrsUpdateNoMagnetometer(&ahrs, gyroscope, accelerometer, 1.0f / DEVICE_IMU_SAMPLE_RATE);
+		
+		if (collect) {
+			const FusionAhrsInternalStates states = FusionAhrsGetInternalStates(&ahrs);
+			const FusionAhrsFlags flags = FusionAhrsGetFlags(&ahrs);
+			
+			sum += states.accelerationRecoveryTrigger + (flags.initialising? 1.0f : 0.0f) + (states.accelerometerIgnored? 1.0f : 0.0f);
+		}
+	}
+	
+	const uint64_t duration = device_time_now() - start;
+	
+	*checksum += sum + FusionAhrsGetQuaternion(&ahrs).element.w;
+	return duration;
+}
+
+static void test_cost() {
+	uint64_t best [2] = { 0, 0 };
+	float checksum = 0.0f;
+	
+	// Alternating both spreads any slow phase of the machine over them
+	for (uint32_t run = 0; run < 3; run++) {
+		for (uint32_t j = 0; j < 2; j++) {
+			const uint64_t duration = test_updates(j == 1, &checksum);
+			
+			if ((run == 0) || (duration < best[j])) {
+				best[j] = duration;
+			}
+		}
+	}
+	
+	const double update = (double) best[0] / TEST_COST_UPDATES;
+	const double collected = (double) best[1] / TEST_COST_UPDATES;
+	
+	// The sum keeps the getters from being optimised away
+	printf("cost: %.1f ns per update, %.1f ns with the flags and internal states read (%.1f ns more, %.4f%% of a core "
+		   "at %d Hz, checksum %.3g)\n", update, collected, collected - update,
+		   (collected - update) * DEVICE_IMU_SAMPLE_RATE * 1e-7, DEVICE_IMU_SAMPLE_RATE, (double) checksum);
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	const bool passed = test_agreement();
+	
+	// Only printed, the time depends on the host
+	test_cost();
+	
+	return passed? 0 : 1;
+}
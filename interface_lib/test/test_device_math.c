@@ -0,0 +1,250 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Compares the inlined kernels of device_math.h with the Fusion functions they replace. Differences are
+// measured in ULP of the magnitude the result is computed from (sum of the absolute products), which
+// stays meaningful when terms cancel out.
+
+#define FUSION_USE_NORMAL_SQRT
+
+#include "device_math.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TEST_ITERATIONS 1000000
+
+#define TEST_AFFINE_ULPS 4 // (operations get reassociated to add the translation first)
+#define TEST_MULTIPLY_ULPS 2
+#define TEST_NORMALISE_ULPS 2
+#define TEST_EULER_ULPS 8 // (polynomial arctangent, in ULP of 180°)
+#define TEST_MATRIX_ULPS 2
+
+struct test_result_t {
+	const char* name;
+	uint32_t ulps;
+	double max_ulps;
+	uint64_t failures;
+};
+
+typedef struct test_result_t test_result_type;
+
+static uint64_t test_state = 0x9E3779B97F4A7C15ULL;
+
+static float test_random(float min, float max) {
+	// xorshift64*, deterministic so failures can be reproduced
+	test_state ^= test_state >> 12;
+	test_state ^= test_state << 25;
+	test_state ^= test_state >> 27;
+	
+	const uint64_t bits = (test_state * 0x2545F4914F6CDD1DULL) >> 40;
+	return min + (max - min) * ((float) bits / (float) (1 << 24));
+}
+
+static FusionQuaternion test_random_quaternion() {
+	FusionQuaternion q;
+	
+	for (int i = 0; i < 4; i++) {
+		q.array[i] = test_random(-1.0f, 1.0f);
+	}
+	
+	return q;
+}
+
+static void test_compare(test_result_type* result, float value, float expected, float magnitude) {
+	const float ulp = nextafterf(fabsf(magnitude), INFINITY) - fabsf(magnitude);
+	const double ulps = fabs((double) value - (double) expected) / (double) (ulp > 0.0f? ulp : FLT_MIN);
+	
+	if (ulps > result->max_ulps) {
+		result->max_ulps = ulps;
+	}
+	
+	if ((ulps > result->ulps) || (isnan(value) != isnan(expected))) {
+		if (result->failures == 0) {
+			printf("%s: %.9g != %.9g (%.1f ULP)\n", result->name, value, expected, ulps);
+		}
+		
+		result->failures++;
+	}
+}
+
+static bool test_report(const test_result_type* result) {
+	printf("%s: %s, max %.2f ULP (bound %u)\n",
+		   result->name, result->failures? "FAILED" : "passed", result->max_ulps, result->ulps);
+	return (result->failures == 0);
+}
+
+static bool test_affine() {
+	test_result_type result = { "affine_apply", TEST_AFFINE_ULPS, 0.0, 0 };
+	
+	for (uint32_t n = 0; n < TEST_ITERATIONS; n++) {
+		FusionMatrix matrix;
+		FusionVector translation;
+		FusionVector v;
+		
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				matrix.array[i][j] = test_random(-2.0f, 2.0f);
+			}
+			
+			translation.array[i] = test_random(-0.5f, 0.5f);
+			v.array[i] = test_random(-2000.0f, 2000.0f);
+		}
+		
+		device_math_affine_type affine;
+		device_math_affine_identity(&affine);
+		
+		for (int j = 0; j < 3; j++) {
+			for (int i = 0; i < 3; i++) {
+				affine.columns[j][i] = matrix.array[i][j];
+			}
+			
+			affine.columns[3][j] = translation.array[j];
+		}
+		
+		const FusionVector value = device_math_affine_apply(&affine, v);
+		const FusionVector expected = FusionVectorAdd(FusionMatrixMultiplyVector(matrix, v), translation);
+		
+		for (int i = 0; i < 3; i++) {
+			const float magnitude = fabsf(translation.array[i]) +
+					fabsf(matrix.array[i][0] * v.axis.x) +
+					fabsf(matrix.array[i][1] * v.axis.y) +
+					fabsf(matrix.array[i][2] * v.axis.z);
+			
+			test_compare(&result, value.array[i], expected.array[i], magnitude);
+		}
+	}
+	
+	return test_report(&result);
+}
+
+static bool test_quaternion() {
+	test_result_type multiply = { "quaternion_multiply", TEST_MULTIPLY_ULPS, 0.0, 0 };
+	test_result_type normalise = { "quaternion_normalise", TEST_NORMALISE_ULPS, 0.0, 0 };
+	
+	for (uint32_t n = 0; n < TEST_ITERATIONS; n++) {
+		const FusionQuaternion a = test_random_quaternion();
+		const FusionQuaternion b = test_random_quaternion();
+		
+		const FusionQuaternion product = device_math_quaternion_multiply(a, b);
+		const FusionQuaternion expected_product = FusionQuaternionMultiply(a, b);
+		
+		// Bounds the absolute products summed up for any of the components
+		float sum_a = 0.0f;
+		float sum_b = 0.0f;
+		
+		for (int i = 0; i < 4; i++) {
+			sum_a += fabsf(a.array[i]);
+			sum_b += fabsf(b.array[i]);
+		}
+		
+		const float magnitude = sum_a * sum_b;
+		
+		for (int i = 0; i < 4; i++) {
+			test_compare(&multiply, product.array[i], expected_product.array[i], magnitude);
+		}
+		
+		const FusionQuaternion normalised = device_math_quaternion_normalise(a);
+		const FusionQuaternion expected_normalised = FusionQuaternionNormalise(a);
+		
+		for (int i = 0; i < 4; i++) {
+			test_compare(&normalise, normalised.array[i], expected_normalised.array[i], expected_normalised.array[i]);
+		}
+	}
+	
+	const bool multiply_passed = test_report(&multiply);
+	const bool normalise_passed = test_report(&normalise);
+	return (multiply_passed) && (normalise_passed);
+}
+
+static bool test_conversions() {
+	test_result_type euler = { "f4_euler", TEST_EULER_ULPS, 0.0, 0 };
+	test_result_type matrix = { "f4_matrix", TEST_MATRIX_ULPS, 0.0, 0 };
+	
+	for (uint32_t n = 0; n < TEST_ITERATIONS; n += 4) {
+		FusionQuaternion q [4];
+		float lanes [4][4];
+		
+		for (int k = 0; k < 4; k++) {
+			q[k] = FusionQuaternionNormalise(test_random_quaternion());
+			
+			lanes[0][k] = q[k].element.x;
+			lanes[1][k] = q[k].element.y;
+			lanes[2][k] = q[k].element.z;
+			lanes[3][k] = q[k].element.w;
+		}
+		
+		const device_math_f4 x = device_math_f4_load(lanes[0]);
+		const device_math_f4 y = device_math_f4_load(lanes[1]);
+		const device_math_f4 z = device_math_f4_load(lanes[2]);
+		const device_math_f4 w = device_math_f4_load(lanes[3]);
+		
+		device_math_f4 angles [3];
+		device_math_f4 elements [9];
+		
+		device_math_f4_euler(x, y, z, w, &(angles[0]), &(angles[1]), &(angles[2]));
+		device_math_f4_matrix(x, y, z, w, elements);
+		
+		float values [3][4];
+		float matrices [9][4];
+		
+		for (int i = 0; i < 3; i++) {
+			device_math_f4_store(values[i], angles[i]);
+		}
+		
+		for (int i = 0; i < 9; i++) {
+			device_math_f4_store(matrices[i], elements[i]);
+		}
+		
+		for (int k = 0; k < 4; k++) {
+			const FusionEuler expected_euler = FusionQuaternionToEuler(q[k]);
+			const FusionMatrix expected_matrix = FusionQuaternionToMatrix(q[k]);
+			
+			for (int i = 0; i < 3; i++) {
+				test_compare(&euler, values[i][k], expected_euler.array[i], 180.0f);
+			}
+			
+			for (int i = 0; i < 9; i++) {
+				test_compare(&matrix, matrices[i][k], expected_matrix.array[i / 3][i % 3], 1.0f);
+			}
+		}
+	}
+	
+	const bool euler_passed = test_report(&euler);
+	const bool matrix_passed = test_report(&matrix);
+	return (euler_passed) && (matrix_passed);
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+	
+	bool passed = true;
+	
+	passed &= test_affine();
+	passed &= test_quaternion();
+	passed &= test_conversions();
+	
+	return passed? 0 : 1;
+}
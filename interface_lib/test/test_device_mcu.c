@@ -0,0 +1,392 @@
+//
+// Created on 18.10.26.
+//
+// Copyright (c) 2026 xrealmacdriver contributors. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Runs the command scheduler against a simulated MCU which acknowledges writes late and sends events
+// in between. A burst of requests has to be coalesced, while reading keeps delivering events without
+// ever waiting for an acknowledgement.
+
+#include "device_mcu.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <hidapi/hidapi.h>
+
+#include "device_time.h"
+#include "endian_compat.h"
+
+#define TEST_BURST_MS 1000
+#define TEST_DRAIN_MS 500
+#define TEST_ACK_DELAY_MS 30 // (longer than the polling of the scheduler, shorter than its send interval)
+#define TEST_EVENT_INTERVAL_MS 2
+
+#define SIM_QUEUE_SIZE 64
+#define SIM_PRODUCT_ID 0x0424
+#define SIM_INTERFACE_ID 4
+
+struct sim_reply_t {
+	uint64_t ready; // (host time in ns)
+	device_mcu_packet_type packet;
+};
+
+typedef struct sim_reply_t sim_reply_type;
+
+struct sim_mcu_t {
+	sim_reply_type replies [SIM_QUEUE_SIZE];
+	uint32_t head;
+	uint32_t tail;
+
+	uint64_t ack_delay; // (in ns)
+	uint64_t event_interval; // (in ns)
+	uint64_t next_event;
+
+	uint8_t brightness;
+	uint8_t disp_mode;
+	uint32_t writes;
+};
+
+typedef struct sim_mcu_t sim_mcu_type;
+
+struct hid_device_ {
+	int unused;
+};
+
+static sim_mcu_type sim;
+static hid_device sim_device;
+static struct hid_device_info sim_info;
+
+static void sim_packet(device_mcu_packet_type* packet, uint16_t msgid, const void* data, uint8_t len) {
+	memset(packet, 0, sizeof(device_mcu_packet_type));
+
+	packet->head = 0xFD;
+	packet->length = htole16(18 + len);
+	packet->msgid = htole16(msgid);
+
+	memcpy(packet->data + 1, data, len);
+}
+
+static void sim_reply(uint16_t msgid, const void* data, uint8_t len, uint64_t delay) {
+	if (sim.tail - sim.head >= SIM_QUEUE_SIZE) {
+		return;
+	}
+
+	sim_reply_type* reply = &(sim.replies[sim.tail % SIM_QUEUE_SIZE]);
+
+	sim_packet(&(reply->packet), msgid, data, len);
+	reply->ready = device_time_now() + delay;
+	sim.tail++;
+}
+
+int hid_init(void) {
+	return 0;
+}
+
+int hid_exit(void) {
+	return 0;
+}
+
+struct hid_device_info* hid_enumerate(unsigned short vendor_id, unsigned short product_id) {
+	(void) product_id;
+
+	memset(&sim_info, 0, sizeof(sim_info));
+	sim_info.path = "sim";
+	sim_info.vendor_id = vendor_id;
+	sim_info.product_id = SIM_PRODUCT_ID;
+	sim_info.interface_number = SIM_INTERFACE_ID;
+	return &sim_info;
+}
+
+void hid_free_enumeration(struct hid_device_info* devs) {
+	(void) devs;
+}
+
+hid_device* hid_open_path(const char* path) {
+	(void) path;
+	return &sim_device;
+}
+
+void hid_close(hid_device* dev) {
+	(void) dev;
+}
+
+int hid_write(hid_device* dev, const unsigned char* data, size_t length) {
+	(void) dev;
+
+	device_mcu_packet_type packet;
+	memset(&packet, 0, sizeof(packet));
+	memcpy(&packet, data, length < sizeof(packet)? length : sizeof(packet));
+
+	if (packet.head != 0xFD) {
+		return -1;
+	}
+
+	const uint16_t msgid = le16toh(packet.msgid);
+	const uint8_t value = packet.data[0];
+	const uint8_t activated = 1;
+
+	sim.writes++;
+
+	switch (msgid) {
+		case DEVICE_MCU_MSG_R_ACTIVATION_TIME:
+			sim_reply(msgid, &activated, 1, 0);
+			break;
+		case DEVICE_MCU_MSG_R_MCU_APP_FW_VERSION:
+		case DEVICE_MCU_MSG_R_DP7911_FW_VERSION:
+		case DEVICE_MCU_MSG_R_DSP_APP_FW_VERSION:
+			sim_reply(msgid, "simulated", 9, 0);
+			break;
+		case DEVICE_MCU_MSG_R_BRIGHTNESS:
+			sim_reply(msgid, &(sim.brightness), 1, 0);
+			break;
+		case DEVICE_MCU_MSG_R_DISP_MODE:
+			sim_reply(msgid, &(sim.disp_mode), 1, 0);
+			break;
+		case DEVICE_MCU_MSG_W_BRIGHTNESS:
+			sim.brightness = value;
+			sim_reply(msgid, NULL, 0, sim.ack_delay);
+			break;
+		case DEVICE_MCU_MSG_W_DISP_MODE:
+			sim.disp_mode = value;
+			sim_reply(msgid, NULL, 0, sim.ack_delay);
+			break;
+		default:
+			sim_reply(msgid, NULL, 0, 0);
+			break;
+	}
+
+	return (int) length;
+}
+
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds) {
+	(void) dev;
+
+	const uint64_t start = device_time_now();
+	const uint64_t deadline = start + (uint64_t) (milliseconds > 0? milliseconds : 0) * DEVICE_TIME_MS;
+
+	for (;;) {
+		const uint64_t now = device_time_now();
+
+		if ((sim.head != sim.tail) && (sim.replies[sim.head % SIM_QUEUE_SIZE].ready <= now)) {
+			memcpy(data, &(sim.replies[sim.head % SIM_QUEUE_SIZE].packet), length);
+			sim.head++;
+			return (int) length;
+		}
+
+		if ((sim.event_interval) && (sim.next_event <= now)) {
+			const uint8_t active = 1;
+			device_mcu_packet_type packet;
+
+			sim_packet(&packet, DEVICE_MCU_MSG_P_DISPLAY_TOGGLED, NULL, 0);
+			memcpy(packet.data, &active, 1);
+			memcpy(data, &packet, length);
+
+			sim.next_event = now + sim.event_interval;
+			return (int) length;
+		}
+
+		uint64_t next = deadline;
+
+		if ((sim.head != sim.tail) && (sim.replies[sim.head % SIM_QUEUE_SIZE].ready < next)) {
+			next = sim.replies[sim.head % SIM_QUEUE_SIZE].ready;
+		}
+
+		if ((sim.event_interval) && (sim.next_event < next)) {
+			next = sim.next_event;
+		}
+
+		// Blocking without anything scheduled would never return
+		if ((milliseconds < 0) && (next == deadline)) {
+			return 0;
+		}
+
+		if ((milliseconds >= 0) && (now >= deadline)) {
+			return 0;
+		}
+
+		const uint64_t wait = (next > now? next - now : 0);
+		const struct timespec ts = { (time_t) (wait / 1000000000ULL), (long) (wait % 1000000000ULL) };
+		nanosleep(&ts, NULL);
+	}
+}
+
+static uint32_t test_events = 0;
+static uint64_t test_last_event = 0;
+static uint64_t test_event_gap = 0;
+
+static void test_event(uint64_t timestamp,
+					   device_mcu_event_type event,
+					   uint8_t brightness,
+					   const char* msg) {
+	(void) timestamp;
+	(void) brightness;
+	(void) msg;
+
+	if (event != DEVICE_MCU_EVENT_SCREEN_ON) {
+		return;
+	}
+
+	const uint64_t now = device_time_now();
+
+	if ((test_last_event) && (now - test_last_event > test_event_gap)) {
+		test_event_gap = now - test_last_event;
+	}
+
+	test_last_event = now;
+	test_events++;
+}
+
+static bool test_check(const char* name, bool passed) {
+	if (!passed) {
+		printf("%s: FAILED\n", name);
+	}
+
+	return passed;
+}
+
+static uint64_t test_read_until(device_mcu_type* device, uint64_t until) {
+	uint64_t read_max = 0;
+	uint64_t now = device_time_now();
+
+	while (now < until) {
+		device_mcu_read(device, 1);
+
+		const uint64_t next = device_time_now();
+
+		if (next - now > read_max) {
+			read_max = next - now;
+		}
+
+		now = next;
+	}
+
+	return read_max;
+}
+
+static bool test_burst(device_mcu_type* device) {
+	const uint64_t start = device_time_now();
+	uint64_t read_max = 0;
+	uint32_t requests = 0;
+	uint8_t value = 0;
+
+	sim.ack_delay = TEST_ACK_DELAY_MS * DEVICE_TIME_MS;
+	sim.event_interval = TEST_EVENT_INTERVAL_MS * DEVICE_TIME_MS;
+	sim.next_event = start;
+
+	// One request per millisecond, every send interval only the latest one should reach the device
+	while (device_time_now() - start < TEST_BURST_MS * DEVICE_TIME_MS) {
+		value = (uint8_t) (requests % 8);
+
+		if (DEVICE_MCU_ERROR_NO_ERROR == device_mcu_request(device, DEVICE_MCU_COMMAND_BRIGHTNESS, 1, 10, value)) {
+			requests++;
+		}
+
+		const uint64_t read = test_read_until(device, device_time_now() + DEVICE_TIME_MS);
+
+		if (read > read_max) {
+			read_max = read;
+		}
+	}
+
+	const uint64_t drain = test_read_until(device, device_time_now() + TEST_DRAIN_MS * DEVICE_TIME_MS);
+
+	if (drain > read_max) {
+		read_max = drain;
+	}
+
+	sim.event_interval = 0;
+
+	device_mcu_command_stats_type stats;
+	device_mcu_state_type state;
+
+	device_mcu_get_command_stats(device, DEVICE_MCU_COMMAND_BRIGHTNESS, &stats);
+	device_mcu_get_state(device, &state);
+
+	printf("burst: %u requests, %u sent, %u coalesced, %u failed, latency max %.1f ms\n",
+		   stats.requested, stats.sent, stats.coalesced, stats.failed, (double) stats.latency_max / 1e6);
+	printf("burst: %u events, longest gap %.1f ms, longest read %.1f ms (acknowledgement after %d ms)\n",
+		   test_events, (double) test_event_gap / 1e6, (double) read_max / 1e6, TEST_ACK_DELAY_MS);
+
+	bool passed = true;
+
+	passed &= test_check("all requests accounted", stats.requested == stats.sent + stats.coalesced + stats.failed);
+	passed &= test_check("no failures", stats.failed == 0);
+	passed &= test_check("sends limited", stats.sent <= TEST_BURST_MS / DEVICE_MCU_COMMAND_INTERVAL_MS + 2);
+	passed &= test_check("last value applied", (state.brightness == value) && (sim.brightness == value));
+	passed &= test_check("reads not blocked", read_max < TEST_ACK_DELAY_MS * DEVICE_TIME_MS);
+	passed &= test_check("events delivered", test_event_gap < TEST_ACK_DELAY_MS * DEVICE_TIME_MS);
+	return passed;
+}
+
+static bool test_arbitration(device_mcu_type* device) {
+	bool passed = true;
+
+	sim.ack_delay = 0;
+
+	passed &= test_check("owner request", DEVICE_MCU_ERROR_NO_ERROR == device_mcu_request(
+			device, DEVICE_MCU_COMMAND_DISPLAY_MODE, 2, 20, DEVICE_MCU_DISPLAY_MODE_1920x1080_60
+	));
+
+	test_read_until(device, device_time_now() + 2 * DEVICE_MCU_COMMAND_INTERVAL_MS * DEVICE_TIME_MS);
+
+	passed &= test_check("lower priority held off", DEVICE_MCU_ERROR_BUSY == device_mcu_request(
+			device, DEVICE_MCU_COMMAND_DISPLAY_MODE, 3, 5, DEVICE_MCU_DISPLAY_MODE_3840x1080_60_SBS
+	));
+
+	passed &= test_check("owner may lower priority", DEVICE_MCU_ERROR_NO_ERROR == device_mcu_request(
+			device, DEVICE_MCU_COMMAND_DISPLAY_MODE, 2, 0, DEVICE_MCU_DISPLAY_MODE_3840x1080_60_SBS
+	));
+
+	test_read_until(device, device_time_now() + 2 * DEVICE_MCU_COMMAND_INTERVAL_MS * DEVICE_TIME_MS);
+
+	passed &= test_check("owner change applied", sim.disp_mode == DEVICE_MCU_DISPLAY_MODE_3840x1080_60_SBS);
+
+	printf("arbitration: %s\n", passed? "passed" : "FAILED");
+	return passed;
+}
+
+int main(int argc, char** argv) {
+	(void) argc;
+	(void) argv;
+
+	device_mcu_type dev;
+
+	sim.brightness = 3;
+	sim.disp_mode = DEVICE_MCU_DISPLAY_MODE_1920x1080_60;
+
+	if (DEVICE_MCU_ERROR_NO_ERROR != device_mcu_open(&dev, test_event)) {
+		printf("open: FAILED\n");
+		return 1;
+	}
+
+	bool passed = true;
+
+	passed &= test_burst(&dev);
+	passed &= test_arbitration(&dev);
+
+	device_mcu_close(&dev);
+	return passed? 0 : 1;
+}